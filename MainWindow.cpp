@@ -7,8 +7,11 @@
 
 #include "ui_MainWindow.h"
 #include "iv_greeks.h"
+#include "iv_batch.h"
+#include "snapshot_file.h"
 
 #include "WebSocketClient.h"
+#include "ingest_engine.h"
 #include "ux_support.h"
 #include "engine_helpers.h"
 
@@ -35,15 +38,16 @@
 #include <QTableWidget>
 #include <QVBoxLayout>
 #include <QSettings>
+#include <QStandardPaths>
+#include <QDir>
 #include <QCheckBox>
 #include <QSpinBox>
 #include <QComboBox>
 #include <QDoubleSpinBox>
 #include <vector>
+#include <cstring>
+#include <memory>
 
-#ifdef HAS_IV_SOLVER
-#include "iv_greeks.h"
-#endif
 // ← plotLine() から使うので前方宣言
 static int clamp_i(int x, int lo, int hi);
 
@@ -111,16 +115,7 @@ static void plotLine(QChartView* view,
 
 static double trySolveIV(bool isCall, double price, double S, double K, double minutes)
 {
-#ifdef HAS_IV_SOLVER
-    // ※ iv_greeks.h 側のシグネチャ・名前空間が異なる場合はここだけ合わせればOK
-    auto gk = IVGreeks::solveAndGreeks(
-        isCall ? OptionCP::Call : OptionCP::Put,
-        price, S, K, minutes, 0.0, 0.0);
-    return gk.iv;
-#else
-    (void)isCall; (void)price; (void)S; (void)K; (void)minutes;
-    return 0.0;
-#endif
+    return IvBatch::solveOne(isCall, price, S, K, minutes).iv;
 }
 
 // --- SI表記とツールチップ付きセル ---
@@ -204,7 +199,7 @@ static void loadPrefs(MainWindow* self) {
         const int idx = cmb->findText(want, Qt::MatchFixedString);
         if (idx >= 0) cmb->setCurrentIndex(idx);
     }
-    // 満期は銘柄一覧取得後（onRpc 内）で復元する
+    // 満期は銘柄一覧取得後（onInstruments 内）で復元する
 }
 
 static void savePrefs(const MainWindow* self) {
@@ -247,8 +242,112 @@ static void storeBackfillWatermarkMs(qint64 toMs) {
     s.sync();
 }
 
+// ---- フル履歴の trade_seq カーソル（銘柄名 → 次に取る seq）----
+static QHash<QString, qint64> loadSeqCursors() {
+    QSettings s("BTC_OP_V2", "BTC_OP_V2");
+    QHash<QString, qint64> out;
+    const QVariantMap m = s.value("cache/tradeSeqCursor").toMap();
+    for (auto it = m.cbegin(); it != m.cend(); ++it) out.insert(it.key(), it.value().toLongLong());
+    return out;
+}
+static void storeSeqCursors(const QHash<QString, qint64>& cursors) {
+    QSettings s("BTC_OP_V2", "BTC_OP_V2");
+    QVariantMap m;
+    for (auto it = cursors.cbegin(); it != cursors.cend(); ++it) m.insert(it.key(), it.value());
+    s.setValue("cache/tradeSeqCursor", m);
+    s.sync();
+}
+
 // ============ 状態スナップショット（残存・アンカー・Auto閾値用サンプルなど） ============
+static QString snapshotPath() {
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+    QDir().mkpath(dir);
+    return dir + "/state.snap";
+}
+
 bool MainWindow::loadSnapshot() {
+    // 既定はバイナリファイル。無ければ旧形式（QSettings の JSON）から引き継ぐ
+    m_snapJournalGen = 0;
+    const bool loaded = loadSnapshotFile(snapshotPath()) || loadSnapshotJson();
+    if (!loaded && m_journal.isOpen()) {   // ジャーナルだけで組み直す（手元の状態と二重にしない）
+        m_clusters.clear();
+        m_dedup.clear();
+    }
+
+    // チェックポイント以降の差分をジャーナルから重ねる（異常終了でも直前まで戻る）
+    const qint64 replayed = replayJournal(m_snapJournalGen);
+    m_stateLive = true;
+    if (!loaded && replayed == 0) return false;
+
+    // 即時描画
+    rebuildSignalTableFromResidual();
+    updateExpiryActivityTable();
+    updatePinMapTable();
+    m_curveRebuild = true;
+    updateCurves();
+
+    ui->plainTextEdit->appendPlainText(QString("[情報] 前回スナップショットを復元しました（%1キー・ジャーナル%2件）。")
+        .arg(m_clusters.size()).arg(replayed));
+    return true;
+}
+
+// fromGen 以降のジャーナルを残存へ重ねる（重複判定も進める）。戻り値は反映した件数
+qint64 MainWindow::replayJournal(quint64 fromGen) {
+    QVector<InstId> idOf(m_store.nameCount(), INVALID_INST);     // nameId → InstId
+    for (int i = 0; i < idOf.size(); ++i) idOf[i] = m_reg.find(m_store.name(quint32(i)));
+
+    qint64 n = 0;
+    m_journal.replay(fromGen, [&](const JournalRecord& r) {
+        const InstId id = (r.nameId < quint32(idOf.size())) ? idOf[int(r.nameId)] : INVALID_INST;
+        if (m_dedup.seen(id, r.tradeSeq, 0, r.ts)) return;
+        const int s = m_clusters.slot(m_clusters.makeKey(r.expMs, r.isCall != 0, r.strike));
+        m_clusters.addTrade(s, r.ts, r.signedAmt, r.dVol, id);
+        ++n;
+        });
+    return n;
+}
+
+bool MainWindow::loadSnapshotFile(const QString& path) {
+    SnapshotData d;
+    if (!SnapshotFile::load(path, d)) return false;
+
+    m_lastSnapshotTs = d.ts;
+    m_snapJournalGen = d.journalGen;
+
+    // 保存時の文字列表の添字 → 今回の銘柄表の ID（未登録は INVALID_INST）
+    QVector<InstId> idOf(d.names.size(), INVALID_INST);
+    for (int i = 0; i < d.names.size(); ++i) idOf[i] = m_reg.find(d.names[i]);
+
+    m_clusters.clear();
+    for (int c = 0; c < d.clusterCount(); ++c) {
+        const int s = m_clusters.slot(m_clusters.makeKey(d.expMs[c], d.isCall[c] != 0, d.strike[c]));
+        m_clusters.restore(s, d.qty[c], d.signedQty[c], d.dVol[c], d.lastTs[c], d.trades[c]);
+        m_clusters.setAnchorTs(s, d.anchorTs[c]);
+        for (quint32 k = d.instOfs[c]; k < d.instOfs[c + 1]; ++k)
+            m_clusters.addInst(s, idOf[int(d.instList[int(k)])]);
+    }
+
+    if (d.amtSketch.isEmpty() || !m_amtSketch.fromJson(QJsonDocument::fromJson(d.amtSketch).object()))
+        m_amtSketch.clear();
+    refreshAutoBigUnit(QDateTime::currentMSecsSinceEpoch());   // 復元した分布で最初の判定から
+
+    m_dedup.clear();
+    m_lastIV.fill(0.0);
+    m_lastDelta.fill(0.0);
+    for (int i = 0; i < idOf.size(); ++i) {
+        const InstId id = idOf[i];
+        if (id == INVALID_INST) continue;
+        if (i < d.lastIV.size() && int(id) < m_lastIV.size())       m_lastIV[int(id)] = d.lastIV[i];
+        if (i < d.lastDelta.size() && int(id) < m_lastDelta.size()) m_lastDelta[int(id)] = d.lastDelta[i];
+        if (i + 1 < d.seqOfs.size())
+            m_dedup.setRanges(id, d.seqRanges.constData() + 2 * qsizetype(d.seqOfs[i]),
+                int(d.seqOfs[i + 1] - d.seqOfs[i]));
+    }
+    return true;
+}
+
+// 旧形式（QSettings の state/snapshot に JSON）。次回の保存でバイナリへ移る
+bool MainWindow::loadSnapshotJson() {
     QSettings s("BTC_OP_V2", "BTC_OP_V2");
     const QByteArray blob = s.value("state/snapshot").toByteArray();
     if (blob.isEmpty()) return false;
@@ -261,131 +360,158 @@ bool MainWindow::loadSnapshot() {
     // 1) 前回保存時刻
     m_lastSnapshotTs = qint64(o.value("ts").toDouble());
 
-    // 2) マップ類
-    auto loadMapD = [&](const char* key, QHash<QString, double>& dst) {
-        dst.clear();
-        const QJsonObject m = o.value(key).toObject();
-        for (auto it = m.begin(); it != m.end(); ++it) dst.insert(it.key(), it.value().toDouble());
-        };
-    auto loadMapI64 = [&](const char* key, QHash<QString, qint64>& dst) {
-        dst.clear();
-        const QJsonObject m = o.value(key).toObject();
-        for (auto it = m.begin(); it != m.end(); ++it) dst.insert(it.key(), qint64(it.value().toDouble()));
-        };
-    auto loadMapI = [&](const char* key, QHash<QString, int>& dst) {
-        dst.clear();
-        const QJsonObject m = o.value(key).toObject();
-        for (auto it = m.begin(); it != m.end(); ++it) dst.insert(it.key(), it.value().toInt());
-        };
-    auto loadMapSet = [&](const char* key, QHash<QString, QSet<QString>>& dst) {
-        dst.clear();
-        const QJsonObject m = o.value(key).toObject();
-        for (auto it = m.begin(); it != m.end(); ++it) {
-            QSet<QString> set;
-            for (const auto& v : it.value().toArray()) set.insert(v.toString());
-            dst.insert(it.key(), set);
+    // 2) クラスタ（キーは "exp|isCall|k" 文字列で保存してある）
+    m_clusters.clear();
+    {
+        const QJsonObject mQty = o.value("residualQty").toObject();
+        const QJsonObject mDVol = o.value("residualDVol").toObject();
+        const QJsonObject mSigned = o.value("residualSignedQty").toObject();
+        const QJsonObject mLastTs = o.value("residualLastTs").toObject();
+        const QJsonObject mTrades = o.value("residualTrades").toObject();
+        const QJsonObject mInsts = o.value("residualInsts").toObject();
+        const QJsonObject mAnchor = o.value("signalAnchorTs").toObject();
+        for (auto it = mQty.begin(); it != mQty.end(); ++it) {
+            const ClusterBook::Key key = m_clusters.keyFromString(it.key());
+            if (key == ClusterBook::INVALID_KEY) continue;
+            const int c = m_clusters.slot(key);
+            m_clusters.restore(c, it.value().toDouble(),
+                mSigned.value(it.key()).toDouble(),
+                mDVol.value(it.key()).toDouble(),
+                qint64(mLastTs.value(it.key()).toDouble()),
+                mTrades.value(it.key()).toInt());
+            m_clusters.setAnchorTs(c, qint64(mAnchor.value(it.key()).toDouble()));
+            // 銘柄は名前で保存してあるので、今回の銘柄表で ID に引き直す（未登録は捨てる）
+            for (const auto& v : mInsts.value(it.key()).toArray())
+                m_clusters.addInst(c, m_reg.find(v.toString()));
         }
-        };
-
-    loadMapD("residualQty", m_residualQtyByKey);
-    loadMapD("residualDVol", m_residualDVolByKey);
-    loadMapD("residualSignedQty", m_residualSignedQtyByKey);
-    loadMapI64("residualLastTs", m_residualLastTsByKey);
-    loadMapI("residualTrades", m_residualTradesByKey);
-    loadMapSet("residualInsts", m_residualInstsByKey);
-    loadMapI64("signalAnchorTs", m_signalAnchorTsByKey);
-
-    // Auto 閾値用サンプル（直近だけでOK）
-    m_amtSamples.clear();
-    for (const auto& v : o.value("amtSamples").toArray()) {
-        const auto a = v.toArray();
-        if (a.size() == 2) m_amtSamples.append(AmtSample{ qint64(a[0].toDouble()), a[1].toDouble() });
     }
 
-    // 代表I// 代表IV/Δ（任意・あれば復元）
-    m_lastIV.clear();
-    {
-        const QJsonObject lastIVObj = o.value("lastIV").toObject();
-        for (auto it = lastIVObj.begin(); it != lastIVObj.end(); ++it) {
-            m_lastIV.insert(it.key(), it.value().toDouble());
+    auto loadInstVec = [&](const char* key, QVector<double>& dst) {
+        dst.fill(0.0);
+        const QJsonObject m = o.value(key).toObject();
+        for (auto it = m.begin(); it != m.end(); ++it) {
+            const InstId id = m_reg.find(it.key());
+            if (id != INVALID_INST && int(id) < dst.size()) dst[int(id)] = it.value().toDouble();
         }
-    }
+        };
 
-    m_lastDelta.clear();
-    {
-        const QJsonObject lastDeltaObj = o.value("lastDelta").toObject();
-        for (auto it = lastDeltaObj.begin(); it != lastDeltaObj.end(); ++it) {
-            m_lastDelta.insert(it.key(), it.value().toDouble());
+    // Auto 閾値用の分布（無ければ旧形式のサンプル列から起こす）
+    if (!m_amtSketch.fromJson(o.value("amtSketch").toObject())) {
+        m_amtSketch.clear();
+        for (const auto& v : o.value("amtSamples").toArray()) {
+            const auto a = v.toArray();
+            if (a.size() == 2) m_amtSketch.add(qint64(a[0].toDouble()), a[1].toDouble());
         }
     }
+    refreshAutoBigUnit(QDateTime::currentMSecsSinceEpoch());
 
-    // 即時描画
-    rebuildSignalTableFromResidual();
-    updateExpiryActivityTable();
-    updatePinMapTable();
-    updateCurvesTables();
-    updateCurvesCharts();
+    // 取り込み済み trade_seq（残存と対。無ければ空から）
+    m_dedup.clear();
+    m_dedup.fromJson(o.value("seenSeq").toObject(), m_reg);
 
-    ui->plainTextEdit->appendPlainText(QString("[情報] 前回スナップショットを復元しました（%1キー）。")
-        .arg(m_residualQtyByKey.size()));
+    // 代表IV/Δ（任意・あれば復元）
+    loadInstVec("lastIV", m_lastIV);
+    loadInstVec("lastDelta", m_lastDelta);
     return true;
 }
 
-void MainWindow::saveSnapshot() const {
+// 残存・銘柄ごとの値を列に詰める（GUI スレッド外からも呼ぶので写しだけを読む）
+static SnapshotData buildSnapshotData(const ClusterBook& clusters, const InstrumentRegistry& reg,
+    const QVector<double>& lastIV, const QVector<double>& lastDelta, const TradeDedup& dedup) {
+    SnapshotData d;
+
+    // 文字列表は銘柄表そのまま（添字 = InstId）
+    const int nInst = reg.size();
+    d.names.reserve(nInst);
+    d.lastIV.resize(nInst, 0.0);
+    d.lastDelta.resize(nInst, 0.0);
+    d.seqOfs.reserve(nInst + 1);
+    d.seqOfs.push_back(0);
+    for (int i = 0; i < nInst; ++i) {
+        d.addName(reg.name(InstId(i)));
+        if (i < lastIV.size())    d.lastIV[i] = lastIV[i];
+        if (i < lastDelta.size()) d.lastDelta[i] = lastDelta[i];
+        // 残存に入れた約定の trade_seq（次回のバックフィルで二重計上しないため）
+        dedup.appendRanges(InstId(i), d.seqRanges);
+        d.seqOfs.push_back(quint32(d.seqRanges.size() / 2));
+    }
+
+    const int nc = clusters.size();
+    d.expMs.reserve(nc); d.isCall.reserve(nc); d.strike.reserve(nc);
+    d.qty.reserve(nc); d.signedQty.reserve(nc); d.dVol.reserve(nc);
+    d.lastTs.reserve(nc); d.anchorTs.reserve(nc); d.trades.reserve(nc);
+    d.instOfs.reserve(nc + 1);
+    d.instOfs.push_back(0);
+    for (int c = 0; c < nc; ++c) {
+        const ClusterBook::Key key = clusters.key(c);
+        d.expMs.push_back(clusters.expiryMs(c));
+        d.isCall.push_back(quint8(clusters.isCall(c) ? 1 : 0));
+        d.strike.push_back(qint32(ClusterBook::strikeOf(key)));
+        d.qty.push_back(clusters.qty(c));
+        d.signedQty.push_back(clusters.signedQty(c));
+        d.dVol.push_back(clusters.dVol(c));
+        d.lastTs.push_back(clusters.lastTs(c));
+        d.anchorTs.push_back(clusters.anchorTs(c));
+        d.trades.push_back(qint32(clusters.trades(c)));
+        clusters.forEachInst(c, [&](InstId id) { if (reg.valid(id)) d.instList.push_back(quint32(id)); });
+        d.instOfs.push_back(quint32(d.instList.size()));
+    }
+    return d;
+}
+
+bool MainWindow::saveSnapshot(quint64 journalGen) const {
+    SnapshotData d = buildSnapshotData(m_clusters, m_reg, m_lastIV, m_lastDelta, m_dedup);
+    d.ts = QDateTime::currentMSecsSinceEpoch();
+    d.journalGen = journalGen;
+
+    // Auto 閾値用の分布（24h 分のヒストグラムごと）
+    d.amtSketch = QJsonDocument(m_amtSketch.toJson()).toJson(QJsonDocument::Compact);
+
+    if (!SnapshotFile::save(snapshotPath(), d)) return false;
+
+    // 旧形式の JSON はもう読まない（レジストリを空ける）
     QSettings s("BTC_OP_V2", "BTC_OP_V2");
+    if (s.contains("state/snapshot")) s.remove("state/snapshot");
+    return true;
+}
 
-    auto dumpMapD = [&](const QHash<QString, double>& src) {
-        QJsonObject m; for (auto it = src.begin(); it != src.end(); ++it) m.insert(it.key(), it.value());
-        return m;
-        };
-    auto dumpMapI64 = [&](const QHash<QString, qint64>& src) {
-        QJsonObject m; for (auto it = src.begin(); it != src.end(); ++it) m.insert(it.key(), double(it.value()));
-        return m;
-        };
-    auto dumpMapI = [&](const QHash<QString, int>& src) {
-        QJsonObject m; for (auto it = src.begin(); it != src.end(); ++it) m.insert(it.key(), it.value());
-        return m;
-        };
-    auto dumpMapSet = [&](const QHash<QString, QSet<QString>>& src) {
-        QJsonObject m;
-        for (auto it = src.begin(); it != src.end(); ++it) {
-            QJsonArray a; for (const auto& s : it.value()) a.append(s);
-            m.insert(it.key(), a);
-        }
-        return m;
-        };
-
-    QJsonObject o;
-    o.insert("ts", double(QDateTime::currentMSecsSinceEpoch()));
-    o.insert("residualQty", dumpMapD(m_residualQtyByKey));
-    o.insert("residualDVol", dumpMapD(m_residualDVolByKey));
-    o.insert("residualSignedQty", dumpMapD(m_residualSignedQtyByKey));
-    o.insert("residualLastTs", dumpMapI64(m_residualLastTsByKey));
-    o.insert("residualTrades", dumpMapI(m_residualTradesByKey));
-    o.insert("residualInsts", dumpMapSet(m_residualInstsByKey));
-    o.insert("signalAnchorTs", dumpMapI64(m_signalAnchorTsByKey));
-
-    // Auto 閾値用サンプルは直近1000件だけ
-    QJsonArray samples;
-    const int sz = static_cast<int>(m_amtSamples.size());
-    const int keep = std::min(1000, sz);
-    for (int i = std::max(0, sz - keep); i < sz; ++i) {
-        const auto& a = m_amtSamples[i];
-        QJsonArray row; row.append(double(a.ts)); row.append(a.absAmt); samples.append(row);
-    }
-    o.insert("amtSamples", samples);
-
-    // 任意
-    o.insert("lastIV", dumpMapD(m_lastIV));
-    o.insert("lastDelta", dumpMapD(m_lastDelta));
-
-    const QByteArray blob = QJsonDocument(o).toJson(QJsonDocument::Compact);
-    s.setValue("state/snapshot", blob);
-    s.sync();
+// 定期チェックポイント：世代を切った瞬間の状態を写し、組み立てと書き出しはワーカーで。
+// 写しは Qt の暗黙共有なのでここでは参照が増えるだけ（以降 GUI 側が書いた列だけ複製される）
+void MainWindow::checkpointAsync() {
+    if (m_ckptBusy || !m_stateLive || !m_journal.isOpen()) return;
+    m_ckptBusy = true;
+
+    const quint64 gen = m_journal.rotate();      // ここまでの記録は gen 未満の世代に入っている
+    const qint64 ts = QDateTime::currentMSecsSinceEpoch();
+    const QString path = snapshotPath();
+    QByteArray sketch = QJsonDocument(m_amtSketch.toJson()).toJson(QJsonDocument::Compact);
+
+    m_ckptPool.start([this, gen, ts, path, sketch = std::move(sketch),
+        clusters = m_clusters, reg = m_reg, iv = m_lastIV, delta = m_lastDelta, dedup = m_dedup]() {
+        SnapshotData d = buildSnapshotData(clusters, reg, iv, delta, dedup);
+        d.ts = ts;
+        d.journalGen = gen;
+        d.amtSketch = sketch;
+        const bool ok = SnapshotFile::save(path, d);
+
+        QMetaObject::invokeMethod(this, [this, ok, gen]() {
+            m_ckptBusy = false;
+            if (ok) m_journal.dropBefore(gen);   // 保存できた分より前はもう要らない
+            }, Qt::QueuedConnection);
+        });
 }
 
 void MainWindow::closeEvent(QCloseEvent* e) {
-    saveSnapshot();                 // 状態保存
+    m_ckptTimer.stop();
+    m_ckptPool.waitForDone();       // 書きかけのチェックポイントを待つ
+    if (m_stateLive) {              // 復元前に閉じたときは前回の保存を上書きしない
+        const quint64 gen = m_journal.rotate();
+        if (saveSnapshot(gen)) m_journal.dropBefore(gen);   // 状態保存
+    }
+    m_journal.close();
+    if (!m_seqCursor.isEmpty()) storeSeqCursors(m_seqCursor);   // フル履歴の続き位置
+    syncTradeStore();
+    m_store.close();
     // もし load/savePrefs を使っているならここで savePrefs(this); を呼ぶ
     QMainWindow::closeEvent(e);
 }
@@ -396,7 +522,6 @@ static constexpr int   AUTO_FLOOR = 50;    // 最低でも 50 枚
 static constexpr int   AUTO_MIN_SAMPLES = 200;   // サンプル不足なら強制 FLOOR
 static constexpr double AUTO_Q = 0.98;  // 98パーセンタイル
 static constexpr int   AUTO_ROUND_STEP = 10;    // 10 枚刻みで切り上げ
-static constexpr qint64 DAY_MS64 = 24ll * 60 * 60 * 1000;
 static constexpr int   ALL_BACK_DAYS = 7; // 「全満期バックフィル」の既定期間（日）。24h制限撤廃。
 // バックフィル時の最小枚数：手動>0なら手動値、Auto(=0)なら1枚で全件保持
 static inline int backfillMinUnit(const Ui::MainWindow* ui) {
@@ -406,16 +531,9 @@ static inline int backfillMinUnit(const Ui::MainWindow* ui) {
     }
     return 1;
 }
-// 24h バッファ管理
+// 24h 分布（古いバケットはスケッチ側で落ちる）
 void MainWindow::pushAmtSample(qint64 ts, double absAmt) {
-    if (!(absAmt > 0.0) || !(ts > 0)) return;
-    m_amtSamples.append(AmtSample{ ts, absAmt });
-    pruneAmtSamples(ts);
-}
-void MainWindow::pruneAmtSamples(qint64 now) {
-    const qint64 cutoff = now - DAY_MS64;
-    while (!m_amtSamples.isEmpty() && m_amtSamples.front().ts < cutoff)
-        m_amtSamples.removeFirst();
+    m_amtSketch.add(ts, absAmt);
 }
 
 // Auto 閾値（枚）の決定
@@ -425,30 +543,23 @@ int MainWindow::currentBigUnit() const {
         int manual = int(std::llround(ui->spinMinSize->value()));
         if (manual > 0) return manual;
     }
+    return m_autoBigUnit;                 // 約定ごとには引き直さない（refreshAutoBigUnit が更新）
+}
 
-    // 24h の全サンプルから分位点
-    const qint64 now = QDateTime::currentMSecsSinceEpoch();
-    // prune（const関数だが軽微なので const_cast で許容、嫌なら呼び出し側でprune）
-    const_cast<MainWindow*>(this)->pruneAmtSamples(now);
-
-    std::vector<double> vals;
-    vals.reserve(size_t(m_amtSamples.size()));
-    for (const auto& s : m_amtSamples) vals.push_back(s.absAmt);
+// 24h 分布から分位点（スケッチ側もキャッシュ済み。バケットが回った時だけ引き直す）
+void MainWindow::refreshAutoBigUnit(qint64 now) {
+    m_amtSketch.advance(now);
 
     int unit = AUTO_FLOOR;
-    if ((int)vals.size() >= AUTO_MIN_SAMPLES) {
-        // nth_element で p 分位
-        const double p = std::clamp(AUTO_Q, 0.0, 1.0);
-        size_t k = (size_t)std::floor((vals.size() - 1) * p);
-        std::nth_element(vals.begin(), vals.begin() + k, vals.end());
-        unit = (int)std::llround(vals[k]);
+    if (m_amtSketch.count() >= AUTO_MIN_SAMPLES) {
+        unit = (int)std::llround(m_amtSketch.quantile(AUTO_Q));
         if (unit < AUTO_FLOOR) unit = AUTO_FLOOR;
     }
     // 10枚刻みに切り上げ
     if (unit % AUTO_ROUND_STEP) {
         unit = ((unit + AUTO_ROUND_STEP - 1) / AUTO_ROUND_STEP) * AUTO_ROUND_STEP;
     }
-    return unit;
+    m_autoBigUnit = unit;
 }
 /* ================= ctor / dtor ================= */
 
@@ -488,11 +599,12 @@ MainWindow::MainWindow(QWidget* parent)
     if (!m_tableLegs) m_tableLegs = findChild<QTableWidget*>("tableLegDetails");
     if (!m_tableLegs) m_tableLegs = findChild<QTableWidget*>("tableLegDetail");
     if (m_tableLegs) {
-        m_tableLegs->setColumnCount(19);
+        m_tableLegs->setColumnCount(24);
         QStringList hdr;
         hdr << "時刻" << "LinkID" << "アグレッサ" << "Venue" << "銘柄" << "Call/Put"
             << "満期" << "行使" << "数量" << "プレミアム" << "通貨" << "乗数M" << "手数料"
-            << "Trade IV" << "NBBO Bid" << "NBBO Ask" << "Mid" << "乖離(bp)" << "OrderID";
+            << "Trade IV" << "NBBO Bid" << "NBBO Ask" << "Mid" << "乖離(bp)"
+            << "板中央(厚み)" << "滑り(bp)" << "食い段数" << "Mark" << "Index" << "OrderID";
         m_tableLegs->setHorizontalHeaderLabels(hdr);
         m_tableLegs->horizontalHeader()->setStretchLastSection(true);
         m_tableLegs->setEditTriggers(QAbstractItemView::NoEditTriggers);
@@ -516,8 +628,8 @@ MainWindow::MainWindow(QWidget* parent)
                 if (!cur.isValid()) return;
                 auto* item = ui->tableSignals->item(cur.row(), 0);
                 if (!item) return;
-                const QString key = item->data(Qt::UserRole).toString();
-                if (!key.isEmpty()) populateLegDetailsForKey(key);
+                const QVariant v = item->data(Qt::UserRole);
+                if (v.isValid()) populateLegDetailsForKey(ClusterBook::Key(v.toULongLong()));
             });
     }
 
@@ -604,29 +716,106 @@ MainWindow::MainWindow(QWidget* parent)
 
     hookUiActions();
 
-    // ---- WS 初期化 ----
-    m_ws = new WebSocketClient(this);
-    connect(m_ws, &WebSocketClient::msgReceived, this, [this](const QJsonObject& o) { handleDeribitMsg(o); });
-    connect(m_ws, &WebSocketClient::rpcReceived, this, [this](int id, const QJsonObject& rep) { onRpc(id, rep); });
+    // ---- WS 初期化（受信・解析はエンジンスレッド、約定は SPSC キュー経由）----
+    m_engine = new IngestEngine(this);
+    m_ws = m_engine->ws();
+    connect(m_engine, &IngestEngine::batchesReady, this, [this] { drainIngest(); });
+    connect(m_ws, &WebSocketClient::msgReceived, this, [this](const QJsonObject& o) {
+        m_liveLastMs = QDateTime::currentMSecsSinceEpoch();
+        handleDeribitMsg(o);
+        });
     connect(m_ws, &WebSocketClient::connected, this, [this] {
+        syncTradeStore();
+        m_liveSinceMs = 0;              // 受信区間は全体購読の最初のバッチから数え直す
         bootstrapAuto();
-        // 全BTCオプションの約定を購読（ログ／満期アクティビティ／残存用）
-        m_ws->subscribe(QStringList() << "trades.option.BTC.raw");
+        // 全BTCオプションの約定を購読（ログ／満期アクティビティ／残存用）と指数（参照価格）
+        m_ws->subscribe(QStringList() << "trades.option.BTC.raw" << "deribit_price_index.btc_usd");
         ui->plainTextEdit->appendPlainText("[情報] BTC全体トレード購読: trades.option.BTC.raw");
         });
-    m_ws->connectPublic();
+    // 切断 → 受信区間を閉じる（再接続後の受信と繋げて“取れていた”ことにしない）
+    connect(m_ws, &WebSocketClient::disconnected, this, [this] {
+        syncTradeStore();
+        m_liveSinceMs = 0;
+        m_wsRttMs = -1.0;
+        m_books.clear();                // 再購読の snapshot から取り直す
+        m_bookResync.clear();
+        ui->plainTextEdit->appendPlainText("[警告] WS切断。再接続します。");
+        });
+    // 再接続（購読は WebSocketClient が復元済み）→ 途切れた区間だけを取り直す
+    connect(m_ws, &WebSocketClient::reconnected, this, [this](qint64 fromMs, qint64 toMs) {
+        m_liveSinceMs = 0;
+        ui->plainTextEdit->appendPlainText(QString("[情報] WS再接続（%1秒途切れ）。購読を復元しました。")
+            .arg(std::max<qint64>(0, toMs - fromMs) / 1000));
+        backfillDisconnectGap(fromMs, toMs);
+        // 起動直後の取得が切断で落ちていたら取り直す（connected は初回しか来ない）
+        if (m_instruments.isEmpty()) requestInstruments();
+        if (m_underlyingPx <= 0.0) requestPerpTicker();
+        });
+    connect(m_ws, &WebSocketClient::rttMeasured, this, [this](double ms) { m_wsRttMs = ms; });
+    m_engine->start();
+
+    // ---- REST は全てスケジューラ経由（優先度：IV/ticker > 差分 > フル履歴）----
+    m_sched = new RequestScheduler(&m_net, this);
+    {
+        // public/* は接続中の WS で出す（net/restOverWs=false で従来どおり HTTPS）
+        QSettings s("BTC_OP_V2", "BTC_OP_V2");
+        if (s.value("net/restOverWs", true).toBool()) m_sched->setRpcTransport(m_ws);
+    }
+    m_decoder = new HistoryDecoder(this);     // 履歴応答の解析はワーカープールで
+
+    // ---- ローカル約定ストア（取得済み区間は次回起動時にディスクから再生）----
+    {
+        const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/trades";
+        if (!m_store.open(dir))
+            ui->plainTextEdit->appendPlainText(QString("[警告] 約定ストアを開けません: %1").arg(dir));
+    }
+
+    // ---- 残存のジャーナル（銘柄はストアの名前表の番号で持つので、ストアが開けた時だけ）----
+    // 復元後に定期チェックポイント（既定300s毎、state/checkpointSec で変更）
+    if (m_store.isOpen()) {
+        const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/journal";
+        if (!m_journal.open(dir))
+            ui->plainTextEdit->appendPlainText(QString("[警告] ジャーナルを開けません: %1").arg(dir));
+    }
+    {
+        QSettings s("BTC_OP_V2", "BTC_OP_V2");
+        const int sec = std::clamp(s.value("state/checkpointSec", 300).toInt(), 30, 3600);
+        m_ckptPool.setMaxThreadCount(1);
+        m_ckptPool.setObjectName(QStringLiteral("Checkpoint"));
+        connect(&m_ckptTimer, &QTimer::timeout, this, [this] { checkpointAsync(); });
+        m_ckptTimer.setInterval(sec * 1000);
+        m_ckptTimer.start();
+    }
 
-    // ---- IV オンデマンド取得ポンプ（200msに1件・同時1）----
+    // ---- IV オンデマンド取得ポンプ（スナップショットの取りこぼし用。200ms毎・同時 IV_MAX_INFLIGHT）----
     connect(&m_ivTimer, &QTimer::timeout, this, [this] { pumpIV(); });
     m_ivTimer.setInterval(200);
     m_ivTimer.start();
 
-    // ---- OI 定期取得（60s毎）----
-    connect(&m_oiTimer, &QTimer::timeout, this, [this] { requestOIAll(); });
-    m_oiTimer.setInterval(60 * 1000);
-    m_oiTimer.start();
+    // ---- IV/NBBO/OI の一括スナップショット（既定15s毎、market/snapshotSec で変更）----
+    {
+        QSettings s("BTC_OP_V2", "BTC_OP_V2");
+        const int sec = std::clamp(s.value("market/snapshotSec", 15).toInt(), 5, 600);
+        connect(&m_snapTimer, &QTimer::timeout, this, [this] { requestMarketSnapshot(); });
+        m_snapTimer.setInterval(sec * 1000);
+        m_snapTimer.start();
+    }
+
+    // ---- 参照価格の更新幅（既定5bp、market/spotThresholdBp で変更）----
+    {
+        QSettings s("BTC_OP_V2", "BTC_OP_V2");
+        m_spot.setThresholdBp(std::clamp(s.value("market/spotThresholdBp", SpotState::DEFAULT_THRESHOLD_BP).toDouble(), 0.0, 500.0));
+    }
+
+    // ---- L2 板（購読銘柄の book.*.100ms。market/bookDepth=false で取らない）----
+    {
+        QSettings s("BTC_OP_V2", "BTC_OP_V2");
+        m_bookDepth = s.value("market/bookDepth", true).toBool();
+    }
 
     // ---- UI 1秒更新 ----
+    m_dVolWheel.addWindow(ONE_MIN_MS);
+    m_dVolWheel.addWindow(FIVE_MIN_MS);
     connect(&m_uiTick, &QTimer::timeout, this, [this] {
         const qint64 now = QDateTime::currentMSecsSinceEpoch();
         pruneOld(now);
@@ -638,8 +827,8 @@ MainWindow::MainWindow(QWidget* parent)
 
         QString ivText = "-";
         if (!m_targetInstruments.isEmpty()) {
-            const auto& inst0 = m_targetInstruments.front();
-            if (m_lastIV.contains(inst0)) ivText = fmt2(m_lastIV.value(inst0));
+            const double iv0 = lastIVOf(m_reg.find(m_targetInstruments.front()));
+            if (iv0 > 0.0) ivText = fmt2(iv0);
         }
         ui->valueIV->setText(ivText);
 
@@ -653,15 +842,31 @@ MainWindow::MainWindow(QWidget* parent)
 
         // 満期カーブ（GEX/Vanna/Charm）も1〜2秒に1回
         if (++m_curvesTick >= 2) {
-            updateCurvesTables();
-            updateCurvesCharts();
+            updateCurves();
             m_curvesTick = 0;
         }
 
-        statusBar()->showMessage(QString("Δ-Vol 1分 %1 | 5分 %2 | 代表IV %3 | 大口閾値 %4枚")
-            .arg(fmt2(d1m)).arg(fmt2(d5m)).arg(ivText).arg(currentBigUnit()));
+        // 約定ストアは5秒に1回まとめて書く
+        if (++m_storeTick >= 5) {
+            syncTradeStore();
+            m_storeTick = 0;
+        }
+
+        const QString rttText = (m_wsRttMs >= 0.0) ? QString("%1ms").arg(m_wsRttMs, 0, 'f', 0) : QStringLiteral("-");
+        const QString spotText = m_spot.valid() ? fmt2(m_spot.live()) : QStringLiteral("-");
+        statusBar()->showMessage(QString("Δ-Vol 1分 %1 | 5分 %2 | 代表IV %3 | 大口閾値 %4枚 | RTT %5 | 指数 %6 | 板再同期 %7")
+            .arg(fmt2(d1m)).arg(fmt2(d5m)).arg(ivText).arg(currentBigUnit()).arg(rttText).arg(spotText)
+            .arg(m_bookResyncs));
         });
     m_uiTick.start(1000);
+
+    // ---- 描画フレーム（既定30Hz、20〜60Hzで設定可）----
+    {
+        QSettings s("BTC_OP_V2", "BTC_OP_V2");
+        const int hz = std::clamp(s.value("ui/frameHz", 30).toInt(), 20, 60);
+        connect(&m_frameTimer, &QTimer::timeout, this, [this] { flushUiFrame(); });
+        m_frameTimer.start(1000 / hz);
+    }
 }
 
 MainWindow::~MainWindow() { delete ui; }
@@ -679,8 +884,7 @@ void MainWindow::hookUiActions() {
         });
     connect(ui->btnResubscribe, &QPushButton::clicked, this, [this] { m_subscribedOnce = false; chooseAndSubscribe(); });
     connect(ui->btnRefresh, &QPushButton::clicked, this, [this] {
-        QJsonObject p; p["currency"] = "BTC"; p["kind"] = "option"; p["expired"] = false;
-        m_idGetInstruments = m_ws->call("public/get_instruments", p);
+        requestInstruments();
         });
     connect(ui->btnClearTape, &QPushButton::clicked, this, [this] { ui->plainTextEdit->clear(); });
     connect(ui->btnSaveTape, &QPushButton::clicked, this, [this] {
@@ -702,67 +906,102 @@ void MainWindow::hookUiActions() {
 
 /* ================= WS / RPC ================= */
 
+// WS の request 応答（REST と同じ形）から result を取り出す。失敗時は Undefined
+static QJsonValue rpcResult(const WebSocketClient::RpcReply& r) {
+    if (!r.ok()) return QJsonValue(QJsonValue::Undefined);
+    return QJsonDocument::fromJson(r.body).object().value("result");
+}
+
 void MainWindow::bootstrapAuto() {
     ui->plainTextEdit->appendPlainText("[情報] WS接続完了。銘柄一覧とPERP価格を取得します。");
+    requestInstruments();
+    requestPerpTicker();
+}
+
+// 応答が来ないまま時間切れなら少し置いて出し直す。切断で落ちた分は reconnected で取り直す
+static constexpr int BOOTSTRAP_RETRY_MS = 3000;
+
+void MainWindow::requestPerpTicker() {
+    QJsonObject p; p["instrument_name"] = "BTC-PERPETUAL";
+    m_ws->request("public/ticker", p, this, [this](const WebSocketClient::RpcReply& r) {
+        const QJsonValue res = rpcResult(r);
+        if (res.isObject()) { onPerpTicker(res.toObject()); return; }
+        if (r.timedOut)
+            QTimer::singleShot(BOOTSTRAP_RETRY_MS, this, [this] { if (m_underlyingPx <= 0.0) requestPerpTicker(); });
+        });
+}
+
+void MainWindow::requestInstruments() {
+    QJsonObject p; p["currency"] = "BTC"; p["kind"] = "option"; p["expired"] = false;
+    m_ws->request("public/get_instruments", p, this, [this](const WebSocketClient::RpcReply& r) {
+        const QJsonValue res = rpcResult(r);
+        if (res.isArray()) { onInstruments(res.toArray()); return; }
+        if (!r.ok()) ui->plainTextEdit->appendPlainText(QString("[警告] 銘柄一覧の取得に失敗: %1").arg(r.error));
+        if (r.timedOut)
+            QTimer::singleShot(BOOTSTRAP_RETRY_MS, this, [this] { if (m_instruments.isEmpty()) requestInstruments(); });
+        });
+}
 
-    QJsonObject p1; p1["currency"] = "BTC"; p1["kind"] = "option"; p1["expired"] = false;
-    m_idGetInstruments = m_ws->call("public/get_instruments", p1);
+void MainWindow::onPerpTicker(const QJsonObject& o) {
+    const double idx = o.value("index_price").toDouble();
+    const double last = o.value("last_price").toDouble();
+    qint64 ts = qint64(o.value("timestamp").toDouble());
+    if (ts <= 0) ts = QDateTime::currentMSecsSinceEpoch();
+    onSpot(idx > 0.0 ? idx : last, ts);
+    ui->plainTextEdit->appendPlainText(QString("[情報] 参照価格: %1").arg(fmt2(m_underlyingPx)));
+    subscribeWhenReady();
+}
+
+void MainWindow::onSpot(double px, qint64 ts) {
+    if (!m_spot.update(px, ts)) return;
+    m_underlyingPx = m_spot.px();
 
-    QJsonObject p2; p2["instrument_name"] = "BTC-PERPETUAL";
-    m_idPerpTicker = m_ws->call("public/ticker", p2);
+    // 参照価格に依存する表示だけ次フレームで作り直す（残存の dVol は約定時点の Δ のまま）。
+    // シグナル表は行ごとの差し替え（想定元本・Δ推定）で足りる
+    m_dirty.curves = true;
+    m_dirty.pinMap = true;
+    for (auto it = m_signalRowIndexByKey.cbegin(); it != m_signalRowIndexByKey.cend(); ++it)
+        m_dirty.clusterKeys.insert(it.key());
+
+    // PERP の ticker が落ちても指数が来れば初回購読へ進める（済んでいれば何もしない）
+    subscribeWhenReady();
 }
 
-void MainWindow::onRpc(int id, const QJsonObject& reply) {
-    if (!reply.contains("result")) return;
-    const auto res = reply.value("result");
+void MainWindow::onInstruments(const QJsonArray& list) {
+    m_instruments = list;
+    ui->plainTextEdit->appendPlainText(QString("[情報] 銘柄を取得: %1件").arg(m_instruments.size()));
 
-    if (id == m_idPerpTicker) {
-        const auto o = res.toObject();
-        const double idx = o.value("index_price").toDouble();
-        const double last = o.value("last_price").toDouble();
-        m_underlyingPx = (idx > 0.0 ? idx : last);
-        ui->plainTextEdit->appendPlainText(QString("[情報] 参照価格: %1").arg(fmt2(m_underlyingPx)));
+    // 銘柄表（ID・行使・満期・CP・tick）を更新し、受信スレッドにも配る
+    m_reg.ingest(m_instruments);
+    resizeInstStores();
+    {
+        auto reg = std::make_shared<const InstrumentRegistry>(m_reg);
+        m_engine->setRegistry(reg);
+        m_decoder->setRegistry(std::move(reg));
     }
-    else if (id == m_idGetInstruments) {
-        if (!res.isArray()) return;
-        m_instruments = res.toArray();
-        ui->plainTextEdit->appendPlainText(QString("[情報] 銘柄を取得: %1件").arg(m_instruments.size()));
 
-        // inst→expiry
-        m_instToExpiryMs.clear();
-        QVector<qint64> exps; exps.reserve(m_instruments.size());
-        for (const auto& v : m_instruments) {
-            if (!v.isObject()) continue;
-            const auto o = v.toObject();
-            if (!o.value("is_active").toBool(true)) continue;
-            const QString name = o.value("instrument_name").toString();
-            const qint64  exp = (qint64)o.value("expiration_timestamp").toDouble();
-            if (!name.isEmpty() && exp > 0) {
-                m_instToExpiryMs.insert(name, exp);
-                exps.push_back(exp);
-            }
-        }
-        std::sort(exps.begin(), exps.end());
-        exps.erase(std::unique(exps.begin(), exps.end()), exps.end());
-        m_nearestExpiryMs = exps.isEmpty() ? 0 : exps.front();
+    const QVector<qint64> exps = m_reg.activeExpiries();
+    m_nearestExpiryMs = exps.isEmpty() ? 0 : exps.front();
 
-        populateExpiryChoices();                 // ここで先頭に All を入れる
-        ui->comboExpiry->setCurrentIndex(0);     // 表示フィルタは All
+    populateExpiryChoices();                 // ここで先頭に All を入れる
+    ui->comboExpiry->setCurrentIndex(0);     // 表示フィルタは All
 
-        const bool restored = loadSnapshot();
-        // 先に直近7日(または前回停止点→今)の差分を回す → 右画面がすぐ埋まる
-        ui->plainTextEdit->appendPlainText("[情報] 直近差分の取り込みを開始します（初回は過去7日）。");
-        autoBackfillDeltaInit();
+    const bool restored = loadSnapshot();
+    // 先に直近7日(または前回停止点→今)の差分を回す → 右画面がすぐ埋まる
+    ui->plainTextEdit->appendPlainText("[情報] 直近差分の取り込みを開始します（初回は過去7日）。");
+    autoBackfillDeltaInit();
 
-        // その裏でフルバックフィルも走らせて、徐々に深掘り
-        fullBackfillLiveExpiriesInit();
+    // その裏でフルバックフィルも走らせて、徐々に深掘り
+    fullBackfillLiveExpiriesInit();
 
 
-        updateExpiryActivityTable();
-        requestOIAll();                           // OI は従来通り
-        // ★ 初回のOI取得
-    }
+    updateExpiryActivityTable();
+    requestMarketSnapshot();                  // IV/NBBO/OI を一括で埋める
+    // ★ 初回のOI取得
+    subscribeWhenReady();
+}
 
+void MainWindow::subscribeWhenReady() {
     if (m_underlyingPx > 0.0 && !m_instruments.isEmpty() && !m_subscribedOnce) {
         chooseAndSubscribe(); // 期近を購読
         m_subscribedOnce = true;
@@ -771,6 +1010,36 @@ void MainWindow::onRpc(int id, const QJsonObject& reply) {
 
 /* ================= 受信（購読） ================= */
 
+// trade_id（"12345" / "ETH-12345" など）の数値部分
+static quint64 tradeIdNum(const QJsonValue& v) {
+    const QString id = v.toVariant().toString();
+    qsizetype b = id.size();
+    while (b > 0 && id.at(b - 1).isDigit()) --b;
+    return id.mid(b).toULongLong();
+}
+
+// JSON 経路で trades.* が来た場合（高速パーサが解釈できなかったフレーム）の変換
+static RawTrade rawTradeFromJson(const QJsonObject& t) {
+    RawTrade r;
+    const QByteArray inst = t.value("instrument_name").toString().toLatin1();
+    if (inst.isEmpty() || inst.size() >= int(sizeof(r.inst))) return r;
+    std::memcpy(r.inst, inst.constData(), size_t(inst.size()));
+    r.instLen = quint8(inst.size());
+    r.tradeId = tradeIdNum(t.value("trade_id"));
+    const QByteArray tid = t.value("trade_id").toVariant().toString().toLatin1().left(int(sizeof(r.tradeIdText)) - 1);
+    std::memcpy(r.tradeIdText, tid.constData(), size_t(tid.size()));
+    r.tradeIdLen = quint8(tid.size());
+    r.tradeSeq = qint64(t.value("trade_seq").toDouble());
+    r.ts = (qint64)t.value("timestamp").toDouble();
+    r.amount = t.value("amount").toDouble();
+    r.price = t.value("price").toDouble();
+    r.iv = t.value("iv").toDouble();
+    r.indexPrice = t.value("index_price").toDouble();
+    r.markPrice = t.value("mark_price").toDouble();
+    r.sign = (t.value("direction").toString().compare("buy", Qt::CaseInsensitive) == 0) ? +1 : -1;
+    return r;
+}
+
 void MainWindow::handleDeribitMsg(const QJsonObject& obj) {
     const QString method = obj.value("method").toString();
     if (method != QStringLiteral("subscription")) return;
@@ -779,169 +1048,253 @@ void MainWindow::handleDeribitMsg(const QJsonObject& obj) {
     const QString channel = params.value("channel").toString();
     const QJsonValue dataVal = params.value("data");
 
-    // ---- trades.* ----
+    // ---- trades.*（通常は WebSocketClient::tradesReceived 側で処理される）----
     if (channel.startsWith(QStringLiteral("trades."))) {
-        const bool isGlobal = channel.startsWith(QStringLiteral("trades.option."));
         QJsonArray tradesArr;
         if (dataVal.isArray())       tradesArr = dataVal.toArray();
         else if (dataVal.isObject()) tradesArr = dataVal.toObject().value("trades").toArray();
-        if (tradesArr.isEmpty()) return;
 
+        std::vector<RawTrade> trades;
+        trades.reserve(size_t(tradesArr.size()));
         for (const auto& v : tradesArr) {
             if (!v.isObject()) continue;
-            const QJsonObject t = v.toObject();
+            const RawTrade r = rawTradeFromJson(v.toObject());
+            if (r.instLen > 0) trades.push_back(r);
+        }
+        if (!trades.empty()) handleTrades(trades, channel.startsWith(QStringLiteral("trades.option.")));
+        return;
+    }
+
+    // ---- ticker.* ----
+    if (channel.startsWith(QStringLiteral("ticker."))) {
+        if (!dataVal.isObject()) return;
+        const QJsonObject d = dataVal.toObject();
+        const InstId id = m_reg.find(d.value("instrument_name").toString());
+        if (id != INVALID_INST) {
+            const QJsonObject greeks = d.value("greeks").toObject();
+            if (!greeks.isEmpty()) m_lastDelta[int(id)] = greeks.value("delta").toDouble();
+            if (d.contains("mark_iv")) m_lastIV[int(id)] = d.value("mark_iv").toDouble();
+
+            // ★ NBBO配線（best bid/ask が来る）
+            const double bid = d.value("best_bid_price").toDouble();
+            const double ask = d.value("best_ask_price").toDouble();
+            if (bid > 0.0 && ask > 0.0 && ask >= bid) {
+                qint64 ts = qint64(d.value("timestamp").toDouble());
+                if (ts <= 0) ts = QDateTime::currentMSecsSinceEpoch();
+                m_nbbo.update(id, ts, bid, ask);
+            }
+        }
 
-            const QString tradeId = t.value("trade_id").toVariant().toString();
-            const QString inst = t.value("instrument_name").toString();
-            const double  amount = t.value("amount").toDouble();
-            const double  price = t.value("price").toDouble();
-            const qint64  ts = (qint64)t.value("timestamp").toDouble();
-            const QString dir = t.value("direction").toString();
-            const int     sign = (dir.compare("buy", Qt::CaseInsensitive) == 0) ? +1 : -1;
+        return;
+    }
 
-            if (!tradeId.isEmpty() && alreadySeenTrade(tradeId, ts)) continue;
+    // ---- deribit_price_index.*（参照価格）----
+    if (channel.startsWith(QStringLiteral("deribit_price_index."))) {
+        const QJsonObject d = dataVal.toObject();
+        qint64 ts = qint64(d.value("timestamp").toDouble());
+        if (ts <= 0) ts = QDateTime::currentMSecsSinceEpoch();
+        onSpot(d.value("price").toDouble(), ts);
+        return;
+    }
 
-            const double delta = m_lastDelta.value(inst, 0.0);
+    // ---- book.*（L2 板の snapshot / change）----
+    if (channel.startsWith(QStringLiteral("book."))) {
+        if (dataVal.isObject()) handleBookMsg(channel, dataVal.toObject());
+        return;
+    }
+}
 
-            // ★ Auto用サンプルは必ず記録（小口でも）
-            pushAmtSample(ts, std::fabs(amount));
+void MainWindow::handleBookMsg(const QString& channel, const QJsonObject& d) {
+    const InstId id = m_reg.find(d.value("instrument_name").toString());
+    if (id == INVALID_INST) return;
+    OrderBook& book = m_books[id];
 
-            // 全約定ログ（表示は出すが小口は以降スキップ）
-            {
-                const auto dtStr = QDateTime::fromMSecsSinceEpoch(ts).toLocalTime().toString("yyyy-MM-dd HH:mm:ss");
-                ui->plainTextEdit->appendPlainText(
-                    QString("[約定] %1  %2  %3  amt=%4  @%5")
-                    .arg(dtStr).arg(inst).arg(dir)
-                    .arg(QString::number(amount, 'f', 3))
-                    .arg(QString::number(price, 'f', 3)));
-                if (!isBigTrade(amount)) continue;  // ★小口はここで切る
-            }
+    const qint64 changeId = qint64(d.value("change_id").toDouble());
+    qint64 ts = qint64(d.value("timestamp").toDouble());
+    if (ts <= 0) ts = QDateTime::currentMSecsSinceEpoch();
 
-            // 満期アクティビティ
-            recordExpiryEvent(inst, ts, amount, sign, delta);
+    if (d.value("type").toString() == QLatin1String("snapshot")) {
+        book.beginSnapshot(changeId, ts);
+        m_bookResync.remove(id);
+    }
+    else {
+        if (m_bookResync.contains(id)) return;          // 取り直し中（次の snapshot まで捨てる）
+        if (!book.beginChange(qint64(d.value("prev_change_id").toDouble()), changeId, ts)) {
+            // 欠番 → 購読し直すと snapshot から送られてくる
+            m_bookResync.insert(id);
+            ++m_bookResyncs;
+            m_ws->unsubscribe(QStringList() << channel);
+            m_ws->subscribe(QStringList() << channel);
+            return;
+        }
+    }
 
-            // 残存へ反映（tradePx=price を渡す）
-            applyTradeToResidual(inst, ts, amount, sign, delta, price);
+    // 各段は [op, price, amount]。op は new / change / delete
+    auto apply = [&book](const QJsonArray& levels, bool bidSide) {
+        for (const auto& v : levels) {
+            const QJsonArray e = v.toArray();
+            if (e.size() < 3) continue;
+            const QString op = e.at(0).toString();
+            const OrderBook::Op o = (op == QLatin1String("delete")) ? OrderBook::Op::Delete
+                : (op == QLatin1String("new")) ? OrderBook::Op::New : OrderBook::Op::Change;
+            book.set(bidSide, o, e.at(1).toDouble(), e.at(2).toDouble());
+        }
+        };
+    apply(d.value("bids").toArray(), true);
+    apply(d.value("asks").toArray(), false);
+}
 
-            // ★ 逆算IV（価格・残存分から求める）→ tradeIV と m_lastIV 埋め
-            {
-                const qint64 expMs = expiryFromInst(inst);
-                const qint64 minLeft = std::max<qint64>(expMs - ts, 0) / 60000ll;
-                if (price > 0.0 && minLeft > 0 && m_underlyingPx > 0.0) {
-                    const double K = strikeFromInst(inst);
-                    const bool   isCall = isCallFromInst(inst);
-                    const auto   gk = IVGreeks::solveAndGreeks(
-                        isCall ? OptionCP::Call : OptionCP::Put,
-                        price, m_underlyingPx, K, double(minLeft), 0.0, 0.0);
-                    if (gk.iv > 0.0) {
-                        // 代表IVが未設定なら埋める
-                        if (m_lastIV.value(inst, 0.0) <= 0.0) m_lastIV[inst] = gk.iv;
-                    }
-                }
-                // 代表IVが未だ無ければ、オンデマンドで取りに行く
-                if (m_lastIV.value(inst, 0.0) <= 0.0) queueIV(inst);
-            }
+void MainWindow::drainIngest() {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    m_liveLastMs = now;
+    m_engine->drain([this, now](const IngestBatch& b) {
+        if (b.isGlobal && m_liveSinceMs == 0) m_liveSinceMs = now;
+        handleTrades(b.trades, b.isGlobal);
+        });
+}
 
+void MainWindow::handleTrades(const std::vector<RawTrade>& trades, bool isGlobal) {
+    for (const RawTrade& t : trades) {
+        // 受信スレッドで解決済み。銘柄表の更新直後だけここで引き直す
+        InstId id = t.instId;
+        if (id == INVALID_INST) id = m_reg.find(t.inst, t.instLen);
+
+        const double  amount = t.amount;
+        const double  price = t.price;
+        const qint64  ts = t.ts;
+        const int     sign = t.sign;
+        const char*   dir = (sign > 0 ? "buy" : "sell");
+
+        if (m_dedup.seen(id, t.tradeSeq, t.tradeId, ts)) continue;   // 個別購読と全体購読の重なり・バックフィルとの競合
+
+        // ローカルストアへ（全体購読分だけ。個別購読は同じ約定の重複）
+        if (isGlobal) {
+            TradeRecord rec;
+            rec.ts = ts;
+            rec.tradeSeq = t.tradeSeq;
+            rec.tradeId = t.tradeId;
+            rec.price = price;
+            rec.amount = std::fabs(amount);
+            rec.iv = t.iv;
+            rec.indexPrice = t.indexPrice;
+            rec.nameId = storeNameIdOf(id, t.inst, t.instLen);
+            rec.side = qint8(sign);
+            m_store.append(rec);
+        }
 
-            // ★ レッグ明細の保存（NBBO/Aggressor 付き、大口のみ）
-            if (isBigTrade(amount)) {
-                const bool   isCall = isCallFromInst(inst);
-                const double k = strikeFromInst(inst);
-                const qint64 expMs = expiryFromInst(inst);
-                const QString key = makeClusterKey(expMs, isCall, k);
+        const double delta = lastDeltaOf(id);
 
-                double bpDiff = 0.0;
-                Aggressor ag = m_nbbo.inferAggressor(inst, price, &bpDiff);
-                const auto nb = m_nbbo.get(inst);
-                const double mid = nb.mid();
+        // ★ Auto用サンプルは必ず記録（小口でも）
+        pushAmtSample(ts, std::fabs(amount));
 
-                // 推定Δ：無い/0なら距離から補完
-                double dAbs = std::abs(delta);
-                if (dAbs <= 1e-9) dAbs = absDeltaGuess(k, m_underlyingPx);
+        // 全約定ログ（表示は出すが小口は以降スキップ）
+        {
+            const auto dtStr = QDateTime::fromMSecsSinceEpoch(ts).toLocalTime().toString("yyyy-MM-dd HH:mm:ss");
+            m_dirty.tapeLines << (
+                QString("[約定] %1  %2  %3  amt=%4  @%5")
+                .arg(dtStr).arg(QLatin1String(t.inst, t.instLen)).arg(QLatin1String(dir))
+                .arg(QString::number(amount, 'f', 3))
+                .arg(QString::number(price, 'f', 3)));
+            if (!isBigTrade(amount)) continue;  // ★小口はここで切る
+        }
+        if (id == INVALID_INST) continue;       // 銘柄表に無い（満期・行使が引けない）
 
-                LegDetail lg;
-                lg.ts = ts;
-                lg.linkKey = key;
-                lg.inst = inst;
-                lg.sign = sign;
-                lg.amount = std::abs(amount);
-                lg.estDelta = dAbs;
-                lg.price = price;
+        // 満期アクティビティ
+        recordExpiryEvent(id, ts, amount, sign, delta);
 
-                lg.aggressor = ag;
-                lg.venue = "Deribit";
-                lg.expiryMs = expMs;
-                lg.strike = k;
-                lg.isCall = isCall;
+        // 残存へ反映（tradePx=price を渡す）
+        applyTradeToResidual(id, ts, amount, sign, delta, price, t.tradeSeq);
 
-                lg.nbboBid = nb.bid;
-                lg.nbboAsk = nb.ask;
-                lg.mid = mid;
-                lg.bpDiffBp = bpDiff;
+        const bool   isCall = m_reg.isCall(id);
+        const double k = m_reg.strike(id);
+        const qint64 expMs = expiryFromInst(id);
 
-                // Trade IV 優先順位: 逆算IV > payload(iv) > 代表IV
-                {
-                    double ivSolve = 0.0;
-                    const qint64 expMs2 = lg.expiryMs;
-                    const qint64 minLeft = std::max<qint64>(expMs2 - lg.ts, 0) / 60000ll;
-                    if (lg.price > 0.0 && minLeft > 0 && m_underlyingPx > 0.0 && lg.strike > 0.0) {
-                        const auto gk = IVGreeks::solveAndGreeks(
-                            lg.isCall ? OptionCP::Call : OptionCP::Put,
-                            lg.price, m_underlyingPx, lg.strike, double(minLeft), 0.0, 0.0);
-                        ivSolve = gk.iv;
-                    }
-                    double ivPayload = t.value("iv").toDouble();
-                    double ivRep = m_lastIV.value(inst, 0.0);
-                    if (ivSolve > 0.0)       lg.tradeIV = ivSolve;
-                    else if (ivPayload > 0.) lg.tradeIV = ivPayload;
-                    else                     lg.tradeIV = ivRep;
-                }
-
-
-                lg.orderId = tradeId;
+        // 約定時点の原資産（payload の index_price。無い時だけ参照価格）
+        const double spot = (t.indexPrice > 0.0) ? t.indexPrice : m_underlyingPx;
 
-                auto& vec = m_legsByKey[key];
-                vec.push_back(lg);
-                // メモリ上限（直近200件だけ保持）
-                if (vec.size() > 200) vec.remove(0, vec.size() - 200);
-            }
+        // ★ Trade IV：取引所の iv があればそのまま、無い時だけ約定時点の原資産で逆算 → m_lastIV 埋め
+        double ivTrade = t.iv;
+        {
+            const qint64 minLeft = std::max<qint64>(expMs - ts, 0) / 60000ll;
+            if (ivTrade <= 0.0 && price > 0.0 && minLeft > 0 && spot > 0.0 && k > 0.0)
+                ivTrade = IvBatch::solveOne(isCall, price, spot, k, double(minLeft)).iv;
+            // 代表IVが未設定なら埋める
+            if (ivTrade > 0.0 && lastIVOf(id) <= 0.0) m_lastIV[int(id)] = ivTrade;
+            // 代表IVが未だ無ければ、オンデマンドで取りに行く
+            if (lastIVOf(id) <= 0.0) queueIV(id);
+        }
 
 
-            // 個別購読のみ短期Δ集計とバースト
-            if (!isGlobal) {
-                if (!ui->chkPauseTape->isChecked()) {
-                    ui->plainTextEdit->appendPlainText(
-                        QString("[TAPE] %1  %2  amt=%3  @%4  d~%5")
-                        .arg(inst, 12).arg(dir, 4)
-                        .arg(QString::number(amount, 'f', 3))
-                        .arg(QString::number(price, 'f', 3))
-                        .arg(QString::number(delta, 'f', 3)));
-                }
-                addEvent(TradeEvent{ ts, amount, delta, sign, inst });
+        // ★ レッグ明細の保存（NBBO/Aggressor 付き、大口のみ）
+        if (isBigTrade(amount)) {
+            const ClusterBook::Key key = makeClusterKey(expMs, isCall, k);
+
+            // 約定時刻の直前の気配で判定（明細の NBBO も同じ時点）
+            double bpDiff = 0.0;
+            Aggressor ag = m_nbbo.inferAggressor(id, ts, price, &bpDiff);
+            const auto nb = m_nbbo.at(id, ts - 1);
+            const double mid = nb.mid();
+
+            // 推定Δ：無い/0なら距離から補完
+            double dAbs = std::abs(delta);
+            if (dAbs <= 1e-9) dAbs = absDeltaGuess(k, spot);
+
+            LegDetail lg;
+            lg.ts = ts;
+            lg.linkKey = key;
+            lg.inst = m_reg.name(id);
+            lg.sign = sign;
+            lg.amount = std::abs(amount);
+            lg.estDelta = dAbs;
+            lg.price = price;
+
+            lg.aggressor = ag;
+            lg.venue = "Deribit";
+            lg.expiryMs = expMs;
+            lg.strike = k;
+            lg.isCall = isCall;
+
+            lg.nbboBid = nb.bid;
+            lg.nbboAsk = nb.ask;
+            lg.mid = mid;
+            lg.bpDiffBp = bpDiff;
+            lg.markPrice = t.markPrice;
+            lg.indexPrice = spot;
+
+            // L2 板：約定前の板（この約定を既に反映した後の板は使わない）に枚数を当てる
+            const auto bk = m_books.constFind(id);
+            if (bk != m_books.cend() && bk->valid() && bk->ts() < ts) {
+                const OrderBook::Fill f = bk->fill(sign < 0, lg.amount);
+                lg.depthMid = bk->depthMid(lg.amount);
+                lg.slipBp = bk->slippageBp(sign, lg.amount);
+                lg.levelsHit = f.exhausted;
             }
+
+            // Trade IV 優先順位: payload(iv) > 逆算IV > 代表IV
+            lg.tradeIV = (ivTrade > 0.0) ? ivTrade : lastIVOf(id);
+
+
+            lg.orderId = QString::fromLatin1(t.tradeIdText, t.tradeIdLen);
+
+            auto& vec = m_legsByKey[key];
+            vec.push_back(lg);
+            // メモリ上限（直近200件だけ保持）
+            if (vec.size() > 200) vec.remove(0, vec.size() - 200);
         }
-        return;
-    }
 
-    // ---- ticker.* ----
-    if (channel.startsWith(QStringLiteral("ticker."))) {
-        if (!dataVal.isObject()) return;
-        const QJsonObject d = dataVal.toObject();
-        const QString inst = d.value("instrument_name").toString();
-        if (!inst.isEmpty()) {
-            const QJsonObject greeks = d.value("greeks").toObject();
-            if (!greeks.isEmpty()) m_lastDelta[inst] = greeks.value("delta").toDouble();
-            if (d.contains("mark_iv")) m_lastIV[inst] = d.value("mark_iv").toDouble();
 
-            // ★ NBBO配線（best bid/ask が来る）
-            const double bid = d.value("best_bid_price").toDouble();
-            const double ask = d.value("best_ask_price").toDouble();
-            if (bid > 0.0 && ask > 0.0 && ask >= bid) {
-                m_nbbo.update(inst, bid, ask);
+        // 個別購読のみ短期Δ集計とバースト
+        if (!isGlobal) {
+            if (!ui->chkPauseTape->isChecked()) {
+                m_dirty.tapeLines << (
+                    QString("[TAPE] %1  %2  amt=%3  @%4  d~%5")
+                    .arg(m_reg.name(id), 12).arg(QLatin1String(dir), 4)
+                    .arg(QString::number(amount, 'f', 3))
+                    .arg(QString::number(price, 'f', 3))
+                    .arg(QString::number(delta, 'f', 3)));
             }
+            addEvent(TradeEvent{ ts, amount, delta, sign, id });
         }
-
-        return;
     }
 }
 
@@ -1029,11 +1382,23 @@ void MainWindow::chooseAndSubscribe() {
         return;
     }
 
-    m_channels.clear();
+    QStringList channels;
     for (const auto& inst : m_targetInstruments) {
-        m_channels << QString("ticker.%1.raw").arg(inst);
-        m_channels << QString("trades.%1.raw").arg(inst);
-    }
+        channels << QString("ticker.%1.raw").arg(inst);
+        channels << QString("trades.%1.raw").arg(inst);
+        if (m_bookDepth) channels << QString("book.%1.100ms").arg(inst);
+    }
+    // 外れた銘柄は購読をやめ（再接続時にも復元しない）、板も捨てる
+    QStringList dropped;
+    for (const QString& c : m_channels)
+        if (!channels.contains(c)) dropped << c;
+    if (!dropped.isEmpty()) m_ws->unsubscribe(dropped);
+    for (auto it = m_books.begin(); it != m_books.end();) {
+        if (m_targetInstruments.contains(m_reg.name(it.key()))) { ++it; continue; }
+        m_bookResync.remove(it.key());
+        it = m_books.erase(it);
+    }
+    m_channels = channels;
     m_ws->subscribe(m_channels);
     refreshWatchList();
 
@@ -1049,32 +1414,8 @@ void MainWindow::refreshWatchList() {
     ui->listInstruments->addItems(m_targetInstruments);
 }
 
-void MainWindow::autoBackfillPump() {
-    while (m_autoInflight < AUTO_MAX_INFLIGHT && !m_autoBackfillQueue.isEmpty()) {
-        const QString inst = m_autoBackfillQueue.front();
-        m_autoBackfillQueue.pop_front();
-        ++m_autoInflight;
-        requestBackfillAuto(inst, m_autoBackFromMs, m_autoBackToMs);
-    }
-
-    if (m_autoInflight == 0 && m_autoBackfillQueue.isEmpty() && !m_autoBackfillDone) {
-        m_autoBackfillDone = true;
-        ui->plainTextEdit->appendPlainText("[情報] 差分取り込みが完了しました。");
-        storeBackfillWatermarkMs(m_autoBackToMs);      // ★ 追加：完了時点を保存
-        rebuildSignalTableFromResidual();
-        updateExpiryActivityTable();
-    }
-
-}
-void MainWindow::requestBackfillAuto(const QString& inst, qint64 fromMs, qint64 toMs) {
-    if (fromMs >= toMs) {
-        ui->plainTextEdit->appendPlainText(
-            QString("[DIFF][WARN] %1 範囲が不正: from=%2 to=%3").arg(inst).arg(fromMs).arg(toMs));
-        m_autoInflight = std::max(0, m_autoInflight - 1);
-        autoBackfillPump();
-        return;
-    }
-
+// get_last_trades_by_instrument_and_time（差分・フル・手動で共通）
+static QUrl lastTradesUrl(const QString& inst, qint64 fromMs, qint64 toMs) {
     QUrl url("https://www.deribit.com/api/v2/public/get_last_trades_by_instrument_and_time");
     QUrlQuery q;
     q.addQueryItem("instrument_name", inst);
@@ -1083,76 +1424,83 @@ void MainWindow::requestBackfillAuto(const QString& inst, qint64 fromMs, qint64
     q.addQueryItem("include_old", "true");
     q.addQueryItem("count", "1000");
     url.setQuery(q);
+    return url;
+}
+
+// 通貨まとめ取り（get_last_trades_by_currency_and_time、時刻昇順）
+static QUrl currencyTradesUrl(qint64 fromMs, qint64 toMs) {
+    QUrl url("https://www.deribit.com/api/v2/public/get_last_trades_by_currency_and_time");
+    QUrlQuery q;
+    q.addQueryItem("currency", "BTC");
+    q.addQueryItem("kind", "option");
+    q.addQueryItem("start_timestamp", QString::number(fromMs));
+    q.addQueryItem("end_timestamp", QString::number(toMs));
+    q.addQueryItem("include_old", "true");
+    q.addQueryItem("sorting", "asc");
+    q.addQueryItem("count", "1000");
+    url.setQuery(q);
+    return url;
+}
 
-    QNetworkRequest req(url);
-    req.setRawHeader("User-Agent", "BTC-Option-Viewer/1.0 (+Qt)");
-    QNetworkReply* rep = m_net.get(req);
-    rep->setProperty("inst", inst);
-    rep->setProperty("fromMs", QVariant::fromValue(fromMs));
-    rep->setProperty("toMs", QVariant::fromValue(toMs));
+// 通貨まとめ取りの trade_id 順（get_last_trades_by_currency、startId を含む昇順）
+static QUrl currencyTradesByIdUrl(const QString& startId) {
+    QUrl url("https://www.deribit.com/api/v2/public/get_last_trades_by_currency");
+    QUrlQuery q;
+    q.addQueryItem("currency", "BTC");
+    q.addQueryItem("kind", "option");
+    q.addQueryItem("start_id", startId);
+    q.addQueryItem("include_old", "true");
+    q.addQueryItem("sorting", "asc");
+    q.addQueryItem("count", "1000");
+    url.setQuery(q);
+    return url;
+}
 
-    connect(rep, &QNetworkReply::finished, this, [this, rep] {
-        const QString inst = rep->property("inst").toString();
-        const qint64 fromMs = rep->property("fromMs").toLongLong();
-        const qint64 toMs = rep->property("toMs").toLongLong();
+// 履歴1件を取り込む（差分・フル共通）。取得分はローカルストアにも残す
+void MainWindow::ingestHistoryTrade(const RawTrade& t) {
+    InstId id = t.instId;
+    if (id == INVALID_INST) id = m_reg.find(t.inst, t.instLen);   // 解析後に銘柄表が伸びた分
+    if (m_dedup.seen(id, t.tradeSeq, t.tradeId, t.ts)) return;   // 差分とフル・ライブの重なり
 
-        if (rep->error() != QNetworkReply::NoError) {
-            const auto fstr = QDateTime::fromMSecsSinceEpoch(fromMs).toLocalTime().toString("yyyy-MM-dd HH:mm");
-            const auto tstr = QDateTime::fromMSecsSinceEpoch(toMs).toLocalTime().toString("yyyy-MM-dd HH:mm");
-            ui->plainTextEdit->appendPlainText(
-                QString("[DIFF][ERR] %1  %2 ～ %3 : %4")
-                .arg(inst, fstr, tstr, rep->errorString()));
-            rep->deleteLater();
-            m_autoInflight = std::max(0, m_autoInflight - 1);
-            autoBackfillPump();
-            return;
-        }
+    TradeRecord rec;
+    rec.ts = t.ts;
+    rec.tradeSeq = t.tradeSeq;
+    rec.tradeId = t.tradeId;
+    rec.price = t.price;
+    rec.amount = std::fabs(t.amount);
+    rec.iv = t.iv;
+    rec.indexPrice = t.indexPrice;
+    rec.nameId = storeNameIdOf(id, t.inst, t.instLen);
+    rec.side = t.sign;
+    m_store.append(rec);
 
-        QByteArray bytes = rep->readAll();
-        rep->deleteLater();
+    ingestHistory(id, t.ts, t.amount, t.sign, t.price, t.tradeSeq, t.iv);
+}
 
-        int n = 0;
+// 解析済みの履歴1バッチを反映（時刻順）。画面は次フレームでまとめて1回更新
+void MainWindow::applyHistoryBatch(const std::vector<RawTrade>& trades) {
+    for (const RawTrade& t : trades) ingestHistoryTrade(t);
+    if (!trades.empty()) m_dirty.expiryAll = true;
+}
 
-        QJsonDocument doc = QJsonDocument::fromJson(bytes);
-        if (doc.isObject()) {
-            const QJsonObject res = doc.object().value("result").toObject();
-            const QJsonArray  trades = res.value("trades").toArray();
-            n = trades.size();
-
-            for (const auto& v : trades) {
-                if (!v.isObject()) continue;
-                const QJsonObject t = v.toObject();
-                const qint64 ts = qint64(t.value("timestamp").toDouble());
-                const double amt = t.value("amount").toDouble();
-                const QString dir = t.value("direction").toString();
-                const int sign = (dir.compare("buy", Qt::CaseInsensitive) == 0) ? +1 : -1;
-                const double px = t.value("price").toDouble();
-                const double delta = m_lastDelta.value(inst, 0.0);
-
-                pushAmtSample(ts, std::fabs(amt)); // Auto閾値サンプルは常に保持
-
-                if (std::fabs(amt) >= backfillMinUnit(ui)) {
-                    if (m_lastIV.value(inst, 0.0) <= 0.0) queueIV(inst);
-                    recordExpiryEvent(inst, ts, amt, sign, delta);
-                    applyTradeToResidual(inst, ts, amt, sign, delta, px);
-                }
-            }
-        }
-        else {
-            const auto head = QString::fromUtf8(bytes.left(200)).replace('\n', ' ');
-            ui->plainTextEdit->appendPlainText(
-                QString("[DIFF][WARN] %1 JSON解釈失敗。head=%2").arg(inst, head));
-        }
+// 取り込み本体（ストア再生もここへ）。Auto 閾値サンプルは銘柄不明でも記録する
+void MainWindow::ingestHistory(InstId id, qint64 ts, double amt, int sign, double px, qint64 seq, double iv) {
+    pushAmtSample(ts, std::fabs(amt));
+    if (id == INVALID_INST) return;
+    if (std::fabs(amt) < backfillMinUnit(ui)) return;      // 残存へは手動>0なら手動、Auto=0なら全件
+    const double delta = lastDeltaOf(id);
 
-        ui->plainTextEdit->appendPlainText(QString("[DIFF] %1 : %2件").arg(inst).arg(n));
-        m_autoInflight = std::max(0, m_autoInflight - 1);
-        autoBackfillPump();
-        });
+    if (iv > 0.0 && lastIVOf(id) <= 0.0) m_lastIV[int(id)] = iv;   // 取引所の iv で温める（取りに行かない）
+    if (lastIVOf(id) <= 0.0) queueIV(id);
+    recordExpiryEvent(id, ts, amt, sign, delta);
+    applyTradeToResidual(id, ts, amt, sign, delta, px, seq);
 }
 
 void MainWindow::autoBackfillDeltaInit() {
-    m_deltaQueue.clear();
-    m_deltaInflight = 0;
+    m_deltaPending = 0;
+    m_deltaDone = false;
+    m_deltaGaps.clear();
+    m_deltaGapIdx = 0;
     const qint64 now = QDateTime::currentMSecsSinceEpoch();
     // 初回(=スナップショット無し) は直近7日分だけ先に埋める
     m_deltaFromMs = (m_lastSnapshotTs > 0 ? m_lastSnapshotTs : now - 7ll * DAY_MS);
@@ -1162,123 +1510,278 @@ void MainWindow::autoBackfillDeltaInit() {
         ui->plainTextEdit->appendPlainText("[情報] 差分取り込み: 取り込み対象なし。");
         return;
     }
-    for (const auto& v : m_instruments) {
-        if (!v.isObject()) continue;
+
+    // 既定は通貨まとめ取り（数十ページ）。backfill/deltaMode=instrument で従来の銘柄別
+    QSettings st("BTC_OP_V2", "BTC_OP_V2");
+    if (st.value("backfill/deltaMode", "currency").toString() != QLatin1String("instrument")) {
+        // 取得済みの区間はディスクから再生し、穴だけを取りに行く
+        const qint64 replayed = replayStoredTrades(m_deltaFromMs, m_deltaToMs);
+        m_deltaGaps = m_store.gaps(TradeStore::ALL, m_deltaFromMs, m_deltaToMs);
+        ui->plainTextEdit->appendPlainText(
+            QString("[情報] 差分取り込み: ストアから %1件を再生。残り %2区間を BTC オプション全体でページ取得します。")
+            .arg(replayed).arg(m_deltaGaps.size()));
+        m_deltaPages = 0;
+        startDeltaGaps();
+        return;
+    }
+
+    QStringList names;
+    for (const auto& v : m_instruments) {
+        if (!v.isObject()) continue;
         const auto o = v.toObject();
         if (!o.value("is_active").toBool(true)) continue;
         const QString name = o.value("instrument_name").toString();
-        if (!name.isEmpty()) m_deltaQueue.push_back(name);
+        if (!name.isEmpty()) names << name;
     }
-    ui->plainTextEdit->appendPlainText(QString("[情報] 差分取り込み: 銘柄=%1").arg(m_deltaQueue.size()));
-    autoBackfillDeltaPump();
+    ui->plainTextEdit->appendPlainText(QString("[情報] 差分取り込み: 銘柄=%1").arg(names.size()));
+
+    m_deltaPending = names.size();
+    for (const QString& name : names) requestBackfillDelta(name, m_deltaFromMs, m_deltaToMs);
+    if (m_deltaPending == 0) { ++m_deltaPending; autoBackfillDeltaTaskDone(); }
 }
 
-void MainWindow::autoBackfillDeltaPump() {
-    while (m_deltaInflight < AUTO_MAX_INFLIGHT && !m_deltaQueue.isEmpty()) {
-        const QString inst = m_deltaQueue.front(); m_deltaQueue.pop_front();
-        ++m_deltaInflight;
-        requestBackfillDelta(inst, m_deltaFromMs, m_deltaToMs);
-    }
-    if (m_deltaInflight == 0 && m_deltaQueue.isEmpty() && !m_deltaDone) {
+// m_deltaGaps[m_deltaGapIdx..] を通貨まとめ取りで順に埋める（差分の1本として数える）
+void MainWindow::startDeltaGaps() {
+    m_deltaPending = 1;
+    m_deltaRetries = 0;
+    m_deltaEdgeTs = -1;
+    m_deltaEdgeIds.clear();
+    m_deltaEdgeMaxId = 0;
+    if (m_deltaGapIdx >= m_deltaGaps.size()) { m_dirty.markAllViews(); autoBackfillDeltaTaskDone(); }
+    else requestDeltaCurrencyPage(m_deltaGaps[m_deltaGapIdx].first);
+}
+
+void MainWindow::autoBackfillDeltaTaskDone() {
+    m_deltaPending = std::max(0, m_deltaPending - 1);
+    if (m_deltaPending == 0 && !m_deltaDone) {
+        // 取り込み中に足された穴（再接続で欠けた区間）があれば続けて埋める
+        if (m_deltaGapIdx < m_deltaGaps.size()) { startDeltaGaps(); return; }
         m_deltaDone = true;
         ui->plainTextEdit->appendPlainText("[情報] 差分取り込みが完了しました。");
         // 差分バックフィルの完了ウォーターマークを保存（次回の起動で“前回停止時＋今回分”を連結）
         storeBackfillWatermarkMs(m_deltaToMs);
 
-        rebuildSignalTableFromResidual();
-        updateExpiryActivityTable();
-        updatePinMapTable();
-        updateCurvesTables();
-        updateCurvesCharts();
+        m_dirty.markAllViews();
     }
-
 }
 
 void MainWindow::requestBackfillDelta(const QString& inst, qint64 fromMs, qint64 toMs) {
     if (fromMs >= toMs) {
         ui->plainTextEdit->appendPlainText(
             QString("[DIFF][WARN] %1 範囲が不正: from=%2 to=%3").arg(inst).arg(fromMs).arg(toMs));
-        m_deltaInflight = std::max(0, m_deltaInflight - 1);
-        autoBackfillDeltaPump();
+        autoBackfillDeltaTaskDone();
         return;
     }
 
-    QUrl url("https://www.deribit.com/api/v2/public/get_last_trades_by_instrument_and_time");
-    QUrlQuery q;
-    q.addQueryItem("instrument_name", inst);
-    q.addQueryItem("start_timestamp", QString::number(fromMs));
-    q.addQueryItem("end_timestamp", QString::number(toMs));
-    q.addQueryItem("include_old", "true");
-    q.addQueryItem("count", "1000");
-    url.setQuery(q);
-
-    QNetworkRequest req(url);
-    req.setRawHeader("User-Agent", "BTC-Option-Viewer/1.0 (+Qt)");
-    QNetworkReply* rep = m_net.get(req);
-    rep->setProperty("inst", inst);
-    rep->setProperty("fromMs", QVariant::fromValue(fromMs));
-    rep->setProperty("toMs", QVariant::fromValue(toMs));
-
-    connect(rep, &QNetworkReply::finished, this, [this, rep] {
-        const QString inst = rep->property("inst").toString();
-        const qint64 fromMs = rep->property("fromMs").toLongLong();
-        const qint64 toMs = rep->property("toMs").toLongLong();
-
-        if (rep->error() != QNetworkReply::NoError) {
+    m_sched->submit(RequestScheduler::Priority::DeltaGap, lastTradesUrl(inst, fromMs, toMs),
+        [this, inst, fromMs, toMs](const RequestScheduler::Reply& r) {
+        if (!r.ok()) {
             const auto fstr = QDateTime::fromMSecsSinceEpoch(fromMs).toLocalTime().toString("yyyy-MM-dd HH:mm");
             const auto tstr = QDateTime::fromMSecsSinceEpoch(toMs).toLocalTime().toString("yyyy-MM-dd HH:mm");
             ui->plainTextEdit->appendPlainText(
                 QString("[DIFF][ERR] %1  %2 ～ %3 : %4")
-                .arg(inst, fstr, tstr, rep->errorString()));
-            rep->deleteLater();
-            m_deltaInflight = std::max(0, m_deltaInflight - 1);
-            autoBackfillDeltaPump();
+                .arg(inst, fstr, tstr, r.error));
+            autoBackfillDeltaTaskDone();
             return;
         }
 
-        QByteArray bytes = rep->readAll();
-        rep->deleteLater();
-
-        int n = 0;
-        const QJsonDocument doc = QJsonDocument::fromJson(bytes);
-        if (doc.isObject()) {
-            const QJsonArray trades = doc.object().value("result").toObject().value("trades").toArray();
-            n = trades.size();
-            for (const auto& v : trades) {
-                if (!v.isObject()) continue;
-                const QJsonObject t = v.toObject();
-                const qint64 ts = qint64(t.value("timestamp").toDouble());
-                const double amt = t.value("amount").toDouble();
-                pushAmtSample(ts, std::fabs(amt));                     // Auto閾値用
-                if (std::fabs(amt) < backfillMinUnit(ui)) continue;    // 残存へは手動>0なら手動、Auto=0なら全件
-                const QString dir = t.value("direction").toString();
-                const int sign = (dir.compare("buy", Qt::CaseInsensitive) == 0) ? +1 : -1;
-                const double px = t.value("price").toDouble();
-                const double delta = m_lastDelta.value(inst, 0.0);
-
-                if (m_lastIV.value(inst, 0.0) <= 0.0) queueIV(inst);
-                recordExpiryEvent(inst, ts, amt, sign, delta);
-                applyTradeToResidual(inst, ts, amt, sign, delta, px);
+        m_decoder->decode(r.body, [this, inst, body = r.body](HistoryBatch& b) {
+            if (b.ok) applyHistoryBatch(b.trades);
+            else {
+                const auto head = QString::fromUtf8(body.left(200)).replace('\n', ' ');
+                ui->plainTextEdit->appendPlainText(
+                    QString("[DIFF][WARN] %1 JSON解釈失敗。head=%2").arg(inst, head));
             }
+            ui->plainTextEdit->appendPlainText(QString("[DIFF] %1 : %2件").arg(inst).arg(b.trades.size()));
+            autoBackfillDeltaTaskDone();
+            });
+        });
+}
+
+// 通貨まとめ取りの1ページ。時刻昇順で最後の ms から次ページを始め、境界 ms の trade_id で重複を除く
+void MainWindow::requestDeltaCurrencyPage(qint64 fromMs) {
+    const qint64 toMs = m_deltaGaps[m_deltaGapIdx].second;
+    m_sched->submit(RequestScheduler::Priority::DeltaGap, currencyTradesUrl(fromMs, toMs),
+        [this, fromMs, toMs](const RequestScheduler::Reply& r) {
+        if (!r.ok()) { deltaCurrencyPageFailed(fromMs, r.error); return; }
+        m_decoder->decode(r.body, [this, fromMs, toMs, body = r.body](HistoryBatch& b) {
+            if (b.ok) applyDeltaCurrencyPage(fromMs, toMs, b);
+            else deltaCurrencyPageFailed(fromMs, QString::fromUtf8(body.left(200)).replace('\n', ' '));
+            });
+        });
+}
+
+void MainWindow::deltaCurrencyPageFailed(qint64 fromMs, const QString& why) {
+    if (++m_deltaRetries <= 3) {
+        ui->plainTextEdit->appendPlainText(QString("[DIFF][ERR] ページ再試行(%1): %2").arg(m_deltaRetries).arg(why));
+        requestDeltaCurrencyPage(fromMs);
+        return;
+    }
+    // 取り切れていないのでウォーターマークは進めない（次回起動で同じ区間から）。
+    // カバレッジにも載せないので、残りはストアの穴として次の差分・切断区間の取り直しで拾われる
+    const auto fmt = [](qint64 ms) { return QDateTime::fromMSecsSinceEpoch(ms).toLocalTime().toString("yyyy-MM-dd HH:mm:ss.zzz"); };
+    ui->plainTextEdit->appendPlainText(QString("[DIFF][ERR] 差分取り込みを中断: %1").arg(why));
+    ui->plainTextEdit->appendPlainText(QString("[DIFF][ERR] 未取得の区間: %1 ～ %2（ほか残り%3区間）")
+        .arg(fmt(fromMs), fmt(m_deltaGaps[m_deltaGapIdx].second)).arg(m_deltaGaps.size() - m_deltaGapIdx - 1));
+    m_deltaDone = true;
+    m_deltaPending = 0;
+    m_dirty.markAllViews();
+}
+
+// 解析済みの1ページを反映（時刻昇順）。境界 ms の trade_id で前ページとの重なりを除く
+void MainWindow::applyDeltaCurrencyPage(qint64 fromMs, qint64 toMs, const HistoryBatch& b) {
+    m_deltaRetries = 0;
+
+    int n = 0;
+    qint64 lastTs = -1;
+    QSet<quint64> lastIds;
+    const RawTrade* lastMax = nullptr;     // 末尾 ms の最大 trade_id
+    for (const RawTrade& t : b.trades) {
+        if (t.ts != lastTs) { lastTs = t.ts; lastIds.clear(); lastMax = nullptr; }
+        lastIds.insert(t.tradeId);
+        if (!lastMax || t.tradeId > lastMax->tradeId) lastMax = &t;
+        if (t.ts == m_deltaEdgeTs && m_deltaEdgeIds.contains(t.tradeId)) continue;   // 前ページと重なった分
+
+        ingestHistoryTrade(t);
+        ++n;
+    }
+    ++m_deltaPages;
+
+    const QString upto = (lastTs > 0)
+        ? QDateTime::fromMSecsSinceEpoch(lastTs).toLocalTime().toString("MM-dd HH:mm") : QStringLiteral("-");
+    ui->plainTextEdit->appendPlainText(QString("[DIFF] ページ%1 : %2件（〜%3）").arg(m_deltaPages).arg(n).arg(upto));
+    m_dirty.expiryAll = true;
+
+    // 次ページ：最後の ms から（同じ ms の続きを落とさない）
+    if (b.hasMore && lastTs >= fromMs && lastTs < toMs) {
+        if (lastTs == m_deltaEdgeTs) m_deltaEdgeIds.unite(lastIds);   // 1ms に1ページ超の約定
+        else { m_deltaEdgeTs = lastTs; m_deltaEdgeIds = lastIds; m_deltaEdgeMaxId = 0; }
+        if (lastMax && lastMax->tradeId > m_deltaEdgeMaxId) {
+            m_deltaEdgeMaxId = lastMax->tradeId;
+            m_deltaEdgeMaxIdText = QString::fromLatin1(lastMax->tradeIdText, lastMax->tradeIdLen);
         }
-        else {
-            const auto head = QString::fromUtf8(bytes.left(200)).replace('\n', ' ');
-            ui->plainTextEdit->appendPlainText(
-                QString("[DIFF][WARN] %1 JSON解釈失敗。head=%2").arg(inst, head));
-        }
+        // 全部が既出＝同一 ms だけで1ページが埋まった。時刻では先へ進めないので、その ms の残りは trade_id 順で取る
+        if (n > 0 || m_deltaEdgeMaxIdText.isEmpty()) requestDeltaCurrencyPage(n > 0 ? lastTs : lastTs + 1);
+        else requestDeltaEdgePage();
+        return;
+    }
 
-        ui->plainTextEdit->appendPlainText(QString("[DIFF] %1 : %2件").arg(inst).arg(n));
-        m_deltaInflight = std::max(0, m_deltaInflight - 1);
-        autoBackfillDeltaPump();
+    // この穴は取り切った → カバレッジに記録して次の穴へ
+    m_store.markCovered(TradeStore::ALL, m_deltaGaps[m_deltaGapIdx].first, toMs);
+    m_store.flush();
+    if (++m_deltaGapIdx < m_deltaGaps.size()) {
+        m_deltaEdgeTs = -1;
+        m_deltaEdgeIds.clear();
+        requestDeltaCurrencyPage(m_deltaGaps[m_deltaGapIdx].first);
+        return;
+    }
+    autoBackfillDeltaTaskDone();
+}
+
+// 境界 ms の続き：前に見た最大の trade_id から取り、ms を越えた所で時刻順のページへ戻る
+void MainWindow::requestDeltaEdgePage() {
+    const qint64 edgeTs = m_deltaEdgeTs;
+    m_sched->submit(RequestScheduler::Priority::DeltaGap, currencyTradesByIdUrl(m_deltaEdgeMaxIdText),
+        [this, edgeTs](const RequestScheduler::Reply& r) {
+        if (!r.ok()) { deltaCurrencyPageFailed(edgeTs, r.error); return; }   // 出し直しは時刻ページから（同じ所に戻る）
+        m_decoder->decode(r.body, [this, edgeTs, body = r.body](HistoryBatch& b) {
+            if (b.ok) applyDeltaEdgePage(b);
+            else deltaCurrencyPageFailed(edgeTs, QString::fromUtf8(body.left(200)).replace('\n', ' '));
+            });
         });
 }
-// ===== ここから挿入：生存満期のフルバックフィル =====
-struct FullTask { QString inst; qint64 fromMs; qint64 toMs; qint64 stepMs; };
+
+void MainWindow::applyDeltaEdgePage(const HistoryBatch& b) {
+    m_deltaRetries = 0;
+    const qint64 edgeTs = m_deltaEdgeTs;
+    const quint64 prevMax = m_deltaEdgeMaxId;
+
+    int n = 0;
+    bool passed = !b.hasMore;             // 続きが無い、または ms を越えた約定が来たら取り切り
+    for (const RawTrade& t : b.trades) {
+        if (t.ts > edgeTs) { passed = true; continue; }             // 先の ms は時刻順のページで取る
+        if (t.tradeId > m_deltaEdgeMaxId) {
+            m_deltaEdgeMaxId = t.tradeId;
+            m_deltaEdgeMaxIdText = QString::fromLatin1(t.tradeIdText, t.tradeIdLen);
+        }
+        if (t.ts == edgeTs && m_deltaEdgeIds.contains(t.tradeId)) continue;
+        if (t.ts == edgeTs) m_deltaEdgeIds.insert(t.tradeId);
+        ingestHistoryTrade(t);
+        ++n;
+    }
+    ++m_deltaPages;
+    ui->plainTextEdit->appendPlainText(QString("[DIFF] ページ%1 : %2件（同一ms・trade_id 順）").arg(m_deltaPages).arg(n));
+    m_dirty.expiryAll = true;
+
+    if (!passed && m_deltaEdgeMaxId > prevMax) { requestDeltaEdgePage(); return; }
+    if (!passed)
+        ui->plainTextEdit->appendPlainText(QString("[DIFF][WARN] %1 の約定を trade_id 順で進められません。次の ms へ進みます。")
+            .arg(QDateTime::fromMSecsSinceEpoch(edgeTs).toLocalTime().toString("yyyy-MM-dd HH:mm:ss.zzz")));
+    requestDeltaCurrencyPage(edgeTs + 1);
+}
+
+// ストアのうちカバレッジ済みの区間だけを時刻順に再生（ストア内・既取り込み分との重なりは共通の重複判定で除く）
+qint64 MainWindow::replayStoredTrades(qint64 fromMs, qint64 toMs) {
+    QVector<InstId> idOf(m_store.nameCount(), INVALID_INST);     // nameId → InstId
+    for (int i = 0; i < idOf.size(); ++i) idOf[i] = m_reg.find(m_store.name(quint32(i)));
+
+    qint64 n = 0;
+    for (const auto& iv : m_store.covered(TradeStore::ALL, fromMs, toMs)) {
+        m_store.replay(iv.first, iv.second, [&](const TradeRecord& r) {
+            const InstId id = (r.nameId < quint32(idOf.size())) ? idOf[int(r.nameId)] : INVALID_INST;
+            if (m_dedup.seen(id, r.tradeSeq, r.tradeId, r.ts)) return;
+            ingestHistory(id, r.ts, r.amount, r.side, r.price, r.tradeSeq, r.iv);
+            ++n;
+            });
+    }
+    if (n > 0) m_dirty.expiryAll = true;
+    return n;
+}
+
+static constexpr qint64 LIVE_COVER_LAG_MS = 2000;   // 全体購読の届き遅れの見込み
+
+// 全体購読で受けた区間をカバレッジへ（届き遅れを見込んで少し手前まで）し、溜まった分を書き出す
+void MainWindow::syncTradeStore() {
+    if (m_liveSinceMs > 0 && m_liveLastMs - LIVE_COVER_LAG_MS > m_liveSinceMs)
+        m_store.markCovered(TradeStore::ALL, m_liveSinceMs, m_liveLastMs - LIVE_COVER_LAG_MS);
+    m_store.flush();
+}
+
+// WS が途切れていた区間（前後に届き遅れぶんの余裕）のうち、ストアに無い所だけを差分取り込みで埋める
+void MainWindow::backfillDisconnectGap(qint64 fromMs, qint64 toMs) {
+    if (fromMs <= 0 || toMs <= fromMs || m_instruments.isEmpty()) return;
+    const auto gaps = m_store.gaps(TradeStore::ALL, fromMs - LIVE_COVER_LAG_MS, toMs + LIVE_COVER_LAG_MS);
+    if (gaps.isEmpty()) return;
+
+    ui->plainTextEdit->appendPlainText(QString("[情報] 切断区間を取り直します（%1区間）。").arg(gaps.size()));
+    m_deltaGaps += gaps;
+    m_deltaToMs = std::max(m_deltaToMs, toMs + LIVE_COVER_LAG_MS);
+    if (!m_deltaDone) return;             // 差分取り込み中 → 今の分が済んだら続けて埋まる
+    m_deltaDone = false;
+    startDeltaGaps();
+}
+
+// ===== 生存満期のフルバックフィル（trade_seq カーソルでページ送り）=====
+// get_last_trades_by_instrument（start_seq〜end_seq、昇順）
+static QUrl tradesBySeqUrl(const QString& inst, qint64 startSeq, qint64 endSeq) {
+    const qint64 count = endSeq - startSeq + 1;
+    QUrl url("https://www.deribit.com/api/v2/public/get_last_trades_by_instrument");
+    QUrlQuery q;
+    q.addQueryItem("instrument_name", inst);
+    q.addQueryItem("start_seq", QString::number(startSeq));
+    q.addQueryItem("end_seq", QString::number(endSeq));
+    q.addQueryItem("include_old", "true");
+    q.addQueryItem("sorting", "asc");
+    q.addQueryItem("count", QString::number(count));
+    url.setQuery(q);
+    return url;
+}
 
 void MainWindow::fullBackfillLiveExpiriesInit() {
-    m_fullQueue.clear();
-    m_fullInflight = 0;
+    m_fullPending = 0;
     m_fullDone = false;
+    m_fullPagesSinceStore = 0;
+    m_fullRetries.clear();
 
     if (m_instruments.isEmpty()) {
         ui->plainTextEdit->appendPlainText("[情報] フルバックフィル: 銘柄なし。");
@@ -1287,189 +1790,124 @@ void MainWindow::fullBackfillLiveExpiriesInit() {
     }
 
     const qint64 now = QDateTime::currentMSecsSinceEpoch();
-    // 生存満期のみに限定
-    QSet<QString> liveInst;
-    for (const auto& v : m_instruments) {
-        if (!v.isObject()) continue;
-        const auto o = v.toObject();
-        if (!o.value("is_active").toBool(true)) continue;
-        const qint64 exp = qint64(o.value("expiration_timestamp").toDouble());
-        if (exp > now) {
-            const QString name = o.value("instrument_name").toString();
-            if (!name.isEmpty()) liveInst.insert(name);
-        }
-    }
-
-    // 初期窓：6時間 → 自動調整
-    const qint64 initialStep = 6ll * HOUR_MS;
-    const qint64 endMs = now;
+    m_seqCursor = loadSeqCursors();
 
-    for (const QString& inst : liveInst) {
-        const qint64 exp = m_instToExpiryMs.value(inst, endMs);
-        // 満期の120日前（早過ぎる空振り期間をスキップ）
-        const qint64 beginMs = std::max<qint64>(0, std::min(endMs, exp) - 120ll * DAY_MS);
-        m_fullQueue.push_back(FullTask{ inst, beginMs, endMs, initialStep });
+    // 生存満期のみ。前回の続き（保存カーソル）から、無ければ先頭から
+    QVector<FullTask> tasks;
+    for (InstId id = 0; id < InstId(m_reg.size()); ++id) {
+        if (!m_reg.isActive(id)) continue;
+        if (m_reg.expiryMs(id) <= now) continue;
+        const QString name = m_reg.name(id);
+        tasks.push_back(FullTask{ name, m_seqCursor.value(name, 1) });
     }
 
     ui->plainTextEdit->appendPlainText(
-        QString("[情報] フルバックフィル開始（生存満期のみ）: 銘柄=%1").arg(m_fullQueue.size())
+        QString("[情報] フルバックフィル開始（生存満期のみ・trade_seq 順）: 銘柄=%1").arg(tasks.size())
     );
 
-    fullBackfillPump();
+    for (const FullTask& t : tasks) requestBackfillSeq(t, false);
+    if (m_fullPending == 0) { ++m_fullPending; fullBackfillTaskDone(); }
 }
-void MainWindow::fullBackfillPump() {
-    while (m_fullInflight < AUTO_MAX_INFLIGHT && !m_fullQueue.empty()) { // std::deque -> empty()
-        FullTask t = m_fullQueue.front();
-        m_fullQueue.pop_front();
 
-        const qint64 winStart = t.fromMs;
-        const qint64 winEnd = std::min(t.fromMs + t.stepMs, t.toMs);
-
-        ++m_fullInflight;
-        requestBackfillWindow(t.inst, winStart, winEnd, t.stepMs);
-    }
-
-    if (m_fullInflight == 0 && m_fullQueue.empty() && !m_fullDone) { // std::deque -> empty()
+void MainWindow::fullBackfillTaskDone() {
+    m_fullPending = std::max(0, m_fullPending - 1);
+    if (m_fullPending == 0 && !m_fullDone) {
         m_fullDone = true;
+        storeSeqCursors(m_seqCursor);
         ui->plainTextEdit->appendPlainText("[情報] フルバックフィルが完了しました。");
-        rebuildSignalTableFromResidual();
-        updateExpiryActivityTable();
-        updatePinMapTable();
-        updateCurvesTables();
-        updateCurvesCharts();
+        m_dirty.markAllViews();
     }
 }
-void MainWindow::requestBackfillWindow(const QString& inst, qint64 fromMs, qint64 toMs, qint64 stepMs) {
-    QUrl url("https://www.deribit.com/api/v2/public/get_last_trades_by_instrument_and_time");
-    QUrlQuery q;
-    q.addQueryItem("instrument_name", inst);
-    q.addQueryItem("start_timestamp", QString::number(fromMs));
-    q.addQueryItem("end_timestamp", QString::number(toMs));
-    q.addQueryItem("include_old", "true");
-    q.addQueryItem("count", "1000");
-    url.setQuery(q);
 
-    QNetworkRequest req(url);
-    QNetworkReply* rep = m_net.get(req);
-    rep->setProperty("inst", inst);
-    rep->setProperty("fromMs", QVariant::fromValue(fromMs));
-    rep->setProperty("toMs", QVariant::fromValue(toMs));
-    rep->setProperty("stepMs", QVariant::fromValue(stepMs));
-
-    connect(rep, &QNetworkReply::finished, this, [this, rep] {
-        const QString inst = rep->property("inst").toString();
-        const qint64 fromMs = rep->property("fromMs").toLongLong();
-        const qint64 toMs = rep->property("toMs").toLongLong();
-        qint64 stepMs = rep->property("stepMs").toLongLong();
-
-        // 1) ネットワークエラー検知（詰まり防止）
-        if (rep->error() != QNetworkReply::NoError) {
-            const auto fstr = QDateTime::fromMSecsSinceEpoch(fromMs).toLocalTime().toString("yyyy-MM-dd HH:mm");
-            const auto tstr = QDateTime::fromMSecsSinceEpoch(toMs).toLocalTime().toString("yyyy-MM-dd HH:mm");
+void MainWindow::requestBackfillSeq(const FullTask& t, bool front) {
+    const qint64 endSeq = t.startSeq + SEQ_PAGE - 1;
+
+    ++m_fullPending;
+    m_sched->submit(RequestScheduler::Priority::DeepHistory, tradesBySeqUrl(t.inst, t.startSeq, endSeq),
+        [this, t, endSeq](const RequestScheduler::Reply& r) {
+        const QString& inst = t.inst;
+
+        if (!r.ok()) {
             ui->plainTextEdit->appendPlainText(
-                QString("[FULL][ERR] %1  %2 ～ %3 : %4")
-                .arg(inst, fstr, tstr, rep->errorString())
-            );
-            rep->deleteLater();
-            // 同じ窓を後ろに回して再試行（混雑回避）。step はそのまま。
-            m_fullQueue.push_back(FullTask{ inst, fromMs, toMs, stepMs });
-            m_fullInflight = std::max(0, m_fullInflight - 1);
-            fullBackfillPump();
-            return;
-        }
+                QString("[FULL][ERR] %1  seq %2～%3 : %4").arg(inst).arg(t.startSeq).arg(endSeq).arg(r.error));
 
-        QByteArray bytes = rep->readAll();
-        rep->deleteLater();
-
-        int n = 0;
-        qint64 lastTsSeen = -1;
-
-        // 2) JSON パース
-        QJsonDocument doc = QJsonDocument::fromJson(bytes);
-        if (doc.isObject()) {
-            const QJsonObject root = doc.object();
-            const QJsonObject res = root.value("result").toObject();
-            const QJsonArray  trades = res.value("trades").toArray();
-
-            n = trades.size();
-            for (const auto& v : trades) {
-                if (!v.isObject()) continue;
-                const QJsonObject t = v.toObject();
-                const qint64 ts = qint64(t.value("timestamp").toDouble());
-                const double amt = t.value("amount").toDouble();
-                const QString dir = t.value("direction").toString();
-                const int sign = (dir.compare("buy", Qt::CaseInsensitive) == 0) ? +1 : -1;
-                const double px = t.value("price").toDouble();
-                const double delta = m_lastDelta.value(inst, 0.0);
-
-                // Auto 閾値サンプルは常に保持
-                pushAmtSample(ts, std::fabs(amt));
-                // 残存への格納（手動>0なら手動、Auto=0なら1枚保持）
-                if (std::fabs(amt) >= backfillMinUnit(ui)) {
-                    if (m_lastIV.value(inst, 0.0) <= 0.0) queueIV(inst);
-                    recordExpiryEvent(inst, ts, amt, sign, delta);
-                    applyTradeToResidual(inst, ts, amt, sign, delta, px);
-                }
-
-                if (ts > lastTsSeen) lastTsSeen = ts;
+            // 1) 断られた（満期済み・未知の銘柄など）：この銘柄は打ち切り、カーソルは据え置き
+            if (r.rejected()) {
+                m_fullRetries.remove(inst);
+                fullBackfillTaskDone();
+                return;
             }
-        }
-        else {
-            // パース失敗（レスポンス先頭 200 文字だけダンプ）
-            const auto head = QString::fromUtf8(bytes.left(200)).replace('\n', ' ');
-            const auto fstr = QDateTime::fromMSecsSinceEpoch(fromMs).toLocalTime().toString("yyyy-MM-dd HH:mm");
-            const auto tstr = QDateTime::fromMSecsSinceEpoch(toMs).toLocalTime().toString("yyyy-MM-dd HH:mm");
-            ui->plainTextEdit->appendPlainText(
-                QString("[FULL][WARN] %1  %2 ～ %3 : JSON解釈失敗。head=%4")
-                .arg(inst, fstr, tstr, head)
-            );
-        }
 
-        // 3) 進捗ログ（Qt の %n 置換に統一）
-        {
-            const auto fstr = QDateTime::fromMSecsSinceEpoch(fromMs).toLocalTime().toString("yyyy-MM-dd HH:mm");
-            const auto tstr = QDateTime::fromMSecsSinceEpoch(toMs).toLocalTime().toString("yyyy-MM-dd HH:mm");
-            const double stepH = double(stepMs) / 3600000.0;
-            ui->plainTextEdit->appendPlainText(
-                QString("[FULL] %1  %2 ～ %3 : %4件 (step=%5h)")
-                .arg(inst, fstr, tstr)
-                .arg(n)
-                .arg(QString::number(stepH, 'f', 1))
-            );
+            // 2) 通信エラー：待ちを倍々に延ばして同じページを出し直す。上限で打ち切り
+            const int tries = ++m_fullRetries[inst];
+            if (tries > FULL_RETRY_MAX) {
+                ui->plainTextEdit->appendPlainText(
+                    QString("[FULL][WARN] %1 : %2回続けて失敗したので打ち切ります（seq %3 から再開可）")
+                    .arg(inst).arg(FULL_RETRY_MAX).arg(t.startSeq));
+                m_fullRetries.remove(inst);
+                fullBackfillTaskDone();
+                return;
+            }
+            ++m_fullPending;      // 待っている間も完了扱いにしない
+            QTimer::singleShot(FULL_RETRY_BASE_MS << (tries - 1), this, [this, t] {
+                requestBackfillSeq(t, false);
+                fullBackfillTaskDone();
+                });
+            fullBackfillTaskDone();
+            return;
         }
 
-        // 4) 窓サイズの自動調整（疑似ページング）
-        if (n >= 1000) {
-            stepMs = std::max<qint64>(5ll * 60 * 1000, stepMs / 2); // 下限5分
-        }
-        else if (n < 800) {
-            const qint64 maxStep = 24ll * HOUR_MS;
-            stepMs = std::min(maxStep, (qint64)(stepMs * 3 / 2));
-        }
+        // 3) 解析は裏で。反映は1ページ＝1バッチ
+        m_fullRetries.remove(inst);
+        m_decoder->decode(r.body, [this, t, endSeq, body = r.body](HistoryBatch& b) { applySeqPage(t, endSeq, b, body); });
+        });
+}
 
-        // 5) 次窓の enqueue（0件でも必ず前進）
-        //    - 通常: lastTsSeen+1 から toMs
-        //    - lastTs が取れない（n=0 等）: fromMs+step から toMs
-        qint64 resumeFrom = (lastTsSeen >= 0) ? (lastTsSeen + 1)
-            : std::min(toMs, fromMs + stepMs + 1);
-        if (resumeFrom < toMs) {
-            m_fullQueue.push_front(FullTask{ inst, resumeFrom, toMs, stepMs });
-        }
+void MainWindow::applySeqPage(const FullTask& t, qint64 endSeq, const HistoryBatch& b, const QByteArray& body) {
+    const QString& inst = t.inst;
+    if (!b.ok) {
+        // パース失敗・API エラー（先頭 200 文字だけダンプ）。この銘柄はここで打ち切り、カーソルは据え置き
+        const auto head = QString::fromUtf8(body.left(200)).replace('\n', ' ');
+        ui->plainTextEdit->appendPlainText(
+            QString("[FULL][WARN] %1  seq %2～%3 : 応答を解釈できません。head=%4")
+            .arg(inst).arg(t.startSeq).arg(endSeq).arg(head));
+        fullBackfillTaskDone();
+        return;
+    }
+
+    int n = 0;
+    qint64 maxSeq = t.startSeq - 1;
+    for (const RawTrade& tr : b.trades) {
+        if (tr.tradeSeq < t.startSeq || tr.tradeSeq > endSeq) continue;     // 念のため範囲外は捨てる
+        ingestHistoryTrade(tr);
+        maxSeq = std::max(maxSeq, tr.tradeSeq);
+        ++n;
+    }
 
-        // 6) カウンタ調整＆次の実行
-        m_fullInflight = std::max(0, m_fullInflight - 1);
-        updateExpiryActivityTable();  // 右下の集計列が止まらないよう随時更新
-        fullBackfillPump();
-        }); // ← connect の閉じカッコ
+    // 3) 進捗ログ
+    ui->plainTextEdit->appendPlainText(
+        QString("[FULL] %1  seq %2～%3 : %4件").arg(inst).arg(t.startSeq).arg(maxSeq).arg(n));
+
+    // 4) カーソル前進（取り込んだ最後の seq の次）。保存はまとめて
+    const qint64 next = maxSeq + 1;
+    m_seqCursor[inst] = next;
+    if (++m_fullPagesSinceStore >= 50) { storeSeqCursors(m_seqCursor); m_fullPagesSinceStore = 0; }
 
-} 
+    // 5) 続き：ページが埋まった / has_more なら同じ銘柄を先に進める。
+    //    空ページでも has_more なら seq の欠番を飛び越える
+    const bool more = b.hasMore || n >= SEQ_PAGE;
+    if (more) requestBackfillSeq(FullTask{ inst, n > 0 ? next : endSeq + 1 }, true);
+
+    m_dirty.expiryAll = true;     // 右下の集計列が止まらないよう次フレームで更新
+    fullBackfillTaskDone();
+}
 
 /* ================= 手動バックフィル（監視銘柄のみ） ================= */
 
 void MainWindow::onBackfillClicked() {
     if (m_targetInstruments.isEmpty()) { QMessageBox::information(this, "履歴取り込み", "先に購読銘柄を選んでください。"); return; }
 
-    m_events.clear();
+    m_dVolWheel.clear();
     m_bursts.clear();
 
     int hours = 24;  // UI部品がなければ既定24h
@@ -1498,22 +1936,17 @@ void MainWindow::prefetchTickersForTargets() {
 void MainWindow::requestTickerFor(const QString& inst) {
     QUrl url("https://www.deribit.com/api/v2/public/ticker");
     QUrlQuery q; q.addQueryItem("instrument_name", inst); url.setQuery(q);
-    QNetworkRequest req(url);
 
-    QNetworkReply* rep = m_net.get(req);
     m_pendingTickers++;
-    rep->setProperty("inst", inst);
+    m_sched->submit(RequestScheduler::Priority::LiveCritical, url, [this, inst](const RequestScheduler::Reply& rp) {
+        const InstId id = m_reg.find(inst);
 
-    connect(rep, &QNetworkReply::finished, this, [this, rep] {
-        const QString inst = rep->property("inst").toString();
-        QByteArray bytes = rep->readAll(); rep->deleteLater();
-
-        QJsonDocument doc = QJsonDocument::fromJson(bytes);
-        if (doc.isObject()) {
+        QJsonDocument doc = QJsonDocument::fromJson(rp.body);
+        if (doc.isObject() && id != INVALID_INST) {
             const QJsonObject res = doc.object().value("result").toObject();
             const QJsonObject greeks = res.value("greeks").toObject();
-            if (!greeks.isEmpty()) m_lastDelta[inst] = greeks.value("delta").toDouble();
-            if (res.contains("mark_iv")) m_lastIV[inst] = res.value("mark_iv").toDouble();
+            if (!greeks.isEmpty()) m_lastDelta[int(id)] = greeks.value("delta").toDouble();
+            if (res.contains("mark_iv")) m_lastIV[int(id)] = res.value("mark_iv").toDouble();
         }
         if (--m_pendingTickers == 0) {
             ui->plainTextEdit->appendPlainText("[情報] Δ/IVの取得完了。約定履歴を取り込みます。");
@@ -1524,135 +1957,159 @@ void MainWindow::requestTickerFor(const QString& inst) {
         });
 }
 
-void MainWindow::requestBackfillFor(const QString& inst, qint64 fromMs, qint64 toMs) {
-    QUrl url("https://www.deribit.com/api/v2/public/get_last_trades_by_instrument_and_time");
-    QUrlQuery q;
-    q.addQueryItem("instrument_name", inst);
-    q.addQueryItem("start_timestamp", QString::number(fromMs));
-    q.addQueryItem("end_timestamp", QString::number(toMs));
-    q.addQueryItem("include_old", "true");
-    q.addQueryItem("count", "1000");
-    url.setQuery(q);
-
-    QNetworkRequest req(url);
-    QNetworkReply* rep = m_net.get(req);
+void MainWindow::requestBackfillFor(const QString& inst, qint64 fromMs, qint64 toMs, int attempt) {
     m_backfillPending++;
-    rep->setProperty("inst", inst);
-
-    connect(rep, &QNetworkReply::finished, this, [this, rep] {
-        const QString inst = rep->property("inst").toString();
-        QByteArray bytes = rep->readAll(); rep->deleteLater();
-
-        const QJsonDocument doc = QJsonDocument::fromJson(bytes);
-        int added = 0;
-        if (doc.isObject()) {
-            const QJsonArray trs = doc.object().value("result").toObject().value("trades").toArray();
-            for (const auto& v : trs) {
-                if (!v.isObject()) continue;
-                const QJsonObject t = v.toObject();
-                const qint64 ts = (qint64)t.value("timestamp").toDouble();
-                const double amt = t.value("amount").toDouble();
-                // ★ Auto用サンプルは必ず記録
-                pushAmtSample(ts, std::fabs(amt));
-                if (std::fabs(amt) < backfillMinUnit(ui)) continue;  // 手動>0なら手動、Auto時は全件
-                const QString dir = t.value("direction").toString();
-                const int sign = (dir.compare("buy", Qt::CaseInsensitive) == 0) ? +1 : -1;
-                const double delta = m_lastDelta.value(inst, 0.0);
-
-                const double px = t.value("price").toDouble();
-
-                // 逆算IV → m_lastIV を温める（ない時のみ）
-                {
-                    const qint64 expMs = expiryFromInst(inst);
-                    const qint64 minLeft = std::max<qint64>(expMs - ts, 0) / 60000ll;
-                    if (px > 0.0 && minLeft > 0 && m_underlyingPx > 0.0) {
-                        const double K = strikeFromInst(inst);
-                        const bool   isCall = isCallFromInst(inst);
-                        const auto   gk = IVGreeks::solveAndGreeks(
-                            isCall ? OptionCP::Call : OptionCP::Put,
-                            px, m_underlyingPx, K, double(minLeft), 0.0, 0.0);
-                        if (gk.iv > 0.0 && m_lastIV.value(inst, 0.0) <= 0.0) {
-                            m_lastIV[inst] = gk.iv;
-                        }
-                    }
-                    if (m_lastIV.value(inst, 0.0) <= 0.0) queueIV(inst);
-                }
-
-
-                addEvent(TradeEvent{ ts, amt, delta, sign, inst });
-                applyTradeToResidual(inst, ts, amt, sign, delta, px);
-                ++added;
-
-                // （任意）バックフィルでもレッグ明細を復元したい場合は以下を有効化
-                {
-                    const bool   isCall = isCallFromInst(inst);
-                    const double k = strikeFromInst(inst);
-                    const qint64 expMs2 = expiryFromInst(inst);
-                    const QString key = makeClusterKey(expMs2, isCall, k);
-
-                    double bpDiff = 0.0;
-                    Aggressor ag = m_nbbo.inferAggressor(inst, px, &bpDiff);
-                    const auto nb = m_nbbo.get(inst);
-                    const double mid = nb.mid();
-
-                    double dAbs = std::abs(delta);
-                    if (dAbs <= 1e-9) dAbs = absDeltaGuess(k, m_underlyingPx);
-
-                    LegDetail lg;
-                    lg.ts = ts;
-                    lg.linkKey = key;
-                    lg.inst = inst;
-                    lg.sign = sign;
-                    lg.amount = std::abs(amt);
-                    lg.estDelta = dAbs;
-                    lg.price = px;
-
-                    lg.aggressor = ag;
-                    lg.venue = "Deribit";
-                    lg.expiryMs = expMs2;
-                    lg.strike = k;
-                    lg.isCall = isCall;
-
-                    lg.nbboBid = nb.bid;
-                    lg.nbboAsk = nb.ask;
-                    lg.mid = mid;
-                    lg.bpDiffBp = bpDiff;
-
-                    lg.tradeIV = t.value("iv").toDouble();
-                    if (lg.tradeIV <= 0.0) lg.tradeIV = m_lastIV.value(inst, 0.0);
-
-                    lg.orderId = t.value("trade_id").toVariant().toString();
-
-                    auto& vec = m_legsByKey[key];
-                    vec.push_back(lg);
-                    if (vec.size() > 200) vec.remove(0, vec.size() - 200);
-                }
+    m_sched->submit(RequestScheduler::Priority::DeltaGap, lastTradesUrl(inst, fromMs, toMs),
+        [this, inst, fromMs, toMs, attempt](const RequestScheduler::Reply& rp) {
+        if (!rp.ok()) {
+            ui->plainTextEdit->appendPlainText(QString("[警告] 履歴取り込み %1: %2").arg(inst).arg(rp.error));
+            // 断られた（4xx / API エラー）・上限に達したらこの銘柄は諦める。通信エラーは待って出し直す
+            if (!rp.rejected() && attempt < BACKFILL_RETRY_MAX) {
+                QTimer::singleShot(1000 << attempt, this, [this, inst, fromMs, toMs, attempt] {
+                    requestBackfillFor(inst, fromMs, toMs, attempt + 1);
+                    finishBackfillFor();
+                    });
+                return;
+            }
+            finishBackfillFor();
+            return;
+        }
+        m_decoder->decode(rp.body, [this, inst](HistoryBatch& b) { applyBackfillFor(inst, b); });
+        });
+}
+
+// 手動バックフィル1応答ぶんの反映（解析済み・時刻順）
+void MainWindow::applyBackfillFor(const QString& inst, const HistoryBatch& b) {
+    const InstId id = m_reg.find(inst);
+    int added = 0;
+    if (b.ok) {
+        // 1) 取り込む行だけ拾う（逆算IVはこの後まとめて解く）
+        struct Row { qint64 ts; double amt; int sign; double px; double spot; const RawTrade* src; };
+        QVector<Row> rows;
+        rows.reserve(int(b.trades.size()));
+        for (const RawTrade& t : b.trades) {
+            const qint64 ts = t.ts;
+            const double amt = t.amount;
+            if (m_dedup.seen(id, t.tradeSeq, t.tradeId, ts)) continue;   // 既に取り込み済み
+            // ★ Auto用サンプルは必ず記録
+            pushAmtSample(ts, std::fabs(amt));
+            if (id == INVALID_INST) continue;
+            if (std::fabs(amt) < backfillMinUnit(ui)) continue;  // 手動>0なら手動、Auto時は全件
+            const double spot = (t.indexPrice > 0.0) ? t.indexPrice : m_underlyingPx;   // 約定時点の原資産
+            rows.push_back(Row{ ts, amt, int(t.sign), t.price, spot, &t });
+        }
 
+        // 2) Trade IV：取引所の iv がある行はそのまま、無い行だけ約定時点の原資産で一括逆算（解けない行は 0）
+        QVector<double> ivTrade(rows.size(), 0.0);
+        {
+            const bool   isCall = isCallFromInst(id);
+            const double K = strikeFromInst(id);
+            const qint64 expMs = expiryFromInst(id);
+            IvBatchInput ivIn;
+            QVector<int> solveRow;
+            for (int i = 0; i < rows.size(); ++i) {
+                const Row& r = rows[i];
+                if (r.src->iv > 0.0) { ivTrade[i] = r.src->iv; continue; }
+                if (r.spot <= 0.0) continue;
+                const qint64 minLeft = std::max<qint64>(expMs - r.ts, 0) / 60000ll;
+                ivIn.push(isCall, r.px, r.spot, K, double(minLeft));
+                solveRow.push_back(i);
+            }
+            if (ivIn.size() > 0) {
+                IvBatchOutput ivOut;
+                IvBatch::solve(ivIn, ivOut);
+                for (int j = 0; j < solveRow.size() && j < ivOut.iv.size(); ++j) ivTrade[solveRow[j]] = ivOut.iv[j];
             }
         }
-        ui->plainTextEdit->appendPlainText(QString("[情報] 履歴取り込み %1: %2件").arg(inst).arg(added));
 
-        if (--m_backfillPending == 0) {
-            ui->plainTextEdit->appendPlainText("[情報] 履歴取り込み完了。サマリ更新。");
-            rebuildSignalTableFromResidual();
+        // 3) 時系列順に反映
+        for (int i = 0; i < rows.size(); ++i) {
+            const RawTrade& t = *rows[i].src;
+            const qint64 ts = rows[i].ts;
+            const double amt = rows[i].amt;
+            const int    sign = rows[i].sign;
+            const double px = rows[i].px;
+            const double delta = lastDeltaOf(id);
+
+            // Trade IV → m_lastIV を温める（ない時のみ）
+            if (ivTrade[i] > 0.0 && lastIVOf(id) <= 0.0)
+                m_lastIV[int(id)] = ivTrade[i];
+            if (lastIVOf(id) <= 0.0) queueIV(id);
+
+            addEvent(TradeEvent{ ts, amt, delta, sign, id });
+            applyTradeToResidual(id, ts, amt, sign, delta, px, t.tradeSeq);
+            ++added;
+
+            // （任意）バックフィルでもレッグ明細を復元したい場合は以下を有効化
+            {
+                const bool   isCall = isCallFromInst(id);
+                const double k = strikeFromInst(id);
+                const qint64 expMs2 = expiryFromInst(id);
+                const ClusterBook::Key key = makeClusterKey(expMs2, isCall, k);
+
+                // 当時の気配が記録に無ければ Unknown（今の板で判定しない）
+                double bpDiff = 0.0;
+                Aggressor ag = m_nbbo.inferAggressor(id, ts, px, &bpDiff);
+                const auto nb = m_nbbo.at(id, ts - 1);
+                const double mid = nb.mid();
+
+                double dAbs = std::abs(delta);
+                if (dAbs <= 1e-9) dAbs = absDeltaGuess(k, rows[i].spot);
+
+                LegDetail lg;
+                lg.ts = ts;
+                lg.linkKey = key;
+                lg.inst = inst;
+                lg.sign = sign;
+                lg.amount = std::abs(amt);
+                lg.estDelta = dAbs;
+                lg.price = px;
+
+                lg.aggressor = ag;
+                lg.venue = "Deribit";
+                lg.expiryMs = expMs2;
+                lg.strike = k;
+                lg.isCall = isCall;
+
+                lg.nbboBid = nb.bid;
+                lg.nbboAsk = nb.ask;
+                lg.mid = mid;
+                lg.bpDiffBp = bpDiff;
+                lg.markPrice = t.markPrice;
+                lg.indexPrice = rows[i].spot;
+
+                lg.tradeIV = (ivTrade[i] > 0.0) ? ivTrade[i] : lastIVOf(id);
+
+                lg.orderId = QString::fromLatin1(t.tradeIdText, t.tradeIdLen);
+
+                auto& vec = m_legsByKey[key];
+                vec.push_back(lg);
+                if (vec.size() > 200) vec.remove(0, vec.size() - 200);
+            }
+
         }
-        });
+    }
+    ui->plainTextEdit->appendPlainText(QString("[情報] 履歴取り込み %1: %2件").arg(inst).arg(added));
+    finishBackfillFor();
+}
+
+void MainWindow::finishBackfillFor() {
+    if (--m_backfillPending == 0) {
+        ui->plainTextEdit->appendPlainText("[情報] 履歴取り込み完了。サマリ更新。");
+        m_dirty.signalsRebuild = true;
+    }
 }
 
 /* ================= 短期集計 ================= */
 
 void MainWindow::addEvent(const TradeEvent& ev) {
-    m_events.append(ev);
-    pruneOld(ev.tsMs);
+    m_dVolWheel.add(ev.tsMs, double(ev.sign) * ev.amount * ev.delta);
     onNewTradeForBurst(ev);
 }
 
 void MainWindow::pruneOld(qint64 nowMs) {
-    while (!m_events.isEmpty()) {
-        const auto& head = m_events.first();
-        if (nowMs - head.tsMs > FIVE_MIN_MS) m_events.removeFirst();
-        else break;
-    }
+    m_dVolWheel.advance(nowMs);
+    refreshAutoBigUnit(nowMs);
 }
 
 bool MainWindow::isBigTrade(double amount) const {
@@ -1660,67 +2117,50 @@ bool MainWindow::isBigTrade(double amount) const {
     return std::fabs(amount) >= double(unit);
 }
 
-double MainWindow::sumDeltaVolume(qint64 nowMs, int windowMs) const {
-    double s = 0.0;
-    for (const auto& e : m_events)
-        if (nowMs - e.tsMs <= windowMs) s += double(e.sign) * e.amount * e.delta;
-    return s;
+// 走行和を読むだけ（時刻は pruneOld で進めておく）
+double MainWindow::sumDeltaVolume(qint64 /*nowMs*/, int windowMs) const {
+    return m_dVolWheel.sum(windowMs);
 }
 
 /* ================= 満期アクティビティ ================= */
 
-qint64 MainWindow::expiryFromInst(const QString& inst) const {
-    auto it = m_instToExpiryMs.find(inst);
-    if (it != m_instToExpiryMs.end()) return it.value();
-    return 0;
+qint64 MainWindow::expiryFromInst(InstId id) const {
+    // 生存銘柄のみ（満期済みは集計対象外）
+    if (!m_reg.valid(id) || !m_reg.isActive(id)) return 0;
+    return m_reg.expiryMs(id);
 }
 
-bool MainWindow::alreadySeenTrade(const QString& tradeId, qint64 ts) {
-    const qint64 cutoff = ts - DAY_MS;
-    while (!m_seenTradeQueue.isEmpty() && m_seenTradeQueue.front().first < cutoff) {
-        auto old = m_seenTradeQueue.front(); m_seenTradeQueue.pop_front();
-        m_seenTradeIds.remove(old.second);
-    }
-    if (m_seenTradeIds.contains(tradeId)) return true;
-    m_seenTradeIds.insert(tradeId);
-    m_seenTradeQueue.push_back(qMakePair(ts, tradeId));
-    return false;
-}
-
-void MainWindow::recordExpiryEvent(const QString& inst, qint64 ts, double amount, int /*sign*/, double /*delta*/) {
-    const qint64 expMs = expiryFromInst(inst);
+void MainWindow::recordExpiryEvent(InstId id, qint64 ts, double amount, int /*sign*/, double /*delta*/) {
+    const qint64 expMs = expiryFromInst(id);
     if (expMs <= 0) return;
-    auto& vec = m_expiryEvents[expMs];
-    vec.push_back(MiniEv{ ts, std::abs(amount), 0.0 });
+    // 段階保持（生1h→分足24h→時間足365日）へ。1h/24h の和は追加時に更新される
+    const double qty = std::abs(amount);
+    m_expiryActivity[expMs].history.add(ts, qty);
+    m_dirty.expiries.insert(expMs);
 
-    // 全期間集計できるように長期保持（上限は安全のため最大365日）
-    static constexpr qint64 ACTIVITY_KEEP_MS = 365ll * DAY_MS;
-    const qint64 cutoff = QDateTime::currentMSecsSinceEpoch() - ACTIVITY_KEEP_MS;
-    while (!vec.isEmpty() && vec.front().ts < cutoff) vec.removeFirst();
+}
 
+// 全期間 / 24h / 1h（どれも段階保持の走行和を読むだけ）
+MainWindow::ActivityTotals MainWindow::expiryActivityTotals(qint64 exp, qint64 now) {
+    auto it = m_expiryActivity.find(exp);
+    if (it == m_expiryActivity.end()) return ActivityTotals{};
+    it->history.advance(now);
+    const TieredSeries& h = it->history;
+    return ActivityTotals{ h.total(), h.minuteWindowSum(), h.rawWindowSum() };
 }
 
 void MainWindow::updateExpiryActivityTable() {
     if (!ui->tableExpiryActivity) return;
 
-    QVector<qint64> exps; exps.reserve(m_instToExpiryMs.size());
-    for (auto it = m_instToExpiryMs.begin(); it != m_instToExpiryMs.end(); ++it) exps.push_back(it.value());
-    std::sort(exps.begin(), exps.end());
-    exps.erase(std::unique(exps.begin(), exps.end()), exps.end());
+    const QVector<qint64> exps = m_reg.activeExpiries();
 
     struct Row { qint64 exp; double qall; double q24; double q1; };
     QVector<Row> rows; rows.reserve(exps.size());
 
     const qint64 now = QDateTime::currentMSecsSinceEpoch();
     for (qint64 exp : exps) {
-        const auto& vec = m_expiryEvents.value(exp);
-        double qall = 0.0, q24 = 0.0, q1 = 0.0;
-        for (const auto& e : vec) {
-            qall += e.qty;                         // 全期間（保持期間内）
-            if (now - e.ts <= DAY_MS)  q24 += e.qty;
-            if (now - e.ts <= HOUR_MS) q1 += e.qty;
-        }
-        rows.push_back(Row{ exp, qall, q24, q1 });
+        const ActivityTotals t = expiryActivityTotals(exp, now);
+        rows.push_back(Row{ exp, t.all, t.d24, t.h1 });
     }
 
     ui->tableExpiryActivity->setSortingEnabled(false);
@@ -1729,7 +2169,9 @@ void MainWindow::updateExpiryActivityTable() {
     int r = 0;
     for (const auto& row : rows) {
         const QDateTime dt = QDateTime::fromMSecsSinceEpoch(row.exp).toLocalTime();
-        ui->tableExpiryActivity->setItem(r, 0, mkTextItem(dt.toString("yyyy-MM-dd HH:mm")));
+        auto* eitem = mkTextItem(dt.toString("yyyy-MM-dd HH:mm"));
+        eitem->setData(Qt::UserRole, QVariant::fromValue(row.exp));   // 部分更新で行を引く
+        ui->tableExpiryActivity->setItem(r, 0, eitem);
         ui->tableExpiryActivity->setItem(r, 1, mkNumItem(row.qall, 1));
         ui->tableExpiryActivity->setItem(r, 2, mkNumItem(row.q24, 1));
         ui->tableExpiryActivity->setItem(r, 3, mkNumItem(row.q1, 1));
@@ -1740,107 +2182,152 @@ void MainWindow::updateExpiryActivityTable() {
     ui->tableExpiryActivity->sortItems(m_expActSortCol, m_expActSortOrder);
 }
 
-/* ================= シグナル：残存推定 ================= */
+// 変化のあった満期の行だけ数値を差し替える（行が無ければ全体を作り直す）
+void MainWindow::updateExpiryActivityRows(const QSet<qint64>& exps) {
+    auto* tbl = ui->tableExpiryActivity;
+    if (!tbl) return;
 
-bool MainWindow::isCallFromInst(const QString& inst) { return inst.endsWith("-C", Qt::CaseInsensitive); }
-double MainWindow::strikeFromInst(const QString& inst) {
-    const QStringList p = inst.split('-');
-    if (p.size() >= 4) {
-        bool ok = false; double k = p[2].toDouble(&ok);
-        if (ok) return k;
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    int found = 0;
+    tbl->setSortingEnabled(false);
+    for (int r = 0; r < tbl->rowCount(); ++r) {
+        const auto* eitem = tbl->item(r, 0);
+        if (!eitem) continue;
+        const qint64 exp = eitem->data(Qt::UserRole).toLongLong();
+        if (!exps.contains(exp)) continue;
+
+        const ActivityTotals t = expiryActivityTotals(exp, now);
+        tbl->setItem(r, 1, mkNumItem(t.all, 1));
+        tbl->setItem(r, 2, mkNumItem(t.d24, 1));
+        tbl->setItem(r, 3, mkNumItem(t.h1, 1));
+        ++found;
     }
-    return 0.0;
+    tbl->setSortingEnabled(true);
+
+    if (found < exps.size()) { updateExpiryActivityTable(); return; }
+    tbl->sortItems(m_expActSortCol, m_expActSortOrder);
 }
 
-QString MainWindow::makeClusterKey(qint64 expMs, bool isCall, double strike) const {
+/* ================= シグナル：残存推定 ================= */
+
+bool MainWindow::isCallFromInst(InstId id) const { return m_reg.valid(id) && m_reg.isCall(id); }
+double MainWindow::strikeFromInst(InstId id) const { return m_reg.valid(id) ? m_reg.strike(id) : 0.0; }
+
+ClusterBook::Key MainWindow::makeClusterKey(qint64 expMs, bool isCall, double strike) {
     const int kRound = int(std::round(strike / K_BUCKET) * K_BUCKET);
-    return QString("%1|%2|%3").arg(expMs).arg(isCall ? 1 : 0).arg(kRound);
+    return m_clusters.makeKey(expMs, isCall, kRound);
 }
 
-QPair<double, double> MainWindow::residualForKey(const QString& key) const {
-    const double q = m_residualQtyByKey.value(key, 0.0);
-    const double dv = m_residualDVolByKey.value(key, 0.0);
-    return qMakePair(q, dv);
+QPair<double, double> MainWindow::residualForKey(ClusterBook::Key key) const {
+    const int s = m_clusters.find(key);
+    if (s < 0) return qMakePair(0.0, 0.0);
+    return qMakePair(m_clusters.qty(s), m_clusters.dVol(s));
 }
 
-void MainWindow::applyTradeToResidual(const QString& inst, qint64 ts,
-    double amount, int sign, double deltaRaw, double /*tradePx*/) {
-    const qint64 exp = expiryFromInst(inst);
+void MainWindow::applyTradeToResidual(InstId id, qint64 ts,
+    double amount, int sign, double deltaRaw, double /*tradePx*/, qint64 tradeSeq) {
+    const qint64 exp = expiryFromInst(id);
     if (exp <= 0) return;
     if (!isBigTrade(amount)) return;
 
-    const bool   isCall = isCallFromInst(inst);
-    const double k = strikeFromInst(inst);
+    const bool   isCall = isCallFromInst(id);
+    const double k = strikeFromInst(id);
     if (k <= 0.0) return;
 
-    const QString key = makeClusterKey(exp, isCall, k);
-
-    // 残存枚数（買い:+ / 売り:-）。★下限を設けない：売りの“仕込み”は負で保持する
-    double& qty = m_residualQtyByKey[key];
-    qty += (sign > 0 ? std::abs(amount) : -std::abs(amount));
-
-    // ★ 買い/売りのネット（買い:+ 売り:-）…表で「買い連続/売り連続」を正しく出すために使う
-    double& signedQty = m_residualSignedQtyByKey[key];
-    signedQty += (sign > 0 ? +1.0 : -1.0) * std::abs(amount);
+    const ClusterBook::Key key = makeClusterKey(exp, isCall, k);
 
     // Δ：無い/0なら距離から推定。符号は必ず Call=＋ / Put=−
     double dAbs = std::abs(deltaRaw);
     if (dAbs <= 1e-9) dAbs = absDeltaGuess(k, m_underlyingPx);
     const double deltaSigned = isCall ? +dAbs : -dAbs;
 
+    // 残存枚数・ネット（買い:+ / 売り:-）。★下限を設けない：売りの“仕込み”は負で保持する
     // dVol = 約定方向(買い:+ / 売り:-) × 枚数 × (符号付きΔ)
-    double& dv = m_residualDVolByKey[key];
-    dv += (sign > 0 ? +1.0 : -1.0) * std::abs(amount) * deltaSigned;
+    const double signedAmt = (sign > 0 ? +1.0 : -1.0) * std::abs(amount);
+    const int s = m_clusters.slot(key);
+    m_clusters.addTrade(s, ts, signedAmt, signedAmt * deltaSigned, id);
+    m_curveDirtySlots.insert(s);
 
-    // 付帯
-    m_residualLastTsByKey[key] = std::max(m_residualLastTsByKey.value(key, 0ll), ts);
-    m_residualTradesByKey[key] = m_residualTradesByKey.value(key, 0) + 1;
-    m_residualInstsByKey[key].insert(inst);
+    // 先行書き込みログへ（書き出しは書き込みスレッドがまとめて行う）
+    if (m_journal.isOpen())
+        m_journal.append(JournalRecord{ ts, tradeSeq, exp, signedAmt, signedAmt * deltaSigned,
+            qint32(ClusterBook::strikeOf(key)), storeNameIdOf(id), quint8(isCall ? 1 : 0) });
 
-    // 既存行があれば即時更新（推定Δは |dVol|/qty）
+    // 行の書き換え・満期集計はフレーム単位でまとめて反映
+    m_dirty.clusterKeys.insert(key);
+}
+
+// 既存行の数値セルだけを残存から更新（推定Δは |dVol|/qty）
+void MainWindow::refreshSignalRow(ClusterBook::Key key) {
     const int row = findRowByKey(key);
-    if (row >= 0) {
-        const double qAbs = std::abs(qty);
-        const double absDVol = std::abs(dv);
-        const double notionalUSD = (m_underlyingPx > 0.0) ? (qAbs * m_underlyingPx) : 0.0;
-        const double avgAbsDelta = (qAbs > 1e-12 ? absDVol / qAbs : 0.0);
+    const int s = m_clusters.find(key);
+    if (row < 0 || s < 0) return;
+
+    const double qty = m_clusters.qty(s);
+    const double dv = m_clusters.dVol(s);
+    const double qAbs = std::abs(qty);
+    const double absDVol = std::abs(dv);
+    const double notionalUSD = (m_underlyingPx > 0.0) ? (qAbs * m_underlyingPx) : 0.0;
+    const double avgAbsDelta = (qAbs > 1e-12 ? absDVol / qAbs : 0.0);
+
+    const qint64 anchorTs = m_clusters.anchorTs(s) > 0 ? m_clusters.anchorTs(s) : m_clusters.lastTs(s);
+    const QString show = QDateTime::fromMSecsSinceEpoch(anchorTs).toLocalTime()
+        .toString("yy/MM/dd HH:mm:ss");
+    auto* titem = mkTimeItem(anchorTs, show);
+    titem->setData(Qt::UserRole, QVariant::fromValue(key));   // ← クラスタkeyを時刻セルに保持
+    ui->tableSignals->setItem(row, 0, titem);
+    {
+        auto* it = new QTableWidgetItem;
+        it->setData(Qt::EditRole, std::fabs(qty));                 // ← ソート用は abs
+        it->setText(QString::number(qty, 'f', 1));                  // 表示は符号付き
+        it->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        ui->tableSignals->setItem(row, 5, it);
+    }
 
+    ui->tableSignals->setItem(row, 6, mkNumItem(avgAbsDelta, 2));
+    ui->tableSignals->setItem(row, 7, mkNumItem(absDVol, 2));
+    ui->tableSignals->setItem(row, 8, mkNumItemWithText(notionalUSD, fmtComma0(notionalUSD)));
 
+    const int trades = m_clusters.trades(s);
+    const int uniq = m_clusters.instCount(s);
+    ui->tableSignals->setItem(row, 9, mkTextItem(QString("件数%1 / 銘柄%2").arg(trades).arg(uniq)));
+}
 
-        const qint64 anchorTs = m_signalAnchorTsByKey.value(key, m_residualLastTsByKey[key]);
-        const QString show = QDateTime::fromMSecsSinceEpoch(anchorTs).toLocalTime()
-            .toString("yy/MM/dd HH:mm:ss");
-        auto* titem = mkTimeItem(anchorTs, show);
-        titem->setData(Qt::UserRole, key);   // ← クラスタkeyを時刻セルに保持
-        ui->tableSignals->setItem(row, 0, titem);
-        {
-            auto* it = new QTableWidgetItem;
-            it->setData(Qt::EditRole, std::fabs(qty));                 // ← ソート用は abs
-            it->setText(QString::number(qty, 'f', 1));                  // 表示は符号付き
-            it->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-            ui->tableSignals->setItem(row, 5, it);
-        }
+/* ================= フレーム単位の描画反映 ================= */
 
-        ui->tableSignals->setItem(row, 6, mkNumItem(avgAbsDelta, 2));
-        ui->tableSignals->setItem(row, 7, mkNumItem(absDVol, 2));
-        ui->tableSignals->setItem(row, 8, mkNumItemWithText(notionalUSD, fmtComma0(notionalUSD)));
+void MainWindow::flushUiFrame() {
+    if (!m_dirty.any()) return;
 
-        const int trades = m_residualTradesByKey.value(key, 0);
-        const int uniq = m_residualInstsByKey.value(key).size();
-        ui->tableSignals->setItem(row, 9, mkTextItem(QString("件数%1 / 銘柄%2").arg(trades).arg(uniq)));
+    // ログはフレーム分をまとめて1回で追記
+    if (!m_dirty.tapeLines.isEmpty())
+        ui->plainTextEdit->appendPlainText(m_dirty.tapeLines.join('\n'));
+
+    if (m_dirty.signalsRebuild) {
+        rebuildSignalTableFromResidual();
+    }
+    else if (!m_dirty.clusterKeys.isEmpty() && ui->tableSignals) {
+        // setItem 毎の再ソートを避けるため、まとめて書いてから1回だけソート
+        const bool wasSorting = ui->tableSignals->isSortingEnabled();
+        ui->tableSignals->setSortingEnabled(false);
+        for (ClusterBook::Key key : std::as_const(m_dirty.clusterKeys)) refreshSignalRow(key);
+        ui->tableSignals->setSortingEnabled(wasSorting);
     }
 
-    // 1h列が止まらないよう、約定ごとに集計更新
-    updateExpiryActivityTable();
-}
+    if (m_dirty.expiryAll) updateExpiryActivityTable();
+    else if (!m_dirty.expiries.isEmpty()) updateExpiryActivityRows(m_dirty.expiries);
+
+    if (m_dirty.pinMap) updatePinMapTable();
+    if (m_dirty.curves) updateCurves();
 
+    m_dirty.clear();
+}
 
 bool MainWindow::passSignalFilter(qint64 expMs) const {
     const qint64 f = displayExpiryFilterMs(); // 0=All
     return (f == 0) || (f == expMs);
 }
 
-int MainWindow::findRowByKey(const QString& key) const {
+int MainWindow::findRowByKey(ClusterBook::Key key) const {
     auto it = m_signalRowIndexByKey.find(key);
     if (it == m_signalRowIndexByKey.end()) return -1;
     const int row = it.value();
@@ -1848,7 +2335,7 @@ int MainWindow::findRowByKey(const QString& key) const {
     return row;
 }
 
-void MainWindow::removeSignalRowIfExists(const QString& key) {
+void MainWindow::removeSignalRowIfExists(ClusterBook::Key key) {
     const int row = findRowByKey(key);
     if (row >= 0) {
         ui->tableSignals->removeRow(row);
@@ -1856,7 +2343,7 @@ void MainWindow::removeSignalRowIfExists(const QString& key) {
     }
 }
 
-void MainWindow::upsertSignalRow(const QString& key, qint64 expMs,
+void MainWindow::upsertSignalRow(ClusterBook::Key key, qint64 expMs,
     const FlowBurst& snapshot, double residualQty,
     double absDVol, double avgAbsDelta, double notionalUSD)
 {
@@ -1872,8 +2359,9 @@ void MainWindow::upsertSignalRow(const QString& key, qint64 expMs,
     const QString cp = (snapshot.isCall ? "Call" : "Put");
     const QString pat = QString("%1連続（%2）").arg(side, cp);
 
-    const int trades = m_residualTradesByKey.value(key, snapshot.trades);
-    const int uniq = m_residualInstsByKey.value(key, snapshot.instruments).size();
+    const int s = m_clusters.find(key);
+    const int trades = (s >= 0) ? m_clusters.trades(s) : snapshot.trades;
+    const int uniq = (s >= 0) ? m_clusters.instCount(s) : int(snapshot.instruments.size());
 
     const bool wasSorting = ui->tableSignals->isSortingEnabled();
     ui->tableSignals->setSortingEnabled(false);
@@ -1887,12 +2375,13 @@ void MainWindow::upsertSignalRow(const QString& key, qint64 expMs,
 
     // 0: 時刻（初回は startMs、無ければ lastMs。以後は固定）
     {
-        const qint64 lastTsForKey = m_residualLastTsByKey.value(key, snapshot.lastMs);
-        qint64 anchorTs = m_signalAnchorTsByKey.value(key, (snapshot.startMs > 0 ? snapshot.startMs : lastTsForKey));
-        m_signalAnchorTsByKey.insert(key, anchorTs);
+        const qint64 lastTsForKey = (s >= 0) ? m_clusters.lastTs(s) : snapshot.lastMs;
+        qint64 anchorTs = (s >= 0) ? m_clusters.anchorTs(s) : 0;
+        if (anchorTs <= 0) anchorTs = (snapshot.startMs > 0 ? snapshot.startMs : lastTsForKey);
+        if (s >= 0) m_clusters.setAnchorTs(s, anchorTs);
         const QString show = QDateTime::fromMSecsSinceEpoch(anchorTs).toLocalTime().toString("yy/MM/dd HH:mm:ss");
         auto* titem = mkTimeItem(anchorTs, show);
-        titem->setData(Qt::UserRole, key);   // ← クラスタkeyを時刻セルに保持
+        titem->setData(Qt::UserRole, QVariant::fromValue(key));   // ← クラスタkeyを時刻セルに保持
         ui->tableSignals->setItem(row, 0, titem);
 
     }
@@ -1951,8 +2440,8 @@ void MainWindow::onNewTradeForBurst(const TradeEvent& ev) {
     const int bigUnit = currentBigUnit();
     const double fireQty = double(bigUnit) * 5.0;
     const double fireDVol = double(bigUnit) * 2.0;
-    const bool   isCall = isCallFromInst(ev.instrument);
-    const double k = strikeFromInst(ev.instrument);
+    const bool   isCall = isCallFromInst(ev.inst);
+    const double k = strikeFromInst(ev.inst);
     if (k <= 0.0) return;
     if (!isBigTrade(ev.amount)) return;
 
@@ -1985,7 +2474,7 @@ void MainWindow::onNewTradeForBurst(const TradeEvent& ev) {
         b.qtySum = std::abs(ev.amount);
         b.dVolSum = ev.sign * std::abs(ev.amount) * deltaSigned;
         b.trades = 1;
-        b.instruments.insert(ev.instrument);
+        b.instruments.insert(ev.inst);
         m_bursts.push_back(b);
         best = m_bursts.size() - 1;
     }
@@ -1997,7 +2486,7 @@ void MainWindow::onNewTradeForBurst(const TradeEvent& ev) {
         b.qtySum += std::abs(ev.amount);
         b.dVolSum += ev.sign * std::abs(ev.amount) * deltaSigned;
         b.trades += 1;
-        b.instruments.insert(ev.instrument);
+        b.instruments.insert(ev.inst);
     }
 
     const auto& b = m_bursts[best];
@@ -2028,7 +2517,7 @@ void MainWindow::onNewTradeForBurst(const TradeEvent& ev) {
 
 
 void MainWindow::emitSignalRow(const FlowBurst& b, qint64 expMs) {
-    const QString key = makeClusterKey(expMs, b.isCall, b.centerK);
+    const ClusterBook::Key key = makeClusterKey(expMs, b.isCall, b.centerK);
     const auto [qty, dvolNet] = residualForKey(key);
     const double qAbs = std::abs(qty);
     const double absDvol = std::abs(dvolNet);
@@ -2052,20 +2541,18 @@ void MainWindow::rebuildSignalTableFromResidual() {
     const int bigUnit = currentBigUnit();
     const double bigUnitD = double(bigUnit);
 
-    // key 形式: exp|isCall|k
-    const auto keys = m_residualQtyByKey.keys();
-    for (const QString& key : keys) {
-        const QStringList p = key.split('|');
-        if (p.size() != 3) continue;
-        const qint64 expMs = p[0].toLongLong();
+    // 列を先頭から走査（文字列キーの分解はしない）
+    for (int s = 0; s < m_clusters.size(); ++s) {
+        const qint64 expMs = m_clusters.expiryMs(s);
         if (!passSignalFilter(expMs)) continue;
 
-        const double qty = m_residualQtyByKey.value(key, 0.0);
+        const double qty = m_clusters.qty(s);
         if (std::abs(qty) < bigUnit) continue;
 
-        const bool   isCall = (p[1].toInt() == 1);
-        const double k = p[2].toDouble();
-        const double dvolNet = m_residualDVolByKey.value(key, 0.0);
+        const ClusterBook::Key key = m_clusters.key(s);
+        const bool   isCall = m_clusters.isCall(s);
+        const double k = m_clusters.strike(s);
+        const double dvolNet = m_clusters.dVol(s);
         const double qAbs = std::abs(qty);
         const double absDvol = std::abs(dvolNet);
         const double avgAbsDelta = (qAbs > 1e-12 ? absDvol / qAbs : 0.0);
@@ -2073,15 +2560,15 @@ void MainWindow::rebuildSignalTableFromResidual() {
 
         FlowBurst snap;
         snap.startMs = 0; // 履歴からの復元時は不明。表示は lastTs を使う
-        snap.lastMs = m_residualLastTsByKey.value(key, 0ll);
+        snap.lastMs = m_clusters.lastTs(s);
         // ネット残存 qty の符号で「買い/売り」を決める
         snap.isBuy = (qty >= 0.0);
         snap.isCall = isCall;
         snap.centerK = k;
         snap.dVolSum = dvolNet;
         snap.qtySum = qty;
-        snap.trades = m_residualTradesByKey.value(key, 0);
-        snap.instruments = m_residualInstsByKey.value(key);
+        snap.trades = m_clusters.trades(s);
+        m_clusters.forEachInst(s, [&](InstId id) { snap.instruments.insert(id); });
 
         upsertSignalRow(key, expMs, snap, qty, absDvol, avgAbsDelta, notionalUSD);
     }
@@ -2091,7 +2578,7 @@ void MainWindow::rebuildSignalTableFromResidual() {
     ui->tableSignals->sortItems(0, Qt::DescendingOrder);
 }
 // ==== legs: populate detail table for selected cluster key ====
-void MainWindow::populateLegDetailsForKey(const QString& key)
+void MainWindow::populateLegDetailsForKey(ClusterBook::Key key)
 {
     if (!m_tableLegs) return;
 
@@ -2114,7 +2601,7 @@ void MainWindow::populateLegDetailsForKey(const QString& key)
         // 0: 時刻（DisplayRole=QDateTimeでソート安定）
         m_tableLegs->setItem(r, 0, mkTimeItem(lg.ts, show));
         // 1: LinkID（= クラスタkey）
-        m_tableLegs->setItem(r, 1, mkTextItem(lg.linkKey));
+        m_tableLegs->setItem(r, 1, mkTextItem(m_clusters.keyToString(lg.linkKey)));
         // 2: アグレッサ
         QString agtxt = "Unknown";
         switch (lg.aggressor) {
@@ -2161,8 +2648,18 @@ void MainWindow::populateLegDetailsForKey(const QString& key)
         m_tableLegs->setItem(r, 16, mkNumItem(lg.mid, 6));
         // 17: 乖離(bp)
         m_tableLegs->setItem(r, 17, mkNumItem(lg.bpDiffBp, 1));
-        // 18: OrderID
-        m_tableLegs->setItem(r, 18, mkTextItem(lg.orderId));
+        // 18: 板中央(厚み)
+        m_tableLegs->setItem(r, 18, mkNumItem(lg.depthMid, 6));
+        // 19: 滑り(bp)
+        m_tableLegs->setItem(r, 19, mkNumItem(lg.slipBp, 1));
+        // 20: 食い段数
+        m_tableLegs->setItem(r, 20, mkNumItem(lg.levelsHit, 0));
+        // 21: Mark
+        m_tableLegs->setItem(r, 21, mkNumItem(lg.markPrice, 6));
+        // 22: Index
+        m_tableLegs->setItem(r, 22, mkNumItem(lg.indexPrice, 2));
+        // 23: OrderID
+        m_tableLegs->setItem(r, 23, mkTextItem(lg.orderId));
 
         ++r;
     }
@@ -2177,10 +2674,12 @@ void MainWindow::updatePinMapTable()
     if (!tbl) return;
     if (m_underlyingPx <= 0.0) return;
 
-    // モデル構築
+    // モデル構築（pin_map 側は文字列キーのまま）
+    QHash<QString, double> qtyByKey, dvolByKey;
+    residualStringMaps(&qtyByKey, &dvolByKey, nullptr);
     const auto rows = buildPinMap(
-        m_residualQtyByKey,
-        m_residualDVolByKey,
+        qtyByKey,
+        dvolByKey,
         m_underlyingPx,
         &m_oi,
         K_BUCKET
@@ -2221,29 +2720,72 @@ void MainWindow::updatePinMapTable()
     tbl->setSortingEnabled(true);
 }
 
+void MainWindow::residualStringMaps(QHash<QString, double>* qty, QHash<QString, double>* dvol,
+    QHash<QString, QSet<QString>>* insts) const
+{
+    // pin_map / curves は "exp|isCall|k" キーの QHash を受け取るので、ここでだけ組み立てる
+    const int n = m_clusters.size();
+    if (qty) qty->reserve(n);
+    if (dvol) dvol->reserve(n);
+    if (insts) insts->reserve(n);
+    for (int s = 0; s < n; ++s) {
+        const QString key = m_clusters.keyToString(m_clusters.key(s));
+        if (qty) qty->insert(key, m_clusters.qty(s));
+        if (dvol) dvol->insert(key, m_clusters.dVol(s));
+        if (insts) {
+            QSet<QString>& names = (*insts)[key];
+            m_clusters.forEachInst(s, [&](InstId id) { if (m_reg.valid(id)) names.insert(m_reg.name(id)); });
+        }
+    }
+}
+
+// クラスタ1つぶんのカーブ入力（IV は参加銘柄の mark_iv の平均）
+CurveEngine::ClusterInput MainWindow::curveInputOf(int s) const {
+    CurveEngine::ClusterInput in;
+    in.expiryMs = m_clusters.expiryMs(s);
+    in.isCall = m_clusters.isCall(s);
+    in.strike = m_clusters.strike(s);
+    in.qty = m_clusters.qty(s);
+
+    double ivSum = 0.0;
+    int    ivN = 0;
+    m_clusters.forEachInst(s, [&](InstId id) {
+        const double iv = lastIVOf(id);
+        if (iv > 0.0) { ivSum += iv; ++ivN; }
+        });
+    in.ivPct = (ivN > 0) ? ivSum / ivN : 0.0;
+    return in;
+}
+
+// 参照価格が動いた・エポックを過ぎた・IV が入れ替わった時だけ全クラスタ、それ以外は約定で動いた slot だけ
+void MainWindow::refreshCurveEngine() {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (m_curveRebuild || m_curveEngine.epochStale(m_underlyingPx, now)) {
+        m_curveEngine.beginEpoch(m_underlyingPx, now);
+        for (int s = 0; s < m_clusters.size(); ++s) m_curveEngine.set(s, curveInputOf(s));
+        m_curveRebuild = false;
+    }
+    else {
+        for (int s : std::as_const(m_curveDirtySlots)) m_curveEngine.set(s, curveInputOf(s));
+    }
+    m_curveDirtySlots.clear();
+}
+
+void MainWindow::updateCurves() {
+    if (m_underlyingPx <= 0.0) return;
+    refreshCurveEngine();
+    updateCurvesTables();
+    updateCurvesCharts();
+}
+
 void MainWindow::updateCurvesTables()
 {
     auto* tblG = findChild<QTableWidget*>("tableGexCurve");
     auto* tblV = findChild<QTableWidget*>("tableVannaCurve");
     auto* tblC = findChild<QTableWidget*>("tableCharmCurve");
     if (!tblG || !tblV || !tblC) return;
-    if (m_underlyingPx <= 0.0) return;
 
-    const qint64 now = QDateTime::currentMSecsSinceEpoch();
-
-    // IV 取得関数（クラスタ内の代表銘柄に対する mark_iv）
-    auto ivGetter = [this](const QString& inst) -> double {
-        auto it = m_lastIV.find(inst);
-        return (it != m_lastIV.end() ? it.value() : 0.0);
-        };
-
-    const auto rows = buildGreeksCurves(
-        m_residualQtyByKey,
-        m_residualInstsByKey,
-        m_underlyingPx,
-        now,
-        ivGetter
-    );
+    const auto& rows = m_curveEngine.rows();
 
     const qint64 fexp = displayExpiryFilterMs(); // 0=All
 
@@ -2286,24 +2828,15 @@ void MainWindow::updateCurvesTables()
         // tbl->sortItems(1, Qt::DescendingOrder);
         };
 
-    refresh(tblG, [](const CurveRow& x) { return x.netGamma; }, "GEX");
-    refresh(tblV, [](const CurveRow& x) { return x.netVanna; }, "Vanna");
-    refresh(tblC, [](const CurveRow& x) { return x.netCharm; }, "Charm");
+    refresh(tblG, [](const CurveEngine::Row& x) { return x.netGamma; }, "GEX");
+    refresh(tblV, [](const CurveEngine::Row& x) { return x.netVanna; }, "Vanna");
+    refresh(tblC, [](const CurveEngine::Row& x) { return x.netCharm; }, "Charm");
 }
 
 
 void MainWindow::updateCurvesCharts() {
     const qint64 now = QDateTime::currentMSecsSinceEpoch();
-    const auto rows = buildGreeksCurves(
-        m_residualQtyByKey,
-        m_residualInstsByKey,
-        m_underlyingPx,
-        now,
-        [this](const QString& inst) {
-            auto it = m_lastIV.find(inst);
-            return (it != m_lastIV.end() ? it.value() : 0.0);
-        }
-    );
+    const auto& rows = m_curveEngine.rows();
 
     const qint64 fexp = displayExpiryFilterMs(); // 0=All
 
@@ -2335,12 +2868,12 @@ void MainWindow::updateCurvesCharts() {
     }
 }
 
-void MainWindow::requestOIAll()
+void MainWindow::requestMarketSnapshot()
 {
-    // Instruments 未取得ならスキップ
-    if (m_instruments.isEmpty()) return;
+    // Instruments 未取得ならスキップ。前回分が戻る前は重ねない
+    if (m_instruments.isEmpty() || m_snapInflight) return;
 
-    // Deribit: 全BTCオプションの book summary を一括取得（open_interest を含む）
+    // Deribit: 全BTCオプションの book summary を一括取得（mark_iv / bid / ask / open_interest を含む）
     QUrl url("https://www.deribit.com/api/v2/public/get_book_summary_by_currency");
     QUrlQuery q;
     q.addQueryItem("currency", "BTC");
@@ -2348,16 +2881,14 @@ void MainWindow::requestOIAll()
     q.addQueryItem("expired", "false");
     url.setQuery(q);
 
-    QNetworkRequest req(url);
-    QNetworkReply* rep = m_net.get(req);
-    connect(rep, &QNetworkReply::finished, this, [this, rep] {
-        const QByteArray bytes = rep->readAll();
-        rep->deleteLater();
-        handleOIReply(bytes);
+    m_snapInflight = true;
+    m_sched->submit(RequestScheduler::Priority::LiveCritical, url, [this](const RequestScheduler::Reply& rp) {
+        m_snapInflight = false;
+        handleMarketSnapshot(rp.body);
         });
 }
 
-void MainWindow::handleOIReply(const QByteArray& bytes)
+void MainWindow::handleMarketSnapshot(const QByteArray& bytes)
 {
     QJsonDocument doc = QJsonDocument::fromJson(bytes);
     if (!doc.isObject()) return;
@@ -2365,69 +2896,112 @@ void MainWindow::handleOIReply(const QByteArray& bytes)
     const QJsonArray arr = root.value("result").toArray();
     if (arr.isEmpty()) return;
 
-    int setCnt = 0;
+    resizeInstStores();
+    const qint64 stamp = QDateTime::currentMSecsSinceEpoch();
+
+    int oiCnt = 0, ivCnt = 0;
     for (const auto& v : arr) {
         if (!v.isObject()) continue;
         const auto o = v.toObject();
 
-        const QString inst = o.value("instrument_name").toString();
-        if (inst.isEmpty()) continue;
+        const InstId id = m_reg.find(o.value("instrument_name").toString());
+        if (id == INVALID_INST) continue;
+        m_snapSeenMs[int(id)] = stamp;
 
-        const double oi = o.value("open_interest").toDouble(); // 0可
+        // IV（mark_iv は % 表記。0/欠損は据え置き）
+        const double mkiv = o.value("mark_iv").toDouble();
+        if (mkiv > 0.0) { m_lastIV[int(id)] = mkiv; ++ivCnt; }
+
+        // NBBO（片側しか無いときは update 側で弾かれる）
+        const qint64 quoteTs = qint64(o.value("creation_timestamp").toDouble());
+        m_nbbo.update(id, quoteTs > 0 ? quoteTs : stamp, o.value("bid_price").toDouble(), o.value("ask_price").toDouble());
 
-        const qint64 expMs2 = expiryFromInst(inst);
-        const double k = strikeFromInst(inst);
-        const bool  isCall = isCallFromInst(inst);
+        // OI
+        const double oi = o.value("open_interest").toDouble(); // 0可
+        const qint64 expMs2 = expiryFromInst(id);
+        const double k = strikeFromInst(id);
+        const bool  isCall = isCallFromInst(id);
         if (expMs2 <= 0 || k <= 0.0) continue;
 
         m_oi.setOI(expMs2, k, isCall, oi);
-        ++setCnt;
+        ++oiCnt;
+    }
+    m_lastMarketSnapMs = stamp;
+
+    // 載らなかった生存銘柄だけ ticker で補う
+    for (int i = 0; i < m_reg.size(); ++i) {
+        const InstId id = InstId(i);
+        if (m_reg.isActive(id) && m_snapSeenMs[i] != stamp) queueIV(id);
     }
 
-    if (setCnt > 0) updatePinMapTable();
+    if (oiCnt > 0) m_dirty.pinMap = true;
+    if (ivCnt > 0) { m_dirty.curves = true; m_curveRebuild = true; }
 }
 
-void MainWindow::queueIV(const QString& inst)
+void MainWindow::resizeInstStores()
+{
+    // 銘柄表は追記のみなので、伸ばすだけで既存IDの値は保たれる
+    const int n = m_reg.size();
+    if (m_lastDelta.size() < n) m_lastDelta.resize(n, 0.0);
+    if (m_lastIV.size() < n)    m_lastIV.resize(n, 0.0);
+    if (m_ivQueued.size() < n)  m_ivQueued.resize(n, quint8(0));
+    if (m_snapSeenMs.size() < n) m_snapSeenMs.resize(n, 0);
+    for (int i = int(m_storeNameId.size()); i < n; ++i)
+        m_storeNameId.push_back(m_store.nameId(m_reg.name(InstId(i))));
+    m_dedup.resize(n);
+}
+
+quint32 MainWindow::storeNameIdOf(InstId id, const char* name, int len)
 {
-    if (inst.isEmpty()) return;
-    if (m_lastIV.value(inst, 0.0) > 0.0) return; // 既に保持
-    if (m_ivQueued.contains(inst)) return;       // 去重
-    m_ivQueued.insert(inst);
-    m_ivQueue.enqueue(inst);
+    if (id < InstId(m_storeNameId.size())) return m_storeNameId[int(id)];
+    return m_store.nameId(QString::fromLatin1(name, len));
 }
 
-void MainWindow::pumpIV()
+void MainWindow::queueIV(InstId id)
 {
-    if (m_ivInflight > 0) return;
-    if (m_ivQueue.isEmpty()) return;
+    if (!m_reg.valid(id)) return;
+    if (lastIVOf(id) > 0.0) return;              // 既に保持
+    if (id >= InstId(m_ivQueued.size())) resizeInstStores();
+    // 初回スナップショット前、または直近のスナップショットに載っていた銘柄は次の一括更新に任せる
+    if (m_lastMarketSnapMs == 0 || m_snapSeenMs[int(id)] == m_lastMarketSnapMs) return;
+    if (m_ivQueued[int(id)]) return;             // 去重
+    m_ivQueued[int(id)] = 1;
+    m_ivQueue.enqueue(id);
+}
 
-    const QString inst = m_ivQueue.dequeue();
-    QUrl url("https://www.deribit.com/api/v2/public/ticker");
-    QUrlQuery q; q.addQueryItem("instrument_name", inst); url.setQuery(q);
+void MainWindow::pumpIV()
+{
+    while (m_ivInflight < IV_MAX_INFLIGHT) {
+        // 待っている間にスナップショットで埋まった分は飛ばす
+        while (!m_ivQueue.isEmpty() && lastIVOf(m_ivQueue.head()) > 0.0)
+            m_ivQueued[int(m_ivQueue.dequeue())] = 0;
+        if (m_ivQueue.isEmpty()) return;
 
-    QNetworkRequest req(url);
-    QNetworkReply* rep = m_net.get(req);
-    m_ivInflight = 1;
-    rep->setProperty("inst", inst);
+        const InstId id = m_ivQueue.dequeue();
+        requestIVFor(id);
+    }
+}
 
-    connect(rep, &QNetworkReply::finished, this, [this, rep] {
-        const QString inst = rep->property("inst").toString();
-        const QByteArray bytes = rep->readAll();
-        rep->deleteLater();
+void MainWindow::requestIVFor(InstId id)
+{
+    QUrl url("https://www.deribit.com/api/v2/public/ticker");
+    QUrlQuery q; q.addQueryItem("instrument_name", m_reg.name(id)); url.setQuery(q);
 
-        QJsonDocument doc = QJsonDocument::fromJson(bytes);
-        if (doc.isObject()) {
+    ++m_ivInflight;
+    m_sched->submit(RequestScheduler::Priority::LiveCritical, url, [this, id](const RequestScheduler::Reply& rp) {
+        QJsonDocument doc = QJsonDocument::fromJson(rp.body);
+        if (doc.isObject() && id < InstId(m_lastIV.size())) {
             const QJsonObject res = doc.object().value("result").toObject();
             const double mkiv = res.value("mark_iv").toDouble();
             if (mkiv > 0.0) {
-                m_lastIV[inst] = mkiv;
+                m_lastIV[int(id)] = mkiv;
             }
             else {
                 const QJsonObject greeks = res.value("greeks").toObject();
                 const double alt = greeks.value("iv").toDouble();
-                if (alt > 0.0) m_lastIV[inst] = alt;
+                if (alt > 0.0) m_lastIV[int(id)] = alt;
             }
         }
-        m_ivInflight = 0;
+        m_ivInflight = std::max(0, m_ivInflight - 1);
         });
 }
@@ -16,14 +16,31 @@
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QQueue>
+#include <QThreadPool>
 #include <deque>
+#include <memory>
 #include "oi_store.h"
 #include "pin_map.h"
 #include "nbbo_store.h"
+#include "order_book.h"
+#include "spot_state.h"
+#include "curve_engine.h"
 #include "curves.h"
 #include "CurvesChartPane.h"
+#include "deribit_parser.h"
+#include "instrument_registry.h"
+#include "cluster_book.h"
+#include "sliding_quantile.h"
+#include "time_wheel.h"
+#include "tiered_series.h"
+#include "request_scheduler.h"
+#include "trade_store.h"
+#include "trade_dedup.h"
+#include "history_decoder.h"
+#include "trade_journal.h"
 
 class WebSocketClient;
+class IngestEngine;
 class QTableWidget;
 
 QT_BEGIN_NAMESPACE
@@ -36,7 +53,7 @@ static constexpr int     FIVE_MIN_MS = 5 * 60 * 1000;
 static constexpr qint64  HOUR_MS = 60ll * 60 * 1000;
 static constexpr qint64  DAY_MS = 24ll * 60 * 60 * 1000;
 
-static constexpr int     AUTO_MAX_INFLIGHT = 8;     // 自動バックフィル同時実行
+static constexpr int     IV_MAX_INFLIGHT = 4;       // ticker 補完の同時実行（送出間隔はスケジューラ任せ）
 
 // バースト検出・重複抑制
 static constexpr int     BURST_WINDOW_MS = 6 * 1000;    // 連続判定窓
@@ -49,13 +66,12 @@ struct TradeEvent {
     double  amount{};        // 枚数
     double  delta{};         // その時のΔ
     int     sign{};          // +1=buy, -1=sell
-    QString instrument;      // 銘柄
+    InstId  inst{ INVALID_INST };  // 銘柄
 };
 
-struct MiniEv {
-    qint64 ts{};
-    double qty{};            // 枚数(>0)
-    double dvol{};           // Δ加重出来高（参考）
+// 満期ごとの出来高（段階保持。1h は生データ、24h は分足、全期間は合計から読む）
+struct ExpiryActivity {
+    TieredSeries history;    // 生1h / 分足24h / 時間足365日
 };
 
 struct FlowBurst {
@@ -67,13 +83,34 @@ struct FlowBurst {
     double qtySum{};
     double dVolSum{};
     int    trades{};
-    QSet<QString> instruments;
+    QSet<InstId> instruments;
+};
+
+// 描画の間引き：約定ごとの変更を溜め、表示フレームごとに1回だけ反映する
+struct UiDirty {
+    QSet<ClusterBook::Key> clusterKeys;   // シグナル表で数値を差し替える行
+    QSet<qint64>  expiries;        // 満期アクティビティで差し替える行
+    bool signalsRebuild{};         // シグナル表の全再構築
+    bool expiryAll{};              // 満期アクティビティの全再構築
+    bool pinMap{};
+    bool curves{};
+    QStringList tapeLines;         // ログ追記（1回の appendPlainText にまとめる）
+
+    void markAllViews() { signalsRebuild = expiryAll = pinMap = curves = true; }
+    bool any() const {
+        return signalsRebuild || expiryAll || pinMap || curves
+            || !clusterKeys.isEmpty() || !expiries.isEmpty() || !tapeLines.isEmpty();
+    }
+    void clear() {
+        clusterKeys.clear(); expiries.clear(); tapeLines.clear();
+        signalsRebuild = expiryAll = pinMap = curves = false;
+    }
 };
 
 // ★第三弾：レッグ明細1件（NBBO/Aggressor対応）
 struct LegDetail {
     qint64  ts{};
-    QString linkKey;     // クラスタkey（exp|isCall|kRound）
+    ClusterBook::Key linkKey{ ClusterBook::INVALID_KEY };   // クラスタkey
     QString inst;
     int     sign{};      // +1/-1
     double  amount{};    // >0で保存
@@ -94,6 +131,13 @@ struct LegDetail {
     double nbboAsk{};
     double mid{};
     double bpDiffBp{}; // (price-mid)/mid*10000
+    double markPrice{};  // 約定時点の mark_price（payload に無ければ 0）
+    double indexPrice{}; // 約定時点の index_price（無ければ参照価格）
+
+    // 板の厚み（L2 購読中の銘柄のみ。約定処理時点の板で、バックフィル分は 0）
+    double depthMid{};   // 約定枚数ぶん両側に当てた VWAP の中央
+    double slipBp{};     // 約定枚数を最良から食った時の不利幅
+    int    levelsHit{};  // 食い切った段数
 
     // 任意
     double  tradeIV{};      // 取得できれば
@@ -113,11 +157,20 @@ public:
 private: // ===== UI =====
     void hookUiActions();
     void refreshWatchList();
+    void flushUiFrame();                     // m_dirty を1フレームぶんまとめて反映
 
 private: // ===== WS / RPC =====
     void bootstrapAuto();
-    void onRpc(int id, const QJsonObject& reply);
+    void requestInstruments();               // 応答は onInstruments へ
+    void requestPerpTicker();                // 応答は onPerpTicker へ
+    void onInstruments(const QJsonArray& list);
+    void onPerpTicker(const QJsonObject& res);
+    void onSpot(double px, qint64 ts);       // 指数の更新（確定値が動いた時だけ依存先を dirty に）
+    void subscribeWhenReady();               // 銘柄と参照価格が揃ったら期近を購読
     void handleDeribitMsg(const QJsonObject& obj);
+    void handleBookMsg(const QString& channel, const QJsonObject& d);
+    void handleTrades(const std::vector<RawTrade>& trades, bool isGlobal);
+    void drainIngest();                      // エンジンのキューを取り出して反映
 
 private: // ===== 銘柄・購読 =====
     void   populateExpiryChoices();          // 先頭に「All」を入れる
@@ -132,7 +185,10 @@ private slots:
 private:
     void prefetchTickersForTargets();
     void requestTickerFor(const QString& inst);
-    void requestBackfillFor(const QString& inst, qint64 fromMs, qint64 toMs);
+    static constexpr int BACKFILL_RETRY_MAX = 3;          // 通信エラーの出し直し（1s, 2s, 4s 待ち）
+    void requestBackfillFor(const QString& inst, qint64 fromMs, qint64 toMs, int attempt = 0);
+    void applyBackfillFor(const QString& inst, const HistoryBatch& b);
+    void finishBackfillFor();                             // 1銘柄ぶん終わった（全部済めばサマリ更新）
 
 private: // ===== 集計 =====
     bool   isBigTrade(double amount) const;   // 単発が閾値以上か？
@@ -141,71 +197,101 @@ private: // ===== 集計 =====
     double sumDeltaVolume(qint64 nowMs, int windowMs) const;
 
 private: // ===== 満期アクティビティ =====
-    qint64 expiryFromInst(const QString& inst) const;
-    void   recordExpiryEvent(const QString& inst, qint64 ts, double amount, int sign, double delta);
+    qint64 expiryFromInst(InstId id) const;   // 非生存・未登録は0
+    void   recordExpiryEvent(InstId id, qint64 ts, double amount, int sign, double delta);
+    struct ActivityTotals { double all{}, d24{}, h1{}; };
+    ActivityTotals expiryActivityTotals(qint64 exp, qint64 now);
     void   updateExpiryActivityTable();
-    bool   alreadySeenTrade(const QString& tradeId, qint64 ts);
+    void   updateExpiryActivityRows(const QSet<qint64>& exps);
 
 private: // ===== シグナル =====
-    bool   isCallFromInst(const QString& inst);
-    double strikeFromInst(const QString& inst);
+    bool   isCallFromInst(InstId id) const;
+    double strikeFromInst(InstId id) const;
     void   onNewTradeForBurst(const TradeEvent& ev);
 
     void   emitSignalRow(const FlowBurst& b, qint64 expMs);
-    void   upsertSignalRow(const QString& key, qint64 expMs,
+    void   upsertSignalRow(ClusterBook::Key key, qint64 expMs,
         const FlowBurst& snapshot, double residualQty,
         double absDVol, double avgAbsDelta, double notionalUSD);
 
-    void   removeSignalRowIfExists(const QString& key);
-    int    findRowByKey(const QString& key) const;
+    void   refreshSignalRow(ClusterBook::Key key);   // 既存行の数値セルのみ更新
+    void   removeSignalRowIfExists(ClusterBook::Key key);
+    int    findRowByKey(ClusterBook::Key key) const;
 
     // 一括再構築（初回/フィルタ変更時）
     void   rebuildSignalTableFromResidual();
 
-    struct AmtSample { qint64 ts; double absAmt; };
-    QList<AmtSample> m_amtSamples;        // 直近24hの全約定サンプル
+    SlidingQuantile m_amtSketch;          // 直近24hの約定枚数分布（5分バケット）
+    int  m_autoBigUnit{ 50 };             // Auto 閾値（枚、初期値は AUTO_FLOOR）。UI 1秒更新で引き直す
     void pushAmtSample(qint64 ts, double absAmt);
-    void pruneAmtSamples(qint64 now);
+    void refreshAutoBigUnit(qint64 now);  // スケッチを進めて分位点から Auto 閾値を決める
     int  currentBigUnit() const;          // ← ここを宣言（実装はcpp）
 
-private: // ===== 自動バックフィル =====
-    // 従来の“全期間バックフィル”（スナップショットが無い初回のみ使う）
-    void  autoBackfillAllExpiriesInit();
-    void  autoBackfillPump();
-    void  requestBackfillAuto(const QString& inst, qint64 fromMs, qint64 toMs);
-    QList<QString> m_autoBackfillQueue;
-    int     m_autoInflight{ 0 };
-    qint64  m_autoBackFromMs{ 0 }, m_autoBackToMs{ 0 };
-    bool    m_autoBackfillDone{ false };
+private: // ===== REST 送出（優先度・クレジット・同時実行数はここで一括管理）=====
+    RequestScheduler* m_sched{ nullptr };
+    HistoryDecoder*   m_decoder{ nullptr };
+    void  applyHistoryBatch(const std::vector<RawTrade>& trades);
+
+private: // ===== ローカル約定ストア（取得済み区間は再起動後もディスクから）=====
+    TradeStore m_store;
+    qint64  m_liveSinceMs{ 0 };           // 全体購読の受信開始（接続ごとにリセット）
+    qint64  m_liveLastMs{ 0 };            // 最後にフレームを受けた時刻
+    int     m_storeTick{ 0 };
+    void    syncTradeStore();             // 受信済み区間をカバレッジへ＋書き出し
+    void    backfillDisconnectGap(qint64 fromMs, qint64 toMs);   // WS 切断中に欠けた区間だけ取り直す
+    double  m_wsRttMs{ -1.0 };            // public/test の往復（未計測・切断中は負）
+    qint64  replayStoredTrades(qint64 fromMs, qint64 toMs);
 
 private: // ===== 差分バックフィル（前回スナップショット → 現在）=====
     void  autoBackfillDeltaInit();
-    void  autoBackfillDeltaPump();
+    void  autoBackfillDeltaTaskDone();
     void  requestBackfillDelta(const QString& inst, qint64 fromMs, qint64 toMs);
-    QList<QString> m_deltaQueue;
-    int     m_deltaInflight{ 0 };
+    void  startDeltaGaps();                            // m_deltaGaps の残りを順に取る
+    void  requestDeltaCurrencyPage(qint64 fromMs);     // 通貨まとめ取り（既定）
+    void  applyDeltaCurrencyPage(qint64 fromMs, qint64 toMs, const HistoryBatch& b);
+    void  deltaCurrencyPageFailed(qint64 fromMs, const QString& why);
+    void  requestDeltaEdgePage();                      // 1ms に1ページを超えた分を trade_id 順で
+    void  applyDeltaEdgePage(const HistoryBatch& b);
+    void  ingestHistoryTrade(const RawTrade& t);   // 重複判定＋ストアへ追記＋取り込み
+    void  ingestHistory(InstId id, qint64 ts, double amt, int sign, double px, qint64 seq, double iv = 0.0);
+    int     m_deltaPending{ 0 };          // 未完了の銘柄数（待ち＋実行中。通貨まとめ取りは1本）
+    int     m_deltaPages{ 0 };
+    int     m_deltaRetries{ 0 };
+    qint64  m_deltaEdgeTs{ -1 };          // 前ページ末尾の ms
+    QSet<quint64> m_deltaEdgeIds;         // その ms の trade_id（ページ境界の重複除け）
+    quint64 m_deltaEdgeMaxId{ 0 };        // その ms で見た最大の trade_id（trade_id 順ページの起点）
+    QString m_deltaEdgeMaxIdText;
     qint64  m_deltaFromMs{ 0 }, m_deltaToMs{ 0 };
+    QVector<QPair<qint64, qint64>> m_deltaGaps;   // ストアに無い区間（通貨まとめ取りで順に埋める）
+    int     m_deltaGapIdx{ 0 };
     bool    m_deltaDone{ false };
 
 private: // ===== フルバックフィル（生存満期・全期間）=====
-    struct FullTask { QString inst; qint64 fromMs; qint64 toMs; qint64 stepMs; };
-    std::deque<FullTask> m_fullQueue;
-    int   m_fullInflight{ 0 };
+    // 銘柄ごとに startSeq から SEQ_PAGE 件ずつ trade_seq 順に取る（重なり・抜け無し）
+    static constexpr int SEQ_PAGE = 1000;
+    static constexpr int FULL_RETRY_MAX = 5;             // 通信エラーの再試行（銘柄ごと、成功で戻す）
+    static constexpr int FULL_RETRY_BASE_MS = 2000;      // 待ちは 2s, 4s, 8s ... と倍々
+    struct FullTask { QString inst; qint64 startSeq; };
+    int   m_fullPending{ 0 };             // 未完了のページ数（待ち＋実行中）
     bool  m_fullDone{ false };
+    int   m_fullPagesSinceStore{ 0 };
+    QHash<QString, qint64> m_seqCursor;   // 銘柄名 → 次に取る trade_seq（QSettings に保存）
+    QHash<QString, int>    m_fullRetries; // 銘柄名 → 続けて失敗した回数
 
     void  fullBackfillLiveExpiriesInit();
-    void  fullBackfillPump();
-    void  requestBackfillWindow(const QString& inst, qint64 fromMs, qint64 toMs, qint64 stepMs);
+    void  fullBackfillTaskDone();
+    void  requestBackfillSeq(const FullTask& t, bool front);
+    void  applySeqPage(const FullTask& t, qint64 endSeq, const HistoryBatch& b, const QByteArray& body);
 
 private: // ===== 残存推定（=オフライン清算反映）=====
-    QString makeClusterKey(qint64 expMs, bool isCall, double strike) const;
+    ClusterBook::Key makeClusterKey(qint64 expMs, bool isCall, double strike);
 
     // ★第三弾：price を渡せるように引数追加
-    void    applyTradeToResidual(const QString& inst, qint64 ts,
+    void    applyTradeToResidual(InstId id, qint64 ts,
         double amount, int sign, double delta,
-        double tradePx = 0.0);
+        double tradePx = 0.0, qint64 tradeSeq = 0);
 
-    QPair<double, double> residualForKey(const QString& key) const;
+    QPair<double, double> residualForKey(ClusterBook::Key key) const;
     bool    passSignalFilter(qint64 expMs) const;
 
 private:
@@ -218,39 +304,63 @@ private:
 
 private: // ===== 状態スナップショット =====
     bool  loadSnapshot();        // 復元（あれば即座にUIへ反映）
-    void  saveSnapshot() const;  // 保存（終了時）
+    bool  loadSnapshotFile(const QString& path);   // バイナリ（既定）
+    bool  loadSnapshotJson();                      // 旧形式（QSettings）からの引き継ぎ
+    bool  saveSnapshot(quint64 journalGen) const;  // 保存（終了時。journalGen 以降のジャーナルと対）
     qint64 m_lastSnapshotTs{ 0 };  // 前回保存時刻(ms)
+    quint64 m_snapJournalGen{ 0 }; // 読んだスナップショットが対になるジャーナル世代
+
+private: // ===== 残存のジャーナル＋定期チェックポイント（異常終了でも直前まで戻す）=====
+    TradeJournal m_journal;
+    QTimer       m_ckptTimer;
+    QThreadPool  m_ckptPool;              // スナップショットの組み立て・書き出し（1本）
+    bool         m_ckptBusy{ false };
+    bool         m_stateLive{ false };    // 復元が済んだ（それまでは保存しない）
+    void   checkpointAsync();
+    qint64 replayJournal(quint64 fromGen);
 
 protected:
     void closeEvent(QCloseEvent* e) override;  // 終了時に保存
 
 private: // ===== メンバ =====
     Ui::MainWindow* ui{ nullptr };
-    WebSocketClient* m_ws{ nullptr };
+    IngestEngine*    m_engine{ nullptr };  // WS 受信・解析スレッド
+    WebSocketClient* m_ws{ nullptr };      // m_engine 所有（エンジンスレッド上）
     QTimer           m_uiTick;
+    QTimer           m_frameTimer;          // 描画フレーム（UiDirty を反映）
+    UiDirty          m_dirty;
 
     // 価格・銘柄
-    double     m_underlyingPx{ 0.0 };
+    double     m_underlyingPx{ 0.0 };    // 参照価格＝m_spot の確定値（閾値を超えて動いた時だけ進む）
+    SpotState  m_spot;
     qint64     m_nearestExpiryMs{ 0 };
     bool       m_subscribedOnce{ false };
     QJsonArray m_instruments;
+    InstrumentRegistry m_reg;          // 銘柄名 → InstId と属性（GUI スレッド側の正本）
     QStringList m_targetInstruments;
     QStringList m_channels;
+    bool        m_bookDepth{ true };   // 購読銘柄の L2 板（book.*.100ms）も取る
+
+    // ギリシャ・IV（InstId で引く。サイズは m_reg に合わせる）
+    QVector<double> m_lastDelta;        // id → delta
+    QVector<double> m_lastIV;           // id → iv
+    double lastDeltaOf(InstId id) const { return id < InstId(m_lastDelta.size()) ? m_lastDelta[int(id)] : 0.0; }
+    double lastIVOf(InstId id)    const { return id < InstId(m_lastIV.size()) ? m_lastIV[int(id)] : 0.0; }
+    void   resizeInstStores();         // 銘柄表の拡張に追従
 
-    // ギリシャ・IV
-    QHash<QString, double> m_lastDelta; // inst → delta
-    QHash<QString, double> m_lastIV;    // inst → iv
+    // InstId → 約定ストアの名前表番号（銘柄の登録時に1回だけ引く）
+    QVector<quint32> m_storeNameId;
+    quint32 storeNameIdOf(InstId id, const char* name, int len);   // 表に無い銘柄だけ名前で引く
+    quint32 storeNameIdOf(InstId id) { return id < InstId(m_storeNameId.size()) ? m_storeNameId[int(id)] : m_store.nameId(m_reg.name(id)); }
 
-    // スカッシュ用イベント
-    QVector<TradeEvent> m_events;
+    // 短期Δ出来高（1秒バケット×5分、1m/5m の走行和）
+    TimeWheel m_dVolWheel{ 1000, FIVE_MIN_MS / 1000 };
 
     // 満期アクティビティ
-    QHash<qint64, QVector<MiniEv>> m_expiryEvents;    // expiryMs → events
-    QHash<QString, qint64>         m_instToExpiryMs;  // inst → expiryMs
+    QHash<qint64, ExpiryActivity>  m_expiryActivity;  // expiryMs → 窓集計
 
-    // 二重受信防止
-    QSet<QString>                    m_seenTradeIds;
-    QVector<QPair<qint64, QString>>  m_seenTradeQueue; // (ts, id)
+    // 二重取り込み防止（ライブ・各バックフィル・ストア再生で共有）
+    TradeDedup                       m_dedup;
 
     // シグナル重複抑制
     QSet<QString>                    m_signalKeys;
@@ -264,47 +374,38 @@ private: // ===== メンバ =====
     int    m_pendingTickers{ 0 };
     int    m_backfillPending{ 0 };
 
-    // RPC id
-    int m_idGetInstruments{ 0 };
-    int m_idPerpTicker{ 0 };
-
     // REST
     QNetworkAccessManager m_net;
-    QTimer                m_oiTimer;         // 定期OI更新（軽め）
-    QTimer                m_ivTimer;         // IVポンピング（200msごとに1件）
-    QSet<QString>         m_ivQueued;        // 既にキューイン済みの去重用
-    QQueue<QString>       m_ivQueue;         // リクエスト待ち行列
-    int                   m_ivInflight{ 0 };   // 同時実行数（控えめに1）
+    QTimer                m_snapTimer;       // 一括スナップショット（IV/NBBO/OI、間隔は設定）
+    bool                  m_snapInflight{ false };
+    qint64                m_lastMarketSnapMs{ 0 };  // 最後に受け取ったスナップショットの時刻
+    QVector<qint64>       m_snapSeenMs;      // id → その銘柄が載っていたスナップショットの時刻
+    QTimer                m_ivTimer;         // 取りこぼし銘柄の ticker 補完（200msごとに補充）
+    QVector<quint8>       m_ivQueued;        // id → キューイン済み（去重用）
+    QQueue<InstId>        m_ivQueue;         // リクエスト待ち行列
+    int                   m_ivInflight{ 0 };   // 同時実行数（上限 IV_MAX_INFLIGHT）
 
     // 満期アクティビティのソート保持（1=全期間, 2=24h, 3=1h）
     int           m_expActSortCol{ 1 };
     Qt::SortOrder m_expActSortOrder{ Qt::DescendingOrder };
 
-    // 残存推定：クラスターごとの残枚数・Δ加重
-    QHash<QString, double> m_residualQtyByKey;   // key → 残枚数
-    QHash<QString, double> m_residualDVolByKey;  // key → 残Δ加重
-    // 買い(+)/売り(-)をそのまま合算した“符号付き枚数”
-    QHash<QString, double> m_residualSignedQtyByKey;
-
-    // 追加：クラスタの最終時刻・件数・ユニーク銘柄
-    QHash<QString, qint64>         m_residualLastTsByKey;  // key → 最終約定時刻(ms)
-    QHash<QString, int>            m_residualTradesByKey;  // key → 件数
-    QHash<QString, QSet<QString>>  m_residualInstsByKey;   // key → 参加銘柄セット
-
-    // 仕込み時刻（アンカー）: シグナル行ごとに固定
-    QHash<QString, qint64> m_signalAnchorTsByKey;  // key → anchorMs
+    // 残存推定：クラスター（満期×CP×行使バケット）ごとの残枚数・Δ加重・件数・参加銘柄・アンカー
+    ClusterBook m_clusters;
+    // pin_map / curves 向けに "exp|isCall|k" キーの QHash へ展開（不要な出力は nullptr）
+    void residualStringMaps(QHash<QString, double>* qty, QHash<QString, double>* dvol,
+        QHash<QString, QSet<QString>>* insts) const;
 
     // シグナル行のインデックス
-    QHash<QString, int>     m_signalRowIndexByKey;  // key → row
+    QHash<ClusterBook::Key, int> m_signalRowIndexByKey;  // key → row
 
     // ★第三弾：レッグ明細（クラスタkey -> 直近レッグ列）
-    QHash<QString, QVector<LegDetail>> m_legsByKey;
+    QHash<ClusterBook::Key, QVector<LegDetail>> m_legsByKey;
 
     // ★第三弾：レッグ明細テーブル（存在すれば使う。名前は動的探索）
     QTableWidget* m_tableLegs{ nullptr };
 
     // ★第三弾：シグナル選択 → 明細反映
-    void populateLegDetailsForKey(const QString& key);
+    void populateLegDetailsForKey(ClusterBook::Key key);
 
     // OI 保存（将来のフェッチ用。無ければ0で進む）
     OIStore m_oi;
@@ -313,18 +414,31 @@ private: // ===== メンバ =====
     void updatePinMapTable();
     int  m_pinMapTick{ 0 }; // UI tick で軽くスロットル
 
-    // OI取得
-    void requestOIAll();
-    void handleOIReply(const QByteArray& bytes);
+    // 一括スナップショット（get_book_summary_by_currency → IV/NBBO/OI）
+    void requestMarketSnapshot();
+    void handleMarketSnapshot(const QByteArray& bytes);
 
+    // 満期カーブ：約定で動いたクラスタだけ評価し直し、表とチャートは同じ結果を読む
+    void updateCurves();                     // エンジンを進めてから表・チャートへ
+    void refreshCurveEngine();
+    CurveEngine::ClusterInput curveInputOf(int slot) const;
     void updateCurvesTables();
     int  m_curvesTick{ 0 };
+    CurveEngine m_curveEngine;
+    QSet<int>   m_curveDirtySlots;           // 次の更新で評価し直す slot
+    bool        m_curveRebuild{ true };      // 全クラスタ・IV が入れ替わった（復元・IV スナップショット）
 
-    // IVオンデマンド取得
-    void queueIV(const QString & inst);
+    // IVオンデマンド取得（スナップショットに載らなかった銘柄だけ）
+    void queueIV(InstId id);
     void pumpIV();
+    void requestIVFor(InstId id);
 
     // NBBOキャッシュ
     NbboStore m_nbbo;
 
+    // L2 板（購読中の銘柄だけ）。欠番で購読し直している間は m_bookResync に入れて差分を捨てる
+    QHash<InstId, OrderBook> m_books;
+    QSet<InstId>             m_bookResync;
+    int                      m_bookResyncs{ 0 };   // 欠番で取り直した回数（ステータス表示）
+
 };
@@ -3,12 +3,30 @@
 #include <QJsonValue>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QThread>
+#include <QDateTime>
+#include <QRandomGenerator>
+#include <algorithm>
 
-WebSocketClient::WebSocketClient(QObject* parent) : QObject(parent) {
+WebSocketClient::WebSocketClient(QObject* parent)
+    : QObject(parent)
+    , m_ws(QString(), QWebSocketProtocol::VersionLatest, this)   // moveToThread で一緒に移るよう親を付ける
+    , m_pingTimer(this)
+    , m_reconnectTimer(this)
+    , m_rpcTimer(this)
+{
     connect(&m_ws, &QWebSocket::connected, this, &WebSocketClient::onConnected);
+    connect(&m_ws, &QWebSocket::disconnected, this, &WebSocketClient::onDisconnected);
+    connect(&m_ws, &QWebSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
+        if (!m_connected) scheduleReconnect();    // 接続に失敗した（disconnected は来ない）
+        });
     connect(&m_ws, &QWebSocket::textMessageReceived, this, &WebSocketClient::onTextMessageReceived);
     connect(&m_pingTimer, &QTimer::timeout, this, &WebSocketClient::onPing);
     m_pingTimer.setInterval(15000);
+    m_reconnectTimer.setSingleShot(true);
+    connect(&m_reconnectTimer, &QTimer::timeout, this, &WebSocketClient::connectPublic);
+    m_rpcTimer.setInterval(1000);
+    connect(&m_rpcTimer, &QTimer::timeout, this, &WebSocketClient::sweepRpc);
 }
 
 void WebSocketClient::connectPublic() {
@@ -16,11 +34,32 @@ void WebSocketClient::connectPublic() {
 }
 
 void WebSocketClient::subscribe(const QStringList& channels) {
-    QJsonObject params; params["channels"] = QJsonArray::fromStringList(channels);
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [this, channels] { subscribe(channels); }, Qt::QueuedConnection);
+        return;
+    }
+    QStringList fresh;                            // 購読済みのチャンネルは出し直さない
+    for (const QString& c : channels)
+        if (!m_channels.contains(c)) { m_channels.insert(c); fresh << c; }
+    if (!m_connected || fresh.isEmpty()) return;  // 繋がったら onConnected でまとめて送る
+
+    QJsonObject params; params["channels"] = QJsonArray::fromStringList(fresh);
     QJsonObject obj{ {"jsonrpc","2.0"},{"method","public/subscribe"},{"id",42},{"params",params} };
     sendJson(obj);
 }
 
+void WebSocketClient::unsubscribe(const QStringList& channels) {
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [this, channels] { unsubscribe(channels); }, Qt::QueuedConnection);
+        return;
+    }
+    for (const QString& c : channels) m_channels.remove(c);
+    if (!m_connected) return;                     // 切断中なら再接続時に送らないだけでよい
+
+    QJsonObject params; params["channels"] = QJsonArray::fromStringList(channels);
+    sendJson(QJsonObject{ {"jsonrpc","2.0"},{"method","public/unsubscribe"},{"id",43},{"params",params} });
+}
+
 int WebSocketClient::call(const QString& method, const QJsonObject& params) {
     const int id = m_nextId++;
     QJsonObject obj{ {"jsonrpc","2.0"},{"method",method},{"id",id},{"params",params} };
@@ -28,39 +67,215 @@ int WebSocketClient::call(const QString& method, const QJsonObject& params) {
     return id;
 }
 
+void WebSocketClient::request(const QString& method, const QJsonObject& params, QObject* context,
+    RpcHandler done, int timeoutMs) {
+    Rpc r;
+    r.id = m_nextId++;
+    r.msg = QJsonObject{ {"jsonrpc","2.0"},{"method",method},{"id",r.id},{"params",params} };
+    r.ctx = context;
+    r.done = std::move(done);
+    r.timeoutMs = timeoutMs;
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [this, r = std::move(r)]() mutable { enqueueRpc(std::move(r)); },
+            Qt::QueuedConnection);
+        return;
+    }
+    enqueueRpc(std::move(r));
+}
+
+void WebSocketClient::enqueueRpc(Rpc&& r) {
+    if (!m_connected) {
+        RpcReply rep;
+        rep.error = QStringLiteral("WS 未接続");
+        rep.lost = true;
+        completeRpc(std::move(r), std::move(rep));
+        return;
+    }
+    if (m_rpcPending.size() >= RPC_MAX_INFLIGHT) { m_rpcWaiting.push_back(std::move(r)); return; }
+    sendRpc(std::move(r));
+}
+
+void WebSocketClient::sendRpc(Rpc&& r) {
+    r.clock.start();
+    sendJson(r.msg);
+    const int id = r.id;
+    m_rpcPending.insert(id, std::move(r));
+    if (!m_rpcTimer.isActive()) m_rpcTimer.start();
+}
+
+void WebSocketClient::completeRpc(Rpc&& r, RpcReply&& rep) {
+    rep.latencyMs = r.clock.isValid() ? r.clock.elapsed() : 0;
+    if (r.ctx && r.done) {
+        QMetaObject::invokeMethod(r.ctx.data(), [done = std::move(r.done), rep = std::move(rep)]() { done(rep); },
+            Qt::QueuedConnection);
+    }
+}
+
+void WebSocketClient::pumpRpc() {
+    while (m_connected && !m_rpcWaiting.empty() && m_rpcPending.size() < RPC_MAX_INFLIGHT) {
+        Rpc r = std::move(m_rpcWaiting.front());
+        m_rpcWaiting.pop_front();
+        sendRpc(std::move(r));
+    }
+    if (m_rpcPending.isEmpty()) m_rpcTimer.stop();
+}
+
+void WebSocketClient::sweepRpc() {
+    QList<int> expired;
+    for (auto it = m_rpcPending.cbegin(); it != m_rpcPending.cend(); ++it)
+        if (it->clock.elapsed() > it->timeoutMs) expired << it.key();
+    for (int id : expired) {
+        RpcReply rep;
+        rep.error = QStringLiteral("WS 応答タイムアウト");
+        rep.timedOut = true;
+        completeRpc(m_rpcPending.take(id), std::move(rep));
+    }
+    pumpRpc();
+}
+
+void WebSocketClient::failAllRpc(const QString& why) {
+    std::deque<Rpc> all;
+    for (auto it = m_rpcPending.begin(); it != m_rpcPending.end(); ++it) all.push_back(std::move(*it));
+    m_rpcPending.clear();
+    for (Rpc& r : m_rpcWaiting) all.push_back(std::move(r));
+    m_rpcWaiting.clear();
+    for (Rpc& r : all) {
+        RpcReply rep;
+        rep.error = why;
+        rep.lost = true;
+        completeRpc(std::move(r), std::move(rep));
+    }
+    m_rpcTimer.stop();
+}
+
 void WebSocketClient::onConnected() {
     // hello
     QJsonObject helloParams; helloParams["client_name"] = "BTC_OP_V2"; helloParams["client_version"] = "0.2";
     call("public/hello", helloParams);
-    // heartbeat 30s
-    QJsonObject hb; hb["interval"] = 30;
+    // heartbeat 30s（test_request には onTextMessageReceived で応える）
+    QJsonObject hb; hb["interval"] = HEARTBEAT_SEC;
     call("public/set_heartbeat", hb);
 
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
     m_connected = true;
+    m_backoffMs = BACKOFF_MIN_MS;
+    m_lastRxMs = now;
+    m_rxClock.start();
+    m_testId = -1;
     m_pingTimer.start();
-    emit connected();
+
+    // 覚えているチャンネル（初回なら接続前に頼まれた分）を1回で購読する
+    if (!m_channels.isEmpty()) {
+        QJsonObject params; params["channels"] = QJsonArray::fromStringList(m_channels.values());
+        sendJson(QJsonObject{ {"jsonrpc","2.0"},{"method","public/subscribe"},{"id",42},{"params",params} });
+    }
+
+    if (!m_everConnected) {
+        m_everConnected = true;
+        emit connected();
+        return;
+    }
+    emit reconnected(m_downSinceMs, now);         // 再接続：欠けた区間を知らせる
+}
+
+void WebSocketClient::onDisconnected() {
+    if (m_connected) {
+        m_connected = false;
+        m_downSinceMs = m_lastRxMs;               // ここから先は取りこぼしている可能性がある
+        m_pingTimer.stop();
+        m_testId = -1;
+        failAllRpc(QStringLiteral("WS 切断"));
+        emit disconnected();
+    }
+    scheduleReconnect();
+}
+
+void WebSocketClient::scheduleReconnect() {
+    if (m_reconnectTimer.isActive()) return;
+    // 1s から倍々で最大 60s。揃って再接続しないよう少し揺らす
+    const int jitter = int(QRandomGenerator::global()->bounded(m_backoffMs / 4 + 1));
+    m_reconnectTimer.start(m_backoffMs + jitter);
+    m_backoffMs = std::min(m_backoffMs * 2, BACKOFF_MAX_MS);
 }
 
 void WebSocketClient::onTextMessageReceived(const QString& msg) {
-    const auto doc = QJsonDocument::fromJson(msg.toUtf8());
+    m_lastRxMs = QDateTime::currentMSecsSinceEpoch();
+    m_rxClock.restart();
+    const QByteArray utf8 = msg.toUtf8();
+
+    // 約定フレームは UTF-8 のまま走査（QJsonDocument/QJsonObject を経由しない）
+    m_tradeBuf.clear();
+    const FrameInfo fi = DeribitParser::parseFrame(utf8.constData(), utf8.size(), m_tradeBuf);
+    if (fi.kind == FrameKind::Trades) {
+        if (!m_tradeBuf.empty()) emit tradesReceived(m_tradeBuf, fi.globalChannel);
+        return;
+    }
+    // request の応答はフレームのまま返す（解析は受け手のワーカーで）
+    if (fi.kind == FrameKind::Reply) {
+        const auto it = m_rpcPending.find(int(fi.rpcId));
+        if (it != m_rpcPending.end()) {
+            Rpc r = std::move(*it);
+            m_rpcPending.erase(it);
+            RpcReply rep;
+            if (fi.rpcError) {
+                const QJsonObject err = QJsonDocument::fromJson(utf8).object().value("error").toObject();
+                rep.errorCode = err.value("code").toInt();
+                rep.error = QString("RPC error %1: %2").arg(rep.errorCode).arg(err.value("message").toString());
+            }
+            rep.body = utf8;
+            completeRpc(std::move(r), std::move(rep));
+            pumpRpc();
+            return;
+        }
+    }
+
+    const auto doc = QJsonDocument::fromJson(utf8);
     if (!doc.isObject()) return;
     const auto o = doc.object();
 
-    // subscription か RPC応答かを振り分け
-    if (o.contains("method") && o.value("method").toString() == "subscription") {
+    // subscription / heartbeat / RPC応答を振り分け
+    const QString method = o.value("method").toString();
+    if (method == QLatin1String("subscription")) {
         emit msgReceived(o);
         return;
     }
+    if (method == QLatin1String("heartbeat")) {
+        // test_request に答えないとサーバ側から切られる
+        if (o.value("params").toObject().value("type").toString() == QLatin1String("test_request"))
+            call("public/test", QJsonObject());
+        return;
+    }
     if (o.contains("id")) {
-        emit rpcReceived(o.value("id").toInt(), o);
+        const int id = o.value("id").toInt();
+        if (id == m_testId) {
+            m_testId = -1;
+            emit rttMeasured(double(m_testClock.nsecsElapsed()) / 1e6);
+            return;
+        }
+        emit rpcReceived(id, o);
     }
 }
 
 void WebSocketClient::onPing() {
-    QJsonObject nopParams;
-    call("public/test", nopParams);
+    if (!m_connected) return;
+    // 心拍も応答も来ない → 半開きの接続とみなして切り、再接続へ
+    if (m_rxClock.elapsed() > STALE_MS) {
+        m_ws.abort();
+        if (m_connected) onDisconnected();
+        return;
+    }
+    // 往復時間の計測（応答待ちは1本だけ）
+    if (m_testId < 0 || m_testClock.elapsed() > STALE_MS) {
+        m_testClock.start();
+        m_testId = call("public/test", QJsonObject());
+    }
 }
 
 void WebSocketClient::sendJson(const QJsonObject& obj) {
+    // 別スレッド（GUI）からの送信はソケットの所属スレッドへ回す
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [this, obj] { sendJson(obj); }, Qt::QueuedConnection);
+        return;
+    }
     m_ws.sendTextMessage(QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact)));
 }
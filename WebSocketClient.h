@@ -4,32 +4,105 @@
 #include <QtWebSockets/QWebSocket>
 #include <QJsonObject>
 #include <QStringList>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <vector>
+#include "deribit_parser.h"
 
 class WebSocketClient : public QObject {
     Q_OBJECT
 public:
     explicit WebSocketClient(QObject* parent = nullptr);
 
+    static constexpr int HEARTBEAT_SEC = 30;        // public/set_heartbeat の間隔
+    static constexpr int STALE_MS = 2 * HEARTBEAT_SEC * 1000 + 5000;   // これだけ無音なら切れたとみなす
+    static constexpr int BACKOFF_MIN_MS = 1000;
+    static constexpr int BACKOFF_MAX_MS = 60000;
+    static constexpr int RPC_MAX_INFLIGHT = 32;     // 応答待ちの上限（超えた分は送らずに待たせる）
+    static constexpr int RPC_TIMEOUT_MS = 30000;
+
+    // request の結果。body は応答フレームそのまま（result を含み、REST の本文と同じ形）
+    struct RpcReply {
+        QByteArray body;
+        QString    error;             // 空なら成功
+        int        errorCode{ 0 };    // サーバの error.code
+        bool       lost{ false };     // 送れなかった・応答前に切れた（REST で出し直せる）
+        bool       timedOut{ false };
+        qint64     latencyMs{ 0 };
+        bool ok() const { return error.isEmpty(); }
+    };
+    using RpcHandler = std::function<void(const RpcReply&)>;
+
+    // connectPublic は所属スレッドで呼ぶ。subscribe/unsubscribe/call は任意スレッドから可
+    // 購読したチャンネルは覚えておき、接続（初回・再接続とも）時にまとめて購読する。購読済みは出し直さない
     void connectPublic();
     void subscribe(const QStringList& channels);
+    void unsubscribe(const QStringList& channels);
     int  call(const QString& method, const QJsonObject& params);
+    // 応答を id で突き合わせて done へ（context のスレッドで呼ぶ。context が消えていれば捨てる）
+    void request(const QString& method, const QJsonObject& params, QObject* context, RpcHandler done,
+        int timeoutMs = RPC_TIMEOUT_MS);
+    bool isConnected() const { return m_connected.load(std::memory_order_acquire); }
 
 signals:
-    void connected();
+    void connected();                                 // 初回の接続
+    void disconnected();
+    void reconnected(qint64 gapFromMs, qint64 gapToMs);   // 再接続＋再購読済み。欠けた区間（壁時計 ms）
+    void rttMeasured(double ms);                      // public/test の往復
     void msgReceived(const QJsonObject& obj);
     void rpcReceived(int id, const QJsonObject& reply);
+    // trades.* は専用パーサで直接 RawTrade 化して渡す（QJsonObject を作らない）
+    void tradesReceived(const std::vector<RawTrade>& trades, bool isGlobal);
 
     // ---------- [After 後続は既存の slots] ----------
 private slots:
     void onConnected();
+    void onDisconnected();
     void onTextMessageReceived(const QString& msg);
     void onPing();
 
 private:
+    struct Rpc {
+        int id{ 0 };
+        QJsonObject msg;
+        QPointer<QObject> ctx;
+        RpcHandler done;
+        int timeoutMs{ RPC_TIMEOUT_MS };
+        QElapsedTimer clock;
+    };
+
     void sendJson(const QJsonObject& obj);
+    void scheduleReconnect();
+    void enqueueRpc(Rpc&& r);
+    void sendRpc(Rpc&& r);
+    void completeRpc(Rpc&& r, RpcReply&& rep);
+    void pumpRpc();
+    void sweepRpc();                    // タイムアウト
+    void failAllRpc(const QString& why);
 
     QWebSocket m_ws;
     QTimer     m_pingTimer;
-    bool       m_connected{ false };
-    int        m_nextId{ 100 };
+    QTimer     m_reconnectTimer;
+    QTimer     m_rpcTimer;
+    std::atomic<bool> m_connected{ false };
+    bool       m_everConnected{ false };
+    int        m_backoffMs{ BACKOFF_MIN_MS };
+    std::atomic<int> m_nextId{ 100 };
+
+    // 以下はソケットの所属スレッド専用
+    QSet<QString>  m_channels;          // 購読中（再接続で復元）
+    qint64         m_lastRxMs{ 0 };     // 最後にフレームを受けた壁時計
+    qint64         m_downSinceMs{ 0 };  // 切断を検知する直前の受信時刻
+    QElapsedTimer  m_rxClock;           // 無音判定（単調）
+    int            m_testId{ -1 };      // 応答待ちの public/test
+    QElapsedTimer  m_testClock;
+    QHash<int, Rpc> m_rpcPending;       // 送信済み・応答待ち
+    std::deque<Rpc> m_rpcWaiting;       // 上限超えで未送信
+
+    std::vector<RawTrade> m_tradeBuf;   // 受信ごとに再利用（容量は保持）
 };
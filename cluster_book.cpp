@@ -0,0 +1,114 @@
+// cluster_book.cpp
+#include "cluster_book.h"
+#include <QStringList>
+#include <algorithm>
+
+ClusterBook::Key ClusterBook::makeKey(qint64 expMs, bool isCall, int kRound) {
+    auto it = m_expIndex.constFind(expMs);
+    quint32 idx;
+    if (it != m_expIndex.constEnd()) {
+        idx = it.value();
+    }
+    else {
+        idx = quint32(m_expByIndex.size());
+        m_expIndex.insert(expMs, idx);
+        m_expByIndex.push_back(expMs);
+    }
+    return (Key(idx) << 33) | (Key(isCall ? 1 : 0) << 32) | Key(quint32(kRound));
+}
+
+ClusterBook::Key ClusterBook::findKey(qint64 expMs, bool isCall, int kRound) const {
+    auto it = m_expIndex.constFind(expMs);
+    if (it == m_expIndex.constEnd()) return INVALID_KEY;
+    return (Key(it.value()) << 33) | (Key(isCall ? 1 : 0) << 32) | Key(quint32(kRound));
+}
+
+qint64 ClusterBook::expiryOf(Key k) const {
+    const quint64 idx = k >> 33;
+    return idx < quint64(m_expByIndex.size()) ? m_expByIndex[int(idx)] : 0;
+}
+
+QString ClusterBook::keyToString(Key k) const {
+    return QString("%1|%2|%3").arg(expiryOf(k)).arg(isCallOf(k) ? 1 : 0).arg(strikeOf(k));
+}
+
+ClusterBook::Key ClusterBook::keyFromString(const QString& s) {
+    const QStringList p = s.split('|');
+    if (p.size() != 3) return INVALID_KEY;
+    bool ok1 = false, ok2 = false, ok3 = false;
+    const qint64 exp = p[0].toLongLong(&ok1);
+    const int    cp = p[1].toInt(&ok2);
+    const int    k = int(p[2].toDouble(&ok3));
+    if (!ok1 || !ok2 || !ok3 || exp <= 0) return INVALID_KEY;
+    return makeKey(exp, cp == 1, k);
+}
+
+int ClusterBook::slot(Key k) {
+    auto it = m_slotByKey.constFind(k);
+    if (it != m_slotByKey.constEnd()) return it.value();
+
+    const int s = int(m_key.size());
+    m_slotByKey.insert(k, s);
+    m_key.push_back(k);
+    m_expiry.push_back(expiryOf(k));
+    m_qty.push_back(0.0);
+    m_signedQty.push_back(0.0);
+    m_dVol.push_back(0.0);
+    m_lastTs.push_back(0);
+    m_anchorTs.push_back(0);
+    m_trades.push_back(0);
+    m_instBits.resize(m_instBits.size() + m_instWords, 0);
+    return s;
+}
+
+void ClusterBook::clear() {
+    // 満期インデックスは残す（キーの意味を変えない）
+    m_slotByKey.clear();
+    m_key.clear(); m_expiry.clear();
+    m_qty.clear(); m_signedQty.clear(); m_dVol.clear();
+    m_lastTs.clear(); m_anchorTs.clear(); m_trades.clear();
+    m_instBits.clear();
+}
+
+void ClusterBook::addTrade(int s, qint64 ts, double signedAmt, double dVol, InstId inst) {
+    m_qty[s] += signedAmt;
+    m_signedQty[s] += signedAmt;
+    m_dVol[s] += dVol;
+    m_lastTs[s] = std::max(m_lastTs[s], ts);
+    m_trades[s] += 1;
+    addInst(s, inst);
+}
+
+void ClusterBook::restore(int s, double qty, double signedQty, double dVol, qint64 lastTs, int trades) {
+    m_qty[s] = qty;
+    m_signedQty[s] = signedQty;
+    m_dVol[s] = dVol;
+    m_lastTs[s] = lastTs;
+    m_trades[s] = trades;
+}
+
+void ClusterBook::addInst(int s, InstId inst) {
+    if (inst == INVALID_INST) return;
+    const int word = int(inst / 64);
+    if (word >= m_instWords) growInstWords(word + 1);
+    m_instBits[qsizetype(s) * m_instWords + word] |= (quint64(1) << (inst % 64));
+}
+
+int ClusterBook::instCount(int s) const {
+    const quint64* w = m_instBits.constData() + qsizetype(s) * m_instWords;
+    int n = 0;
+    for (int i = 0; i < m_instWords; ++i) n += int(qPopulationCount(w[i]));
+    return n;
+}
+
+void ClusterBook::growInstWords(int words) {
+    // 銘柄表の拡張時のみ。少し余裕を持たせて詰め直しの回数を抑える
+    const int newWords = std::max(words, m_instWords + 4);
+    const int n = size();
+    QVector<quint64> bits(qsizetype(n) * newWords, 0);
+    for (int s = 0; s < n; ++s)
+        std::copy_n(m_instBits.constData() + qsizetype(s) * m_instWords, m_instWords,
+            bits.data() + qsizetype(s) * newWords);
+    m_instBits = std::move(bits);
+    m_instWords = newWords;
+}
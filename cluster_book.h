@@ -0,0 +1,88 @@
+// cluster_book.h
+#pragma once
+#include <QtGlobal>
+#include <QtAlgorithms>
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include "instrument_registry.h"
+
+// クラスタ（満期×CP×行使バケット）ごとの残存推定。
+// キーは 64bit に詰め、列は配列で持つ（1約定＝ハッシュ1回、全走査は連続メモリ）。
+//   [63..33] 満期インデックス / [32] Call=1 / [31..0] 行使（バケット丸め後の整数）
+class ClusterBook {
+public:
+    using Key = quint64;
+    static constexpr Key INVALID_KEY = ~Key(0);
+
+    // 満期はブック内で連番化（初出時に登録）
+    Key makeKey(qint64 expMs, bool isCall, int kRound);
+    Key findKey(qint64 expMs, bool isCall, int kRound) const;   // 満期が未登録なら INVALID_KEY
+
+    static bool isCallOf(Key k) { return ((k >> 32) & 1u) != 0; }
+    static int  strikeOf(Key k) { return int(quint32(k)); }
+    qint64 expiryOf(Key k) const;
+
+    // スナップショット/表示用の "exp|isCall|k" 形式
+    QString keyToString(Key k) const;
+    Key     keyFromString(const QString& s);
+
+    int  find(Key k) const { return m_slotByKey.value(k, -1); }   // 無ければ -1
+    int  slot(Key k);                                            // 無ければ作る
+    int  size() const { return int(m_key.size()); }
+    void clear();
+
+    // 1約定の反映（signedAmt: 買い+/売り-、dVol: 符号付き Δ加重）
+    void addTrade(int s, qint64 ts, double signedAmt, double dVol, InstId inst);
+    // スナップショット復元用
+    void restore(int s, double qty, double signedQty, double dVol, qint64 lastTs, int trades);
+    void addInst(int s, InstId inst);
+
+    Key    key(int s)       const { return m_key[s]; }
+    qint64 expiryMs(int s)  const { return m_expiry[s]; }
+    bool   isCall(int s)    const { return isCallOf(m_key[s]); }
+    double strike(int s)    const { return double(strikeOf(m_key[s])); }
+    double qty(int s)       const { return m_qty[s]; }
+    double signedQty(int s) const { return m_signedQty[s]; }
+    double dVol(int s)      const { return m_dVol[s]; }
+    qint64 lastTs(int s)    const { return m_lastTs[s]; }
+    int    trades(int s)    const { return m_trades[s]; }
+    int    instCount(int s) const;
+
+    // 表示の仕込み時刻（未設定は0）
+    qint64 anchorTs(int s) const { return m_anchorTs[s]; }
+    void   setAnchorTs(int s, qint64 ts) { m_anchorTs[s] = ts; }
+
+    template <typename F>
+    void forEachInst(int s, F&& f) const {
+        const quint64* w = m_instBits.constData() + qsizetype(s) * m_instWords;
+        for (int i = 0; i < m_instWords; ++i) {
+            quint64 bits = w[i];
+            while (bits) {
+                const int b = int(qCountTrailingZeroBits(bits));
+                f(InstId(i * 64 + b));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+private:
+    void growInstWords(int words);   // 銘柄IDが stride を超えたら詰め直す
+
+    QHash<qint64, quint32> m_expIndex;   // expiryMs → 満期インデックス
+    QVector<qint64>        m_expByIndex;
+
+    QHash<Key, int>  m_slotByKey;
+    QVector<Key>     m_key;
+    QVector<qint64>  m_expiry;
+    QVector<double>  m_qty;          // 残枚数（買い+ / 売り-。下限なし）
+    QVector<double>  m_signedQty;    // 買い/売りのネット
+    QVector<double>  m_dVol;         // 符号付き Δ加重
+    QVector<qint64>  m_lastTs;
+    QVector<qint64>  m_anchorTs;
+    QVector<int>     m_trades;
+
+    // 参加銘柄のビット集合（クラスタごとに m_instWords 語を連続配置）
+    int              m_instWords{ 0 };
+    QVector<quint64> m_instBits;
+};
@@ -0,0 +1,62 @@
+// curve_engine.cpp
+#include "curve_engine.h"
+#include "iv_batch.h"
+
+void CurveEngine::clear() {
+    m_spot = 0.0;
+    m_epochMs = 0;
+    m_bySlot.clear();
+    m_byExpiry.clear();
+    m_rowsDirty = true;
+}
+
+void CurveEngine::beginEpoch(double spot, qint64 now) {
+    m_spot = spot;
+    m_epochMs = now;
+    m_bySlot.clear();
+    m_byExpiry.clear();
+    m_rowsDirty = true;
+}
+
+bool CurveEngine::epochStale(double spot, qint64 now) const {
+    return spot != m_spot || now - m_epochMs >= EPOCH_MS;
+}
+
+void CurveEngine::set(int slot, const ClusterInput& in) {
+    if (slot < 0) return;
+    if (slot >= m_bySlot.size()) m_bySlot.resize(slot + 1);
+
+    Contrib c;
+    c.expiryMs = in.expiryMs;
+    const double minutes = double(in.expiryMs - m_epochMs) / 60000.0;
+    const IvGreeksRow g = IvBatch::greeksAt(in.isCall, m_spot, in.strike, minutes, in.ivPct);
+    c.gamma = in.qty * g.gamma;
+    c.vega = in.qty * g.vega;
+    c.vanna = in.qty * g.vanna;
+    c.charm = in.qty * g.charm;
+
+    // 旧い寄与を引いて新しい寄与を足す（満期が変わることはないが、空の slot は expiryMs=0）
+    Contrib& old = m_bySlot[slot];
+    if (old.expiryMs != 0) {
+        Row& r = m_byExpiry[old.expiryMs];
+        r.netGamma -= old.gamma; r.netVega -= old.vega; r.netVanna -= old.vanna; r.netCharm -= old.charm;
+    }
+    if (c.expiryMs != 0) {
+        Row& r = m_byExpiry[c.expiryMs];
+        r.expiryMs = c.expiryMs;
+        r.netGamma += c.gamma; r.netVega += c.vega; r.netVanna += c.vanna; r.netCharm += c.charm;
+    }
+    old = c;
+    m_rowsDirty = true;
+}
+
+const QVector<CurveEngine::Row>& CurveEngine::rows() const {
+    if (m_rowsDirty) {
+        m_rows.clear();
+        m_rows.reserve(m_byExpiry.size());
+        for (auto it = m_byExpiry.cbegin(); it != m_byExpiry.cend(); ++it)
+            if (it.key() > m_epochMs) m_rows.push_back(it.value());
+        m_rowsDirty = false;
+    }
+    return m_rows;
+}
@@ -0,0 +1,54 @@
+// curve_engine.h
+#pragma once
+#include <QtGlobal>
+#include <QVector>
+#include <QMap>
+
+// 満期ごとのグリークス合計（GEX / Vega / Vanna / Charm）。カーブ表とチャートは同じ結果を読む。
+// - クラスタ（ClusterBook の slot）ごとの寄与＝残枚数×1枚あたりのグリークスを覚えておく
+// - 約定で動いたクラスタだけ set し直し、満期の合計は差分で動かす
+// - 全クラスタの評価し直しは基準（参照価格・残存時間のエポック）が変わった時だけ。
+//   その時に合計も作り直すので、差分の積み重ねによる誤差はエポックごとに消える
+class CurveEngine {
+public:
+    static constexpr qint64 EPOCH_MS = 60 * 1000;   // 残存時間の基準を進める間隔（時間減衰）
+
+    struct Row {
+        qint64 expiryMs{};
+        double netGamma{};
+        double netVega{};
+        double netVanna{};
+        double netCharm{};
+    };
+
+    struct ClusterInput {
+        qint64 expiryMs{};
+        bool   isCall{};
+        double strike{};
+        double qty{};        // 残枚数（買い+ / 売り-）
+        double ivPct{};      // 代表 IV（%。0 なら寄与なし）
+    };
+
+    void clear();
+    void beginEpoch(double spot, qint64 now);                // 寄与を捨てて基準を付け替える
+    bool epochStale(double spot, qint64 now) const;          // 参照価格が変わった・エポックを過ぎた
+    void set(int slot, const ClusterInput& in);              // slot の寄与を差し替える
+
+    double spot() const { return m_spot; }
+    qint64 epochMs() const { return m_epochMs; }
+    const QVector<Row>& rows() const;                        // 満期昇順（満期を過ぎた分は除く）
+
+private:
+    struct Contrib {
+        qint64 expiryMs{};
+        double gamma{}, vega{}, vanna{}, charm{};
+    };
+
+    double m_spot{ 0.0 };
+    qint64 m_epochMs{ 0 };
+    QVector<Contrib>  m_bySlot;
+    QMap<qint64, Row> m_byExpiry;
+
+    mutable QVector<Row> m_rows;
+    mutable bool         m_rowsDirty{ true };
+};
@@ -0,0 +1,341 @@
+// deribit_parser.cpp
+#include "deribit_parser.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+struct Cur {
+    const char* p;
+    const char* e;
+};
+
+inline void skipWs(Cur& c) {
+    while (c.p < c.e && (*c.p == ' ' || *c.p == '\n' || *c.p == '\r' || *c.p == '\t')) ++c.p;
+}
+
+inline bool eat(Cur& c, char ch) {
+    skipWs(c);
+    if (c.p < c.e && *c.p == ch) { ++c.p; return true; }
+    return false;
+}
+
+// 文字列の中身を指す（エスケープは読み飛ばすだけ。キー/銘柄名/方向には出てこない）
+bool readStr(Cur& c, const char** s, int* n) {
+    skipWs(c);
+    if (c.p >= c.e || *c.p != '"') return false;
+    const char* b = ++c.p;
+    while (c.p < c.e && *c.p != '"') {
+        if (*c.p == '\\') ++c.p;
+        ++c.p;
+    }
+    if (c.p >= c.e) return false;
+    *s = b;
+    *n = int(c.p - b);
+    ++c.p;
+    return true;
+}
+
+bool readDouble(Cur& c, double* v) {
+    skipWs(c);
+    const auto r = std::from_chars(c.p, c.e, *v);   // ロケール非依存
+    if (r.ec != std::errc()) return false;
+    c.p = r.ptr;
+    return true;
+}
+
+bool readInt(Cur& c, qint64* v) {
+    skipWs(c);
+    const char* b = c.p;
+    long long x = 0;
+    const auto r = std::from_chars(b, c.e, x);
+    if (r.ec != std::errc()) return false;
+    c.p = r.ptr;
+    // 小数・指数表記で来た場合は double で読み直す
+    if (c.p < c.e && (*c.p == '.' || *c.p == 'e' || *c.p == 'E')) {
+        double d = 0.0;
+        const auto r2 = std::from_chars(b, c.e, d);
+        if (r2.ec != std::errc()) return false;
+        c.p = r2.ptr;
+        x = (long long)d;
+    }
+    *v = qint64(x);
+    return true;
+}
+
+// 値を1つ読み飛ばす（文字列/数値/リテラル/ネストしたobject・array）
+bool skipValue(Cur& c) {
+    skipWs(c);
+    if (c.p >= c.e) return false;
+    const char ch = *c.p;
+    if (ch == '"') { const char* s; int n; return readStr(c, &s, &n); }
+    if (ch == '{' || ch == '[') {
+        int depth = 0;
+        while (c.p < c.e) {
+            const char x = *c.p;
+            if (x == '"') { const char* s; int n; if (!readStr(c, &s, &n)) return false; continue; }
+            if (x == '{' || x == '[') ++depth;
+            else if (x == '}' || x == ']') { if (--depth == 0) { ++c.p; return true; } }
+            ++c.p;
+        }
+        return false;
+    }
+    while (c.p < c.e && *c.p != ',' && *c.p != '}' && *c.p != ']'
+        && *c.p != ' ' && *c.p != '\n' && *c.p != '\r' && *c.p != '\t') ++c.p;
+    return true;
+}
+
+template <int N>
+inline bool keyIs(const char* s, int n, const char (&lit)[N]) {
+    return n == N - 1 && std::memcmp(s, lit, N - 1) == 0;
+}
+
+inline bool startsWith(const char* s, int n, const char* lit) {
+    const int m = int(std::strlen(lit));
+    return n >= m && std::memcmp(s, lit, size_t(m)) == 0;
+}
+
+// 先頭付近に "channel":"..." があり trades.* でなければ true（ticker・book・指数は全体を走査しない）。
+// Deribit の subscription は method → params.channel の順で先頭 100 バイト前後に channel が来る
+bool otherChannelAhead(const char* p, qsizetype n) {
+    static constexpr char KEY[] = "\"channel\"";
+    const char* e = p + std::min<qsizetype>(n, 160);
+    const char* k = std::search(p, e, KEY, KEY + sizeof(KEY) - 1);
+    if (k == e) return false;
+    Cur c{ k + sizeof(KEY) - 1, p + n };
+    const char* s; int sn;
+    if (!eat(c, ':') || !readStr(c, &s, &sn)) return false;
+    return !startsWith(s, sn, "trades.");
+}
+
+// trade_id は "123456" / 数値 / "BTC-123456" のいずれも来うるので、照合用には末尾の数字列だけ採る。
+// 表示用に元の文字列も残す（数値で来た時は数字列）
+bool readTradeId(Cur& c, RawTrade& t) {
+    skipWs(c);
+    const char* s; int n;
+    if (c.p < c.e && *c.p == '"') {
+        if (!readStr(c, &s, &n)) return false;
+    }
+    else {
+        s = c.p;
+        qint64 x = 0;
+        if (!readInt(c, &x)) return false;
+        n = int(c.p - s);
+    }
+    int b = n;
+    while (b > 0 && s[b - 1] >= '0' && s[b - 1] <= '9') --b;
+    quint64 x = 0;
+    for (int i = b; i < n; ++i) x = x * 10 + quint64(s[i] - '0');
+    t.tradeId = x;
+    const int keep = std::min(n, int(sizeof(t.tradeIdText)) - 1);
+    std::memcpy(t.tradeIdText, s, size_t(keep));
+    t.tradeIdText[keep] = '\0';
+    t.tradeIdLen = quint8(keep);
+    return true;
+}
+
+bool parseTrade(Cur& c, RawTrade& t) {
+    if (!eat(c, '{')) return false;
+    if (eat(c, '}')) return true;
+    for (;;) {
+        const char* k; int kn;
+        if (!readStr(c, &k, &kn) || !eat(c, ':')) return false;
+
+        bool ok = true;
+        if (keyIs(k, kn, "timestamp"))            ok = readInt(c, &t.ts);
+        else if (keyIs(k, kn, "price"))           ok = readDouble(c, &t.price);
+        else if (keyIs(k, kn, "amount"))          ok = readDouble(c, &t.amount);
+        else if (keyIs(k, kn, "iv"))              ok = readDouble(c, &t.iv);
+        else if (keyIs(k, kn, "index_price"))     ok = readDouble(c, &t.indexPrice);
+        else if (keyIs(k, kn, "mark_price"))      ok = readDouble(c, &t.markPrice);
+        else if (keyIs(k, kn, "trade_id"))        ok = readTradeId(c, t);
+        else if (keyIs(k, kn, "trade_seq"))       ok = readInt(c, &t.tradeSeq);
+        else if (keyIs(k, kn, "direction")) {
+            const char* s; int n;
+            ok = readStr(c, &s, &n);
+            if (ok) t.sign = (n == 3 && (s[0] == 'b' || s[0] == 'B')) ? +1 : -1;
+        }
+        else if (keyIs(k, kn, "instrument_name")) {
+            const char* s; int n;
+            ok = readStr(c, &s, &n) && n < int(sizeof(t.inst));
+            if (ok) {
+                std::memcpy(t.inst, s, size_t(n));
+                t.inst[n] = '\0';
+                t.instLen = quint8(n);
+            }
+        }
+        else ok = skipValue(c);
+        if (!ok) return false;
+
+        if (eat(c, ',')) continue;
+        return eat(c, '}');
+    }
+}
+
+// data は配列そのもの、または {"trades":[...]} の2形態
+bool parseTradesData(Cur& c, std::vector<RawTrade>& out) {
+    skipWs(c);
+    if (c.p < c.e && *c.p == '{') {
+        ++c.p;
+        if (eat(c, '}')) return true;
+        for (;;) {
+            const char* k; int kn;
+            if (!readStr(c, &k, &kn) || !eat(c, ':')) return false;
+            const bool ok = keyIs(k, kn, "trades") ? parseTradesData(c, out) : skipValue(c);
+            if (!ok) return false;
+            if (eat(c, ',')) continue;
+            return eat(c, '}');
+        }
+    }
+    if (!eat(c, '[')) return false;
+    if (eat(c, ']')) return true;
+    for (;;) {
+        RawTrade t;
+        if (!parseTrade(c, t)) return false;
+        if (t.instLen > 0) out.push_back(t);
+        if (eat(c, ',')) continue;
+        return eat(c, ']');
+    }
+}
+
+} // namespace
+
+FrameInfo DeribitParser::parseFrame(const char* p, qsizetype n, std::vector<RawTrade>& out) {
+    FrameInfo info;
+    if (otherChannelAhead(p, n)) return info;
+    const size_t base = out.size();
+    Cur c{ p, p + n };
+    if (!eat(c, '{')) return info;
+
+    bool isSub = false;
+    bool isTrades = false;
+    bool global = false;
+    bool parsedData = false;
+    bool hasError = false;
+    qint64 id = -1;
+    Cur dataSpan{ nullptr, nullptr };   // channel より先に data が来た場合の退避
+
+    auto fail = [&] { out.resize(base); return FrameInfo{}; };
+
+    if (eat(c, '}')) return info;
+    for (;;) {
+        const char* k; int kn;
+        if (!readStr(c, &k, &kn) || !eat(c, ':')) return fail();
+
+        if (keyIs(k, kn, "method")) {
+            const char* s; int sn;
+            if (!readStr(c, &s, &sn)) return fail();
+            isSub = keyIs(s, sn, "subscription");
+        }
+        else if (keyIs(k, kn, "id")) {
+            if (!readInt(c, &id)) return fail();
+        }
+        else if (keyIs(k, kn, "error")) {
+            hasError = true;
+            if (!skipValue(c)) return fail();
+        }
+        else if (keyIs(k, kn, "params")) {
+            if (!eat(c, '{')) return fail();
+            if (!eat(c, '}')) {
+                for (;;) {
+                    const char* pk; int pkn;
+                    if (!readStr(c, &pk, &pkn) || !eat(c, ':')) return fail();
+                    if (keyIs(pk, pkn, "channel")) {
+                        const char* s; int sn;
+                        if (!readStr(c, &s, &sn)) return fail();
+                        isTrades = startsWith(s, sn, "trades.");
+                        global = startsWith(s, sn, "trades.option.");
+                        if (!isTrades) return fail();   // 約定以外の購読はここで打ち切り（残りは読まない）
+                    }
+                    else if (keyIs(pk, pkn, "data")) {
+                        if (isTrades) {
+                            if (!parseTradesData(c, out)) return fail();
+                            parsedData = true;
+                        }
+                        else {
+                            skipWs(c);
+                            dataSpan.p = c.p;
+                            if (!skipValue(c)) return fail();
+                            dataSpan.e = c.p;
+                        }
+                    }
+                    else if (!skipValue(c)) return fail();
+
+                    if (eat(c, ',')) continue;
+                    if (!eat(c, '}')) return fail();
+                    break;
+                }
+            }
+        }
+        else if (!skipValue(c)) return fail();
+
+        if (eat(c, ',')) continue;
+        break;
+    }
+
+    if (!isSub && id >= 0) {
+        out.resize(base);
+        info.kind = FrameKind::Reply;
+        info.rpcId = id;
+        info.rpcError = hasError;
+        return info;
+    }
+    if (!isSub || !isTrades) return fail();
+    if (!parsedData && dataSpan.p && !parseTradesData(dataSpan, out)) return fail();
+
+    info.kind = FrameKind::Trades;
+    info.globalChannel = global;
+    return info;
+}
+
+bool DeribitParser::parseTradesReply(const char* p, qsizetype n, std::vector<RawTrade>& out, bool* hasMore) {
+    const size_t base = out.size();
+    Cur c{ p, p + n };
+    bool gotResult = false;
+    bool more = false;
+
+    auto fail = [&] { out.resize(base); return false; };
+
+    if (!eat(c, '{') || eat(c, '}')) return false;
+    for (;;) {
+        const char* k; int kn;
+        if (!readStr(c, &k, &kn) || !eat(c, ':')) return fail();
+
+        if (keyIs(k, kn, "result")) {
+            skipWs(c);
+            if (c.p < c.e && *c.p == '{') {
+                ++c.p;
+                if (!eat(c, '}')) {
+                    for (;;) {
+                        const char* rk; int rkn;
+                        if (!readStr(c, &rk, &rkn) || !eat(c, ':')) return fail();
+                        bool ok = true;
+                        if (keyIs(rk, rkn, "trades")) ok = parseTradesData(c, out);
+                        else if (keyIs(rk, rkn, "has_more")) {
+                            skipWs(c);
+                            more = (c.p < c.e && *c.p == 't');
+                            ok = skipValue(c);
+                        }
+                        else ok = skipValue(c);
+                        if (!ok) return fail();
+
+                        if (eat(c, ',')) continue;
+                        if (!eat(c, '}')) return fail();
+                        break;
+                    }
+                }
+            }
+            else if (!parseTradesData(c, out)) return fail();
+            gotResult = true;
+        }
+        else if (!skipValue(c)) return fail();
+
+        if (eat(c, ',')) continue;
+        break;
+    }
+
+    if (!gotResult) return fail();
+    if (hasMore) *hasMore = more;
+    return true;
+}
@@ -0,0 +1,48 @@
+// deribit_parser.h
+#pragma once
+#include <QtGlobal>
+#include <vector>
+
+// 約定1件（POD）。ヒープを使わないよう銘柄名は固定長バッファに持つ
+struct RawTrade {
+    qint64  ts{};            // timestamp(ms)
+    quint64 tradeId{};       // trade_id（数値部分）
+    qint64  tradeSeq{};      // trade_seq（銘柄内の連番。無ければ0）
+    double  amount{};        // 枚数
+    double  price{};         // 約定プレミアム
+    double  iv{};            // payload の iv（無ければ0）
+    double  indexPrice{};    // index_price（約定時点の原資産。無ければ0）
+    double  markPrice{};     // mark_price（無ければ0）
+    quint32 instId{ 0xFFFFFFFFu };  // InstId（エンジン側で解決。未登録は INVALID_INST）
+    qint8   sign{};          // +1=buy, -1=sell
+    quint8  instLen{};
+    char    inst[40]{};      // instrument_name（NUL終端）
+    quint8  tradeIdLen{};
+    char    tradeIdText[24]{};   // 取引所の trade_id そのまま（"BTC-123456" など。表示用、NUL終端）
+};
+
+enum class FrameKind : quint8 {
+    Other,      // 上記以外（従来の QJsonDocument 経路へ）
+    Trades,     // subscription: trades.*
+    Reply,      // RPC 応答（id あり）。本文は解かない
+};
+
+struct FrameInfo {
+    FrameKind kind{ FrameKind::Other };
+    bool      globalChannel{};   // trades.option.* （全体購読）
+    bool      rpcError{};        // Reply で error を含む
+    qint64    rpcId{ -1 };       // Reply の id
+};
+
+// Deribit WS フレームを UTF-8 のまま走査する軽量パーサ。
+// QJsonDocument を組み立てず、使うフィールドだけを RawTrade に詰める。
+namespace DeribitParser {
+    // trades.* の subscription なら out に追記して Trades を返す。
+    // RPC 応答なら id と error の有無だけ拾って Reply（result は読み飛ばすだけ）。
+    // それ以外（ticker・heartbeat 等）は Other を返し、out は変更しない（channel が trades.* でなければ全体は走査しない）。
+    FrameInfo parseFrame(const char* p, qsizetype n, std::vector<RawTrade>& out);
+
+    // REST の約定履歴応答（result が {"trades":[...], "has_more":..} または配列そのもの）を out に追記。
+    // result が無い（error 応答・壊れた本文）なら false を返し、out は変更しない
+    bool parseTradesReply(const char* p, qsizetype n, std::vector<RawTrade>& out, bool* hasMore);
+}
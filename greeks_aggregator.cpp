@@ -1,19 +1,27 @@
 // greeks_aggregator.cpp
 #include "greeks_aggregator.h"
-#include "iv_greeks.h"
+#include "iv_batch.h"
 
 void GreeksAggregator::aggregate(LinkedOrder& g, double S) {
+    // レッグをまとめて1回で解く
+    IvBatchInput in;
+    in.reserve(int(g.legs.size()));
+    for (const auto& l : g.legs)
+        in.push(l.cp == OptionCP::Call, l.premium, S, l.strike, l.tteMin);
+    IvBatchOutput gk;
+    IvBatch::solve(in, gk);
+
     double d = 0, ga = 0, va = 0, ch = 0;
+    int i = 0;
     for (auto& l : g.legs) {
-        const auto cp = (l.cp == OptionCP::Call ? OptionCP::Call : OptionCP::Put);
-        auto gk = IVGreeks::solveAndGreeks(cp, l.premium, S, l.strike, l.tteMin, 0.0, 0.0);
-        l.tradeIV = (l.tradeIV > 0.0 ? l.tradeIV : gk.iv); // 既に外部提供IVがあれば尊重
+        l.tradeIV = (l.tradeIV > 0.0 ? l.tradeIV : gk.iv[i]); // 既に外部提供IVがあれば尊重
         // レッグGreeksを“枚数×乗数”で重み付けして合算
         const double w = l.qty * l.multiplier;
-        d += w * gk.delta;
-        ga += w * gk.gamma;
-        va += w * gk.vanna;
-        ch += w * gk.charm;
+        d += w * gk.delta[i];
+        ga += w * gk.gamma[i];
+        va += w * gk.vanna[i];
+        ch += w * gk.charm[i];
+        ++i;
     }
     g.delta = d; g.gamma = ga; g.vanna = va; g.charm = ch;
 }
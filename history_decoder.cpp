@@ -0,0 +1,53 @@
+// history_decoder.cpp
+#include "history_decoder.h"
+#include <QThread>
+#include <algorithm>
+
+HistoryDecoder::HistoryDecoder(QObject* parent) : QObject(parent) {
+    // GUI と受信スレッドの分を残す（応答1件は数ミリ秒なので数本で足りる）
+    m_pool.setMaxThreadCount(std::clamp(QThread::idealThreadCount() - 2, 1, 4));
+    m_pool.setObjectName(QStringLiteral("HistoryDecoder"));
+}
+
+HistoryDecoder::~HistoryDecoder() {
+    m_pool.clear();
+    m_pool.waitForDone();   // 実行中の解析が this へ投げ返す前に止める
+}
+
+HistoryBatch HistoryDecoder::decodeNow(const QByteArray& body, const InstrumentRegistry* reg) {
+    HistoryBatch b;
+    b.ok = DeribitParser::parseTradesReply(body.constData(), body.size(), b.trades, &b.hasMore);
+    if (!b.ok) return b;
+
+    if (reg) {
+        for (RawTrade& t : b.trades) t.instId = reg->find(t.inst, t.instLen);
+    }
+    // 取得順（昇順/降順）に関わらず時刻順で返す。同時刻は応答内の順
+    if (!std::is_sorted(b.trades.begin(), b.trades.end(),
+            [](const RawTrade& a, const RawTrade& c) { return a.ts < c.ts; }))
+        std::stable_sort(b.trades.begin(), b.trades.end(),
+            [](const RawTrade& a, const RawTrade& c) { return a.ts < c.ts; });
+    return b;
+}
+
+void HistoryDecoder::decode(const QByteArray& body, Handler done) {
+    ++m_pending;
+    const quint64 seq = m_nextSeq++;
+    m_pool.start([this, seq, body, reg = m_reg, done = std::move(done)]() mutable {
+        auto batch = std::make_shared<HistoryBatch>(decodeNow(body, reg.get()));
+        QMetaObject::invokeMethod(this, [this, seq, batch, done = std::move(done)]() mutable {
+            deliver(seq, Ready{ batch, std::move(done) });
+            }, Qt::QueuedConnection);
+        });
+}
+
+void HistoryDecoder::deliver(quint64 seq, Ready r) {
+    m_ready.insert(seq, std::move(r));
+    // 先頭から途切れずに揃った分だけ順に渡す（done の中で decode が呼ばれても番号は後ろに付く）
+    while (!m_ready.isEmpty() && m_ready.firstKey() == m_nextDeliver) {
+        Ready next = m_ready.take(m_nextDeliver);
+        ++m_nextDeliver;
+        --m_pending;
+        next.done(*next.batch);
+    }
+}
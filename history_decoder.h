@@ -0,0 +1,54 @@
+// history_decoder.h
+#pragma once
+#include <QObject>
+#include <QByteArray>
+#include <QThreadPool>
+#include <QMap>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "deribit_parser.h"
+#include "instrument_registry.h"
+
+// REST 約定履歴1応答ぶんの解析結果（時刻昇順・InstId 解決済み）
+struct HistoryBatch {
+    std::vector<RawTrade> trades;
+    bool ok{ false };          // result を読めた（false なら error 応答か壊れた本文）
+    bool hasMore{ false };
+};
+
+// 約定履歴応答の解析をワーカープールで回し、結果だけを GUI スレッドへ返す。
+// 取り込み側は1応答＝1バッチで反映する（応答を待つ間も GUI は止まらない）。
+// 解析の終わる順はばらつくので、done は decode を呼んだ順に呼ぶ（先の応答が終わるまで後のは待たせる）
+class HistoryDecoder : public QObject {
+    Q_OBJECT
+public:
+    using Handler = std::function<void(HistoryBatch&)>;
+
+    explicit HistoryDecoder(QObject* parent = nullptr);
+    ~HistoryDecoder();
+
+    // 銘柄表の差し替え（GUI スレッド）。以降の解析で InstId に解決する
+    void setRegistry(std::shared_ptr<const InstrumentRegistry> reg) { m_reg = std::move(reg); }
+
+    // body を裏で解き、完了したら GUI スレッドで done を呼ぶ
+    void decode(const QByteArray& body, Handler done);
+    int  pending() const { return m_pending; }
+
+    // 同期版（どのスレッドからでも可）
+    static HistoryBatch decodeNow(const QByteArray& body, const InstrumentRegistry* reg);
+
+private:
+    struct Ready {
+        std::shared_ptr<HistoryBatch> batch;
+        Handler done;
+    };
+    void deliver(quint64 seq, Ready r);
+
+    QThreadPool m_pool;
+    std::shared_ptr<const InstrumentRegistry> m_reg;
+    int m_pending{ 0 };
+    quint64 m_nextSeq{ 0 };               // 次に振る受付番号
+    quint64 m_nextDeliver{ 0 };           // 次に done を呼ぶ受付番号
+    QMap<quint64, Ready> m_ready;         // 解析済みで順番待ちの分
+};
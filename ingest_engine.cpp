@@ -0,0 +1,70 @@
+// ingest_engine.cpp
+#include "ingest_engine.h"
+#include "WebSocketClient.h"
+
+IngestEngine::IngestEngine(QObject* parent) : QObject(parent) {
+    m_thread.setObjectName(QStringLiteral("IngestEngine"));
+
+    m_ws = new WebSocketClient();   // 親なし（スレッド移動のため）
+    m_ws->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_ws, &QObject::deleteLater);
+
+    // 約定はエンジンスレッド上でそのままキューへ（GUI を経由しない）
+    connect(m_ws, &WebSocketClient::tradesReceived, m_ws,
+        [this](const std::vector<RawTrade>& trades, bool isGlobal) { onTrades(trades, isGlobal); },
+        Qt::DirectConnection);
+}
+
+IngestEngine::~IngestEngine() {
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void IngestEngine::start() {
+    if (m_thread.isRunning()) return;
+    m_thread.start();
+    QMetaObject::invokeMethod(m_ws, &WebSocketClient::connectPublic, Qt::QueuedConnection);
+}
+
+void IngestEngine::setRegistry(std::shared_ptr<const InstrumentRegistry> reg) {
+    std::atomic_store(&m_reg, std::move(reg));
+}
+
+void IngestEngine::onTrades(const std::vector<RawTrade>& trades, bool isGlobal) {
+    IngestBatch b;
+    b.trades = trades;
+    b.isGlobal = isGlobal;
+
+    // 銘柄名→ID は約定ごとにここで1回だけ
+    const auto reg = std::atomic_load(&m_reg);
+    if (reg) {
+        for (RawTrade& t : b.trades) t.instId = reg->find(t.inst, t.instLen);
+    }
+    enqueue(std::move(b));
+}
+
+void IngestEngine::enqueue(IngestBatch&& b) {
+    // 退避分が残っていれば先に流す（到着順を崩さない）
+    if (!m_backlog.empty()) flushBacklog();
+    if (!m_backlog.empty() || !m_queue.push(std::move(b))) {
+        m_backlog.push_back(std::move(b));
+        m_hasBacklog.store(true, std::memory_order_release);
+    }
+    if (!m_notified.exchange(true, std::memory_order_acq_rel)) emit batchesReady();
+}
+
+void IngestEngine::flushBacklog() {
+    while (!m_backlog.empty()) {
+        if (!m_queue.push(std::move(m_backlog.front()))) break;
+        m_backlog.pop_front();
+    }
+    m_hasBacklog.store(!m_backlog.empty(), std::memory_order_release);
+}
+
+void IngestEngine::requestBacklogFlush() {
+    // GUI が空けた分をエンジンスレッドで詰め直す
+    QMetaObject::invokeMethod(m_ws, [this] {
+        flushBacklog();
+        if (!m_queue.empty() && !m_notified.exchange(true, std::memory_order_acq_rel)) emit batchesReady();
+        }, Qt::QueuedConnection);
+}
@@ -0,0 +1,67 @@
+// ingest_engine.h
+#pragma once
+#include <QObject>
+#include <QThread>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "deribit_parser.h"
+#include "instrument_registry.h"
+#include "spsc_queue.h"
+
+class WebSocketClient;
+
+// 受信1フレーム分の約定（GUI 側は読むだけ）
+struct IngestBatch {
+    std::vector<RawTrade> trades;
+    bool isGlobal{};
+};
+
+// WS 受信とフレーム解析を専用スレッドで回し、結果を SPSC キューで GUI へ渡す。
+// GUI が重い描画で詰まっても、ソケットの読み出しは止まらない。
+class IngestEngine : public QObject {
+    Q_OBJECT
+public:
+    explicit IngestEngine(QObject* parent = nullptr);
+    ~IngestEngine();
+
+    // エンジンスレッド上で動く WS（call/subscribe は任意スレッドから可）
+    WebSocketClient* ws() const { return m_ws; }
+
+    void start();   // スレッド起動＋接続
+
+    // 銘柄表の差し替え（任意スレッド）。以降の約定は受信スレッドで InstId に解決される
+    void setRegistry(std::shared_ptr<const InstrumentRegistry> reg);
+
+    // GUI スレッドから呼ぶ。溜まっているバッチを順に f へ渡し、件数を返す
+    template <typename F>
+    int drain(F&& f) {
+        m_notified.store(false, std::memory_order_release);
+        int n = 0;
+        IngestBatch b;
+        while (m_queue.pop(b)) { f(static_cast<const IngestBatch&>(b)); ++n; }
+        if (m_hasBacklog.load(std::memory_order_acquire)) requestBacklogFlush();
+        return n;
+    }
+
+signals:
+    void batchesReady();   // 空→非空になった時だけ発火（GUI へ queued）
+
+private:
+    // 以下はエンジンスレッド専用
+    void onTrades(const std::vector<RawTrade>& trades, bool isGlobal);
+    void enqueue(IngestBatch&& b);
+    void flushBacklog();
+    void requestBacklogFlush();
+
+    QThread          m_thread;
+    WebSocketClient* m_ws{ nullptr };
+
+    static constexpr std::size_t QUEUE_CAP = 4096;
+    SpscQueue<IngestBatch, QUEUE_CAP> m_queue;
+    std::shared_ptr<const InstrumentRegistry> m_reg;   // std::atomic_load/store で受け渡し
+    std::deque<IngestBatch> m_backlog;        // キュー満杯時の退避（順序は保つ）
+    std::atomic<bool> m_hasBacklog{ false };
+    std::atomic<bool> m_notified{ false };
+};
@@ -0,0 +1,65 @@
+// instrument_registry.cpp
+#include "instrument_registry.h"
+#include <QJsonObject>
+#include <algorithm>
+
+int InstrumentRegistry::ingest(const QJsonArray& instruments) {
+    // 今回の一覧に無いものは非生存扱い（IDと属性は残す）
+    std::fill(m_active.begin(), m_active.end(), quint8(0));
+
+    int added = 0;
+    for (const auto& v : instruments) {
+        if (!v.isObject()) continue;
+        const auto o = v.toObject();
+        if (!o.value("is_active").toBool(true)) continue;
+        const QString name = o.value("instrument_name").toString();
+        const qint64  exp = (qint64)o.value("expiration_timestamp").toDouble();
+        if (name.isEmpty() || exp <= 0) continue;
+
+        const QByteArray key = name.toLatin1();
+        auto it = m_byName.constFind(key);
+        InstId id;
+        if (it != m_byName.constEnd()) {
+            id = it.value();
+        }
+        else {
+            id = InstId(m_name.size());
+            m_byName.insert(key, id);
+            m_name.push_back(name);
+            m_strike.push_back(0.0);
+            m_expiry.push_back(0);
+            m_tick.push_back(0.0);
+            m_isCall.push_back(0);
+            m_active.push_back(0);
+            ++added;
+        }
+
+        const int i = int(id);
+        m_strike[i] = o.value("strike").toDouble();
+        m_expiry[i] = exp;
+        m_tick[i] = o.value("tick_size").toDouble();
+        m_isCall[i] = (o.value("option_type").toString() == QLatin1String("call")) ? 1 : 0;
+        m_active[i] = 1;
+    }
+    return added;
+}
+
+InstId InstrumentRegistry::find(const char* name, int len) const {
+    if (!name || len <= 0) return INVALID_INST;
+    return m_byName.value(QByteArray::fromRawData(name, len), INVALID_INST);
+}
+
+InstId InstrumentRegistry::find(const QString& name) const {
+    if (name.isEmpty()) return INVALID_INST;
+    return m_byName.value(name.toLatin1(), INVALID_INST);
+}
+
+QVector<qint64> InstrumentRegistry::activeExpiries() const {
+    QVector<qint64> exps;
+    exps.reserve(m_expiry.size());
+    for (int i = 0; i < m_expiry.size(); ++i)
+        if (m_active[i]) exps.push_back(m_expiry[i]);
+    std::sort(exps.begin(), exps.end());
+    exps.erase(std::unique(exps.begin(), exps.end()), exps.end());
+    return exps;
+}
@@ -0,0 +1,46 @@
+// instrument_registry.h
+#pragma once
+#include <QtGlobal>
+#include <QByteArray>
+#include <QHash>
+#include <QJsonArray>
+#include <QString>
+#include <QVector>
+
+// 銘柄ID（0 から始まる連番）。一度振ったIDは再取得しても変わらない
+using InstId = quint32;
+static constexpr InstId INVALID_INST = 0xFFFFFFFFu;
+
+// public/get_instruments から作る銘柄表。
+// 名前→ID の解決は1回だけ行い、以降は ID で属性配列を引く（文字列の分解をしない）
+class InstrumentRegistry {
+public:
+    // get_instruments の result を反映。既存はIDを保ったまま更新、新規は末尾に追加。
+    // 戻り値は新規に振ったID数
+    int ingest(const QJsonArray& instruments);
+
+    InstId find(const char* name, int len) const;   // 割り当てなしで検索
+    InstId find(const QString& name) const;
+
+    int  size() const { return int(m_name.size()); }
+    bool valid(InstId id) const { return id < InstId(m_name.size()); }
+
+    const QString& name(InstId id) const { return m_name[int(id)]; }
+    double strike(InstId id)   const { return m_strike[int(id)]; }
+    qint64 expiryMs(InstId id) const { return m_expiry[int(id)]; }
+    bool   isCall(InstId id)   const { return m_isCall[int(id)] != 0; }
+    double tickSize(InstId id) const { return m_tick[int(id)]; }
+    bool   isActive(InstId id) const { return m_active[int(id)] != 0; }
+
+    // 生存銘柄の満期（昇順・重複なし）
+    QVector<qint64> activeExpiries() const;
+
+private:
+    QHash<QByteArray, InstId> m_byName;   // instrument_name(Latin-1) → ID
+    QVector<QString> m_name;
+    QVector<double>  m_strike;
+    QVector<qint64>  m_expiry;
+    QVector<double>  m_tick;
+    QVector<quint8>  m_isCall;
+    QVector<quint8>  m_active;
+};
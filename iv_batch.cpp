@@ -0,0 +1,336 @@
+// iv_batch.cpp
+#include "iv_batch.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define IVB_AVX2 1
+#endif
+
+namespace {
+
+constexpr double MIN_PER_YEAR = 365.0 * 24.0 * 60.0;
+constexpr double INV_SQRT_2PI = 0.39894228040143267794;
+constexpr double SQRT_2PI = 2.50662827463100050242;
+constexpr double INV_SQRT2 = 0.70710678118654752440;
+constexpr int    HALLEY_ITERS = 5;      // 初期値からこの回数で相対誤差 1e-10 以下（x∈[-2,2], σ√T∈[0.003,2]）
+constexpr double S_MIN = 1e-5;
+constexpr double S_MAX = 8.0;
+
+// ---- 前処理（スカラー） ----
+// x = ln(F/K), p = OTM 側の価格/F, s0 = 初期値（σ√T）
+struct Prep {
+    QVector<double> x, lp, k, s, sqrtT;
+    QVector<quint8> otmCall, valid;
+
+    void resize(int n) {
+        x.resize(n); lp.resize(n); k.resize(n); s.resize(n); sqrtT.resize(n);
+        otmCall.resize(n); valid.resize(n);
+    }
+};
+
+void prepareRow(const IvBatchInput& in, int i, Prep& pr) {
+    const double F = in.spot[i], K = in.strike[i], px = in.premium[i], tm = in.tteMin[i];
+    pr.valid[i] = 0;
+    pr.x[i] = 0.0; pr.lp[i] = 0.0; pr.k[i] = 1.0; pr.s[i] = 0.1; pr.sqrtT[i] = 1.0; pr.otmCall[i] = 1;
+    if (!(F > 0.0) || !(K > 0.0) || !(px > 0.0) || !(tm > 0.0)) return;
+
+    // コール換算（パリティ）→ OTM 側へ
+    const double c = in.isCall[i] ? px * F : px * F + (F - K);
+    const bool otmCall = (K >= F);
+    const double p = (otmCall ? c : c - (F - K)) / F;
+    const double k = K / F;
+    if (!(p > 0.0)) return;                      // 本質価値以下
+    if (otmCall ? p >= 1.0 : p >= k) return;     // 上限超え
+
+    const double x = std::log(F / K);
+    const double s0 = std::max(SQRT_2PI * p, std::sqrt(2.0 * std::fabs(x)));
+
+    pr.x[i] = x;
+    pr.lp[i] = std::log(p);
+    pr.k[i] = k;
+    pr.s[i] = std::clamp(s0, 1e-4, 5.0);
+    pr.sqrtT[i] = std::sqrt(tm / MIN_PER_YEAR);
+    pr.otmCall[i] = otmCall ? 1 : 0;
+    pr.valid[i] = 1;
+}
+
+// ---- 本体：V/M を差し替えてスカラーと AVX2 で共用 ----
+struct ScalarOps {
+    using V = double;
+    using M = bool;
+    static V set1(double a) { return a; }
+    static V exp(V a) { return std::exp(a); }
+    static V log(V a) { return std::log(a); }
+    static V erfc(V a) { return std::erfc(a); }
+    static V sqrt(V a) { return std::sqrt(a); }
+    static V abs(V a) { return std::fabs(a); }
+    static V min(V a, V b) { return a < b ? a : b; }
+    static V max(V a, V b) { return a > b ? a : b; }
+    static M gt(V a, V b) { return a > b; }
+    static V sel(M m, V a, V b) { return m ? a : b; }
+};
+
+template <class O>
+inline typename O::V normCdf(typename O::V z) {
+    return O::set1(0.5) * O::erfc(O::set1(-INV_SQRT2) * z);
+}
+
+template <class O>
+inline typename O::V normPdf(typename O::V z) {
+    return O::set1(INV_SQRT_2PI) * O::exp(O::set1(-0.5) * z * z);
+}
+
+// OTM 側価格の対数に対する Halley 反復。s は σ√T
+template <class O>
+inline typename O::V halley(typename O::V x, typename O::V k, typename O::V lp,
+                            typename O::M isCall, typename O::V s) {
+    using V = typename O::V;
+    const V one = O::set1(1.0), half = O::set1(0.5), two = O::set1(2.0);
+    const V tiny = O::set1(1e-300);
+    for (int it = 0; it < HALLEY_ITERS; ++it) {
+        const V d1 = x / s + half * s;
+        const V d2 = d1 - s;
+        const V nd1 = normCdf<O>(d1), nd2 = normCdf<O>(d2);
+        const V callP = nd1 - k * nd2;
+        const V putP = k * (one - nd2) - (one - nd1);
+        const V P = O::max(O::sel(isCall, callP, putP), tiny);
+
+        const V v = normPdf<O>(d1);
+        const V g = O::log(P) - lp;
+        const V g1 = v / P;
+        const V g2 = v * d1 * d2 / (s * P) - g1 * g1;
+        const V den = two * g1 * g1 - g * g2;
+        const V step = O::sel(O::gt(O::abs(den), tiny), two * g * g1 / den, g / g1);
+        const V lo = O::max(O::set1(S_MIN), s * O::set1(0.25));
+        const V hi = O::min(O::set1(S_MAX), s * O::set1(4.0));
+        s = O::min(O::max(s - step, lo), hi);
+    }
+    return s;
+}
+
+// s から IV とグリークス。call は元の種別（OTM 側ではない）
+template <class O>
+inline void greeksFrom(typename O::V x, typename O::V s, typename O::V sqrtT, typename O::V F,
+                       typename O::M call,
+                       typename O::V& iv, typename O::V& delta, typename O::V& gamma,
+                       typename O::V& vega, typename O::V& vanna, typename O::V& charm) {
+    using V = typename O::V;
+    const V d1 = x / s + O::set1(0.5) * s;
+    const V d2 = d1 - s;
+    const V pdf = normPdf<O>(d1);
+    const V cdf = normCdf<O>(d1);
+    const V sigma = s / sqrtT;
+    const V T = sqrtT * sqrtT;
+
+    iv = sigma * O::set1(100.0);
+    delta = O::sel(call, cdf, cdf - O::set1(1.0));
+    gamma = pdf / (F * s);
+    vega = F * pdf * sqrtT * O::set1(0.01);
+    vanna = O::set1(-0.01) * pdf * d2 / sigma;
+    charm = pdf * d2 / (O::set1(2.0 * 365.0) * T);
+}
+
+void solveScalarRange(const IvBatchInput& in, const Prep& pr, IvBatchOutput& out, int from, int to) {
+    using O = ScalarOps;
+    for (int i = from; i < to; ++i) {
+        if (!pr.valid[i]) {
+            out.iv[i] = out.delta[i] = out.gamma[i] = out.vega[i] = out.vanna[i] = out.charm[i] = 0.0;
+            continue;
+        }
+        const double s = halley<O>(pr.x[i], pr.k[i], pr.lp[i], pr.otmCall[i] != 0, pr.s[i]);
+        greeksFrom<O>(pr.x[i], s, pr.sqrtT[i], in.spot[i], in.isCall[i] != 0,
+                      out.iv[i], out.delta[i], out.gamma[i], out.vega[i], out.vanna[i], out.charm[i]);
+    }
+}
+
+#ifdef IVB_AVX2
+// ---- AVX2（4 x double） ----
+struct V4 {
+    __m256d v;
+};
+struct M4 {
+    __m256d m;
+};
+
+inline V4 operator+(V4 a, V4 b) { return { _mm256_add_pd(a.v, b.v) }; }
+inline V4 operator-(V4 a, V4 b) { return { _mm256_sub_pd(a.v, b.v) }; }
+inline V4 operator*(V4 a, V4 b) { return { _mm256_mul_pd(a.v, b.v) }; }
+inline V4 operator/(V4 a, V4 b) { return { _mm256_div_pd(a.v, b.v) }; }
+
+struct Avx2Ops {
+    using V = V4;
+    using M = M4;
+
+    static V set1(double a) { return { _mm256_set1_pd(a) }; }
+    static V sqrt(V a) { return { _mm256_sqrt_pd(a.v) }; }
+    static V abs(V a) { return { _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v) }; }
+    static V min(V a, V b) { return { _mm256_min_pd(a.v, b.v) }; }
+    static V max(V a, V b) { return { _mm256_max_pd(a.v, b.v) }; }
+    static M gt(V a, V b) { return { _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; }
+    static V sel(M m, V a, V b) { return { _mm256_blendv_pd(b.v, a.v, m.m) }; }
+
+    // exp: x = n ln2 + r, |r| <= ln2/2。e^r は 11次まで、2^n は指数部へ直接
+    static V exp(V a) {
+        const __m256d x = _mm256_min_pd(_mm256_max_pd(a.v, _mm256_set1_pd(-708.0)), _mm256_set1_pd(709.0));
+        const __m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.4426950408889634074)),
+                                          _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256d r = _mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(6.93147180369123816490e-01)));
+        r = _mm256_sub_pd(r, _mm256_mul_pd(n, _mm256_set1_pd(1.90821492927058770002e-10)));
+
+        static constexpr double C[] = {
+            1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0,
+            1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0 };
+        __m256d p = _mm256_set1_pd(C[0]);
+        for (int i = 1; i < 12; ++i) p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(C[i]));
+
+        // n（整数値の double）→ int64：1.5*2^52 を足すと下位ビットにそのまま乗る
+        const __m256d magic = _mm256_set1_pd(6755399441055744.0);
+        const __m256i ni = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(n, magic)),
+                                            _mm256_castpd_si256(magic));
+        const __m256i bits = _mm256_slli_epi64(_mm256_add_epi64(ni, _mm256_set1_epi64x(1023)), 52);
+        return { _mm256_mul_pd(p, _mm256_castsi256_pd(bits)) };
+    }
+
+    // log（正の正規数のみ）：x = m 2^e, m∈[√½, √2)、ln m = 2 atanh((m-1)/(m+1))
+    static V log(V a) {
+        const __m256i bits = _mm256_castpd_si256(a.v);
+        __m256i e = _mm256_sub_epi64(_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(1023));
+        __m256d m = _mm256_castsi256_pd(_mm256_or_si256(
+            _mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFll)),
+            _mm256_set1_epi64x(0x3FF0000000000000ll)));
+        const __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(1.41421356237309504880), _CMP_GT_OQ);
+        m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+        e = _mm256_sub_epi64(e, _mm256_castpd_si256(big));     // 真のレーンは -1 → e+1
+
+        const __m256d magic = _mm256_set1_pd(6755399441055744.0);
+        const __m256d ed = _mm256_sub_pd(
+            _mm256_castsi256_pd(_mm256_add_epi64(e, _mm256_castpd_si256(magic))), magic);
+
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d t = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one));
+        const __m256d t2 = _mm256_mul_pd(t, t);
+        static constexpr double C[] = {
+            1.0 / 17.0, 1.0 / 15.0, 1.0 / 13.0, 1.0 / 11.0, 1.0 / 9.0, 1.0 / 7.0, 1.0 / 5.0, 1.0 / 3.0, 1.0 };
+        __m256d p = _mm256_set1_pd(C[0]);
+        for (int i = 1; i < 9; ++i) p = _mm256_add_pd(_mm256_mul_pd(p, t2), _mm256_set1_pd(C[i]));
+        const __m256d lnm = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(2.0), t), p);
+        return { _mm256_add_pd(_mm256_mul_pd(ed, _mm256_set1_pd(0.69314718055994530942)), lnm) };
+    }
+
+    // erfc: Chebyshev 近似（相対誤差 < 1.2e-7、裾でも相対精度を保つ）
+    static V erfc(V a) {
+        const __m256d z = abs(a).v;
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d t = _mm256_div_pd(one, _mm256_add_pd(one, _mm256_mul_pd(_mm256_set1_pd(0.5), z)));
+        static constexpr double C[] = {
+            0.17087277, -0.82215223, 1.48851587, -1.13520398, 0.27886807,
+            -0.18628806, 0.09678418, 0.37409196, 1.00002368, -1.26551223 };
+        __m256d p = _mm256_set1_pd(C[0]);
+        for (int i = 1; i < 10; ++i) p = _mm256_add_pd(_mm256_mul_pd(p, t), _mm256_set1_pd(C[i]));
+        const __m256d arg = _mm256_sub_pd(p, _mm256_mul_pd(z, z));
+        const __m256d r = _mm256_mul_pd(t, exp(V{ arg }).v);
+        const __m256d neg = _mm256_cmp_pd(a.v, _mm256_setzero_pd(), _CMP_LT_OQ);
+        return { _mm256_blendv_pd(r, _mm256_sub_pd(_mm256_set1_pd(2.0), r), neg) };
+    }
+};
+
+inline V4 load(const QVector<double>& v, int i) { return { _mm256_loadu_pd(v.constData() + i) }; }
+inline void store(QVector<double>& v, int i, V4 a) { _mm256_storeu_pd(v.data() + i, a.v); }
+
+inline M4 loadMask(const QVector<quint8>& v, int i) {
+    const __m256d m = _mm256_castsi256_pd(_mm256_set_epi64x(
+        v[i + 3] ? -1ll : 0ll, v[i + 2] ? -1ll : 0ll, v[i + 1] ? -1ll : 0ll, v[i] ? -1ll : 0ll));
+    return { m };
+}
+
+// 無効行は前処理で x=0,p 適当,s=0.1 にしてあるので計算自体は無害。結果だけ 0 で潰す
+void solveAvx2Range(const IvBatchInput& in, const Prep& pr, IvBatchOutput& out, int from, int to) {
+    using O = Avx2Ops;
+    for (int i = from; i < to; i += 4) {
+        const V4 x = load(pr.x, i);
+        const V4 s = halley<O>(x, load(pr.k, i), load(pr.lp, i), loadMask(pr.otmCall, i), load(pr.s, i));
+
+        V4 iv, delta, gamma, vega, vanna, charm;
+        greeksFrom<O>(x, s, load(pr.sqrtT, i), load(in.spot, i), loadMask(in.isCall, i),
+                      iv, delta, gamma, vega, vanna, charm);
+
+        const __m256d ok = loadMask(pr.valid, i).m;
+        auto z = [&](V4 a) { return V4{ _mm256_and_pd(a.v, ok) }; };
+        store(out.iv, i, z(iv));
+        store(out.delta, i, z(delta));
+        store(out.gamma, i, z(gamma));
+        store(out.vega, i, z(vega));
+        store(out.vanna, i, z(vanna));
+        store(out.charm, i, z(charm));
+    }
+}
+#endif
+
+} // namespace
+
+void IvBatchInput::reserve(int n) {
+    isCall.reserve(n); premium.reserve(n); spot.reserve(n); strike.reserve(n); tteMin.reserve(n);
+}
+
+void IvBatchInput::push(bool call, double premiumUnderlying, double S, double K, double minutes) {
+    isCall.push_back(call ? 1 : 0);
+    premium.push_back(premiumUnderlying);
+    spot.push_back(S);
+    strike.push_back(K);
+    tteMin.push_back(minutes);
+}
+
+void IvBatchInput::clear() {
+    isCall.clear(); premium.clear(); spot.clear(); strike.clear(); tteMin.clear();
+}
+
+bool IvBatch::simdEnabled() {
+#ifdef IVB_AVX2
+    return true;
+#else
+    return false;
+#endif
+}
+
+void IvBatch::solve(const IvBatchInput& in, IvBatchOutput& out) {
+    const int n = in.size();
+    out.iv.resize(n); out.delta.resize(n); out.gamma.resize(n);
+    out.vega.resize(n); out.vanna.resize(n); out.charm.resize(n);
+    if (n == 0) return;
+
+    Prep pr;
+    pr.resize(n);
+    for (int i = 0; i < n; ++i) prepareRow(in, i, pr);
+
+    int done = 0;
+#ifdef IVB_AVX2
+    done = n & ~3;
+    solveAvx2Range(in, pr, out, 0, done);
+#endif
+    solveScalarRange(in, pr, out, done, n);
+}
+
+IvGreeksRow IvBatch::solveOne(bool call, double premiumUnderlying, double S, double K, double minutes) {
+    IvBatchInput in;
+    in.push(call, premiumUnderlying, S, K, minutes);
+    Prep pr;
+    pr.resize(1);
+    prepareRow(in, 0, pr);
+
+    IvBatchOutput out;
+    out.iv.resize(1); out.delta.resize(1); out.gamma.resize(1);
+    out.vega.resize(1); out.vanna.resize(1); out.charm.resize(1);
+    solveScalarRange(in, pr, out, 0, 1);
+    return IvGreeksRow{ out.iv[0], out.delta[0], out.gamma[0], out.vega[0], out.vanna[0], out.charm[0] };
+}
+
+IvGreeksRow IvBatch::greeksAt(bool call, double S, double K, double minutes, double ivPct) {
+    IvGreeksRow r;
+    if (!(S > 0.0) || !(K > 0.0) || !(minutes > 0.0) || !(ivPct > 0.0)) return r;
+    const double sqrtT = std::sqrt(minutes / MIN_PER_YEAR);
+    const double s = ivPct * 0.01 * sqrtT;
+    greeksFrom<ScalarOps>(std::log(S / K), s, sqrtT, S, call, r.iv, r.delta, r.gamma, r.vega, r.vanna, r.charm);
+    return r;
+}
@@ -0,0 +1,45 @@
+// iv_batch.h
+#pragma once
+#include <QtGlobal>
+#include <QVector>
+
+// Black-76（r=0）の IV とグリークスを配列でまとめて解く。
+// AVX2 でビルドされていれば4本ずつ、そうでなければスカラーで同じ手順を回す。
+//   入力 : プレミアム（原資産建て＝Deribit の BTC 価格）, S, K（USD）, 残存（分）
+//   出力 : iv は % 表記（mark_iv と同じ）。解けない行は全項目 0
+//   単位 : vega/vanna は IV 1% あたり、charm は 1日あたりの Δ変化
+// 初期値は閉形式（ATM 近似と変曲点の大きい方）、その後 OTM 側価格の対数に Halley 法を固定回数。
+struct IvBatchInput {
+    QVector<quint8> isCall;
+    QVector<double> premium;
+    QVector<double> spot;
+    QVector<double> strike;
+    QVector<double> tteMin;
+
+    void reserve(int n);
+    void push(bool call, double premiumUnderlying, double S, double K, double minutes);
+    int  size() const { return int(premium.size()); }
+    void clear();
+};
+
+struct IvBatchOutput {
+    QVector<double> iv;
+    QVector<double> delta;
+    QVector<double> gamma;
+    QVector<double> vega;
+    QVector<double> vanna;
+    QVector<double> charm;
+};
+
+struct IvGreeksRow {
+    double iv{}, delta{}, gamma{}, vega{}, vanna{}, charm{};
+};
+
+namespace IvBatch {
+    void solve(const IvBatchInput& in, IvBatchOutput& out);
+    // 1件だけ（約定1件ごとの経路向け）
+    IvGreeksRow solveOne(bool call, double premiumUnderlying, double S, double K, double minutes);
+    // IV（%）が既知の時のグリークス（逆算しない。単位は solve と同じ。入力が不正なら全項目 0）
+    IvGreeksRow greeksAt(bool call, double S, double K, double minutes, double ivPct);
+    bool simdEnabled();   // AVX2 経路でビルドされているか
+}
@@ -1,19 +1,99 @@
 // nbbo_store.cpp
 #include "nbbo_store.h"
+#include <algorithm>
 #include <cmath>
 
-void NbboStore::update(const QString& inst, double bid, double ask) {
-    if (inst.isEmpty() || bid <= 0.0 || ask <= 0.0 || ask < bid) return;
-    m_nbbo[inst] = NbboSnap{ bid, ask };
+void NbboStore::Ring::push(qint64 t, double b, double a) {
+    if (size() < CAPACITY) {
+        // 満杯までは末尾に伸ばすだけ（start は 0 のまま）
+        ts.push_back(t); until.push_back(t); bid.push_back(b); ask.push_back(a);
+        return;
+    }
+    // 最古を上書きして start を進める
+    ts[start] = t; until[start] = t; bid[start] = b; ask[start] = a;
+    start = (start + 1) % CAPACITY;
 }
 
-NbboSnap NbboStore::get(const QString& inst) const {
-    auto it = m_nbbo.find(inst);
-    return (it != m_nbbo.end()) ? it.value() : NbboSnap{};
+const NbboStore::Ring* NbboStore::ring(InstId inst) const {
+    if (inst == INVALID_INST || int(inst) >= m_rings.size()) return nullptr;
+    const Ring& r = m_rings[int(inst)];
+    return r.size() > 0 ? &r : nullptr;
 }
 
-Aggressor NbboStore::inferAggressor(const QString& inst, double tradePx, double* bpDiffBp) const {
-    const auto nb = get(inst);
+void NbboStore::update(InstId inst, qint64 ts, double bid, double ask) {
+    if (inst == INVALID_INST || bid <= 0.0 || ask <= 0.0 || ask < bid) return;
+    if (int(inst) >= m_rings.size()) m_rings.resize(int(inst) + 1);
+    Ring& r = m_rings[int(inst)];
+
+    if (r.size() > 0) {
+        const int last = r.lastPhys();
+        if (ts < r.ts[last]) return;                         // 遅れて来た古い気配は捨てる（過去分は seed で）
+        if (r.bid[last] == bid && r.ask[last] == ask) {      // 変化なし → 有効期間を伸ばすだけ
+            r.until[last] = std::max(r.until[last], ts);
+            return;
+        }
+        if (ts == r.ts[last]) {                               // 同じ ms の更新は上書き
+            r.bid[last] = bid; r.ask[last] = ask;
+            return;
+        }
+        r.until[last] = ts;                                   // 次の気配が来るまでは有効だった
+    }
+    r.push(ts, bid, ask);
+}
+
+void NbboStore::seed(InstId inst, const QVector<NbboPoint>& pts) {
+    if (inst == INVALID_INST || pts.isEmpty()) return;
+    if (int(inst) >= m_rings.size()) m_rings.resize(int(inst) + 1);
+    Ring& r = m_rings[int(inst)];
+
+    // 既存分と合わせて時刻順に並べ直し、新しい方から CAPACITY 点を残す
+    QVector<NbboPoint> all;
+    all.reserve(r.size() + pts.size());
+    for (int i = 0; i < r.size(); ++i) {
+        const int p = r.phys(i);
+        all.push_back(NbboPoint{ r.ts[p], r.bid[p], r.ask[p] });
+    }
+    const qint64 lastUntil = r.size() > 0 ? r.until[r.lastPhys()] : 0;
+    for (const NbboPoint& p : pts)
+        if (p.bid > 0.0 && p.ask > 0.0 && p.ask >= p.bid) all.push_back(p);
+    std::stable_sort(all.begin(), all.end(), [](const NbboPoint& a, const NbboPoint& b) { return a.ts < b.ts; });
+
+    Ring out;
+    for (const NbboPoint& p : all) {
+        if (out.size() > 0) {
+            const int last = out.lastPhys();
+            if (out.ts[last] == p.ts) { out.bid[last] = p.bid; out.ask[last] = p.ask; continue; }
+            if (out.bid[last] == p.bid && out.ask[last] == p.ask) { out.until[last] = p.ts; continue; }
+            out.until[last] = p.ts;
+        }
+        out.push(p.ts, p.bid, p.ask);
+    }
+    if (out.size() > 0) {
+        const int last = out.lastPhys();
+        out.until[last] = std::max(out.until[last], lastUntil);
+    }
+    r = std::move(out);
+}
+
+NbboSnap NbboStore::at(InstId inst, qint64 ts) const {
+    const Ring* r = ring(inst);
+    if (!r) return NbboSnap{};
+
+    // ts 以下で最後の点（論理添字で二分探索）
+    int lo = 0, hi = r->size();
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (r->ts[r->phys(mid)] <= ts) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return NbboSnap{};                          // 記録より前
+    const int p = r->phys(lo - 1);
+    if (ts > r->until[p] + MAX_STALE_MS) return NbboSnap{};   // 確認が途切れてから時間が経ちすぎ
+    return NbboSnap{ r->bid[p], r->ask[p] };
+}
+
+Aggressor NbboStore::inferAggressor(InstId inst, qint64 ts, double tradePx, double* bpDiffBp) const {
+    const auto nb = at(inst, ts - 1);                         // 約定で動いた後の気配を使わない
     if (!nb.valid() || tradePx <= 0.0) return Aggressor::Unknown;
     const double mid = nb.mid();
     const double spread = nb.ask - nb.bid;
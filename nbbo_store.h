@@ -1,13 +1,45 @@
 // nbbo_store.h
 #pragma once
 #include "trade_types.h"
-#include <QHash>
+#include "instrument_registry.h"
+#include <QVector>
 
+// 過去の気配1点（seed 用）
+struct NbboPoint {
+    qint64 ts{};
+    double bid{};
+    double ask{};
+};
+
+// 銘柄ごとの時刻付き気配リング（ts/until/bid/ask の平らな配列、固定容量）。
+// - update: 気配が変わった時だけ1点足す。同じ気配が続く間は最新点の until を伸ばすだけ
+// - at: ts 時点で有効だった気配を二分探索で引く（O(log n)）。記録より前・途切れた後は無効
+// - inferAggressor は約定時刻の直前の気配で判定する（後から来たバックフィルでも当時の板で）
 class NbboStore {
 public:
-    void update(const QString& inst, double bid, double ask);
-    NbboSnap get(const QString& inst) const;
-    Aggressor inferAggressor(const QString& inst, double tradePx, double* bpDiffBp = nullptr) const;
+    static constexpr int    CAPACITY = 512;                  // 銘柄あたりの点数
+    static constexpr qint64 MAX_STALE_MS = 5 * 60 * 1000;    // 最後に確認してからこれ以上先は使わない
+
+    void update(InstId inst, qint64 ts, double bid, double ask);
+    void seed(InstId inst, const QVector<NbboPoint>& pts);   // 過去分を差し込む（時刻順でなくてよい）
+
+    NbboSnap at(InstId inst, qint64 ts) const;               // ts 時点（無ければ無効）
+    Aggressor inferAggressor(InstId inst, qint64 ts, double tradePx, double* bpDiffBp = nullptr) const;
+
 private:
-    QHash<QString, NbboSnap> m_nbbo; // instrument -> NBBO
+    struct Ring {
+        QVector<qint64> ts;        // 気配が変わった時刻（論理順は start から昇順）
+        QVector<qint64> until;     // 同じ気配を最後に確認した時刻
+        QVector<double> bid, ask;
+        int start{ 0 };            // 最古の物理位置（満杯になってから回る）
+
+        int size() const { return int(ts.size()); }
+        int phys(int i) const { return (start + i) % size(); }
+        int lastPhys() const { return phys(size() - 1); }
+        void push(qint64 t, double b, double a);
+    };
+
+    const Ring* ring(InstId inst) const;
+
+    QVector<Ring> m_rings;     // InstId -> リング（未受信は空）
 };
@@ -0,0 +1,75 @@
+// order_book.cpp
+#include "order_book.h"
+#include <algorithm>
+
+int OrderBook::Side::lowerBound(double price) const {
+    // desc（bid）は価格の降順、asc（ask）は昇順に並んでいる
+    const auto it = desc
+        ? std::lower_bound(px.cbegin(), px.cend(), price, [](double a, double p) { return a > p; })
+        : std::lower_bound(px.cbegin(), px.cend(), price);
+    return int(it - px.cbegin());
+}
+
+void OrderBook::clear() {
+    m_bids.px.clear(); m_bids.amt.clear();
+    m_asks.px.clear(); m_asks.amt.clear();
+    m_changeId = 0;
+    m_ts = 0;
+}
+
+void OrderBook::beginSnapshot(qint64 changeId, qint64 ts) {
+    clear();
+    m_changeId = changeId;
+    m_ts = ts;
+}
+
+bool OrderBook::beginChange(qint64 prevChangeId, qint64 changeId, qint64 ts) {
+    if (!valid() || prevChangeId != m_changeId) { clear(); return false; }
+    m_changeId = changeId;
+    m_ts = ts;
+    return true;
+}
+
+void OrderBook::set(bool bidSide, Op op, double price, double amount) {
+    Side& s = bidSide ? m_bids : m_asks;
+    const int i = s.lowerBound(price);
+    const bool found = (i < s.px.size() && s.px[i] == price);
+
+    if (op == Op::Delete || amount <= 0.0) {
+        if (found) { s.px.remove(i); s.amt.remove(i); }
+        return;
+    }
+    if (found) { s.amt[i] = amount; return; }          // new が既存価格に来ても change と同じ扱い
+    s.px.insert(i, price);
+    s.amt.insert(i, amount);
+}
+
+OrderBook::Fill OrderBook::fill(bool bidSide, double size) const {
+    const Side& s = bidSide ? m_bids : m_asks;
+    Fill f;
+    double notional = 0.0;
+    for (int i = 0; i < s.px.size() && f.filled < size; ++i) {
+        const double take = std::min(s.amt[i], size - f.filled);
+        notional += take * s.px[i];
+        f.filled += take;
+        ++f.touched;
+        if (take >= s.amt[i]) ++f.exhausted;
+    }
+    f.vwap = (f.filled > 0.0) ? notional / f.filled : 0.0;
+    return f;
+}
+
+double OrderBook::depthMid(double size) const {
+    const double b = fill(true, size).vwap;
+    const double a = fill(false, size).vwap;
+    return (b > 0.0 && a > 0.0) ? 0.5 * (a + b) : 0.0;
+}
+
+double OrderBook::slippageBp(int sign, double size) const {
+    const bool bidSide = (sign < 0);                   // 売りは bid に当たる
+    const double best = bidSide ? bestBid() : bestAsk();
+    const Fill f = fill(bidSide, size);
+    if (best <= 0.0 || f.filled <= 0.0) return 0.0;
+    const double adverse = bidSide ? (best - f.vwap) : (f.vwap - best);
+    return adverse / best * 10000.0;
+}
@@ -0,0 +1,50 @@
+// order_book.h
+#pragma once
+#include <QtGlobal>
+#include <QVector>
+
+// 1銘柄の L2 板（book.{instrument}.100ms の snapshot / change を順に当てる）。
+// 片側ごとに価格でソートした平らな配列（bid は降順、ask は昇順で先頭が最良）。
+// 差分は二分探索の位置にその場で挿入・更新・削除する。change_id が繋がらなければ無効にして
+// 呼び出し側に購読し直させる（次の snapshot で戻る）
+class OrderBook {
+public:
+    enum class Op : quint8 { New, Change, Delete };
+
+    // size 枚を片側に当てた結果
+    struct Fill {
+        double vwap{ 0.0 };     // 当たった分の平均価格（板が空なら 0）
+        double filled{ 0.0 };   // 当たった枚数（板が薄ければ size 未満）
+        int    touched{ 0 };    // 触れた段数
+        int    exhausted{ 0 };  // 食い切った段数
+    };
+
+    void   clear();
+    bool   valid() const { return m_changeId > 0; }
+    qint64 changeId() const { return m_changeId; }
+    qint64 ts() const { return m_ts; }
+
+    void beginSnapshot(qint64 changeId, qint64 ts);                      // 両側を空にして以降の set で埋める
+    bool beginChange(qint64 prevChangeId, qint64 changeId, qint64 ts);   // 欠番なら false（板は無効）
+    void set(bool bidSide, Op op, double price, double amount);
+
+    int    levels(bool bidSide) const { return int((bidSide ? m_bids : m_asks).px.size()); }
+    double bestBid() const { return m_bids.px.isEmpty() ? 0.0 : m_bids.px.front(); }
+    double bestAsk() const { return m_asks.px.isEmpty() ? 0.0 : m_asks.px.front(); }
+
+    Fill   fill(bool bidSide, double size) const;
+    double depthMid(double size) const;                // 両側で size 枚ずつ当てた VWAP の中央
+    double slippageBp(int sign, double size) const;    // 買い(+1)は ask、売り(-1)は bid を食った時の最良からの不利幅
+
+private:
+    struct Side {
+        QVector<double> px, amt;
+        bool desc{ false };
+        int  lowerBound(double price) const;           // price 以上に良くない最初の位置
+    };
+
+    Side   m_bids{ {}, {}, true };
+    Side   m_asks{ {}, {}, false };
+    qint64 m_changeId{ 0 };
+    qint64 m_ts{ 0 };
+};
@@ -0,0 +1,187 @@
+// request_scheduler.cpp
+#include "request_scheduler.h"
+#include "WebSocketClient.h"
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QUrlQuery>
+#include <algorithm>
+#include <cmath>
+
+static constexpr int DERIBIT_TOO_MANY_REQUESTS = 10028;
+
+RequestScheduler::RequestScheduler(QNetworkAccessManager* net, QObject* parent)
+    : RequestScheduler(net, Config{}, parent) {}
+
+RequestScheduler::RequestScheduler(QNetworkAccessManager* net, const Config& cfg, QObject* parent)
+    : QObject(parent), m_net(net), m_cfg(cfg),
+      m_credits(cfg.creditsMax), m_window(cfg.initialWindow), m_backoffMs(cfg.backoffMinMs)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, [this] { pump(); });
+}
+
+void RequestScheduler::submit(Priority p, const QUrl& url, Handler done, bool front) {
+    auto& q = m_queues[int(p)];
+    if (front) q.push_front(Job{ p, url, std::move(done) });
+    else       q.push_back(Job{ p, url, std::move(done) });
+    pump();
+}
+
+void RequestScheduler::refill(qint64 now) {
+    if (m_lastRefillMs > 0 && now > m_lastRefillMs)
+        m_credits = std::min(m_cfg.creditsMax,
+            m_credits + double(now - m_lastRefillMs) * m_cfg.creditsPerSec / 1000.0);
+    m_lastRefillMs = now;
+}
+
+void RequestScheduler::armTimer(qint64 waitMs) {
+    const int ms = int(std::clamp<qint64>(waitMs, 1, m_cfg.backoffMaxMs));
+    if (!m_timer.isActive() || m_timer.remainingTime() > ms) m_timer.start(ms);
+}
+
+void RequestScheduler::pump() {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    refill(now);
+
+    for (;;) {
+        int c = 0;
+        while (c < PRIORITY_COUNT && m_queues[c].empty()) ++c;
+        if (c == PRIORITY_COUNT) return;
+
+        // 最上位クラスだけ窓を1つはみ出せる（履歴で窓が埋まっていても IV は通す）
+        const int limit = int(m_window) + (c == int(Priority::LiveCritical) ? 1 : 0);
+        if (m_inflight >= limit) return;                 // 完了時に再度 pump
+        if (now < m_pauseUntilMs) { armTimer(m_pauseUntilMs - now); return; }
+        if (m_credits < m_cfg.creditsPerRequest) {
+            const double lack = m_cfg.creditsPerRequest - m_credits;
+            armTimer(qint64(std::ceil(lack * 1000.0 / m_cfg.creditsPerSec)));
+            return;
+        }
+
+        m_credits -= m_cfg.creditsPerRequest;
+        Job job = std::move(m_queues[c].front());
+        m_queues[c].pop_front();
+        start(std::move(job));
+    }
+}
+
+void RequestScheduler::start(Job&& job) {
+    if (m_ws && !job.httpOnly && m_ws->isConnected()) {
+        QString method;
+        QJsonObject params;
+        if (toRpc(job.url, &method, &params)) { startRpc(std::move(job), method, params); return; }
+    }
+
+    QNetworkRequest req(job.url);
+    req.setRawHeader("User-Agent", "BTC-Option-Viewer/1.0 (+Qt)");
+    req.setTransferTimeout(m_cfg.timeoutMs);
+
+    QNetworkReply* rep = m_net->get(req);
+    ++m_inflight;
+    const qint64 startedMs = QDateTime::currentMSecsSinceEpoch();
+    connect(rep, &QNetworkReply::finished, this, [this, rep, job = std::move(job), startedMs]() mutable {
+        onFinished(rep, std::move(job), startedMs);
+        });
+}
+
+// https://www.deribit.com/api/v2/public/<method>?a=1&b=x → "public/<method>", {"a":1,"b":"x"}
+bool RequestScheduler::toRpc(const QUrl& url, QString* method, QJsonObject* params) {
+    static const QString PREFIX = QStringLiteral("/api/v2/");
+    const QString path = url.path();
+    if (!url.host().endsWith(QLatin1String("deribit.com")) || !path.startsWith(PREFIX + QLatin1String("public/")))
+        return false;
+    *method = path.mid(PREFIX.size());
+
+    // JSON-RPC は型を見るので、数値・真偽は文字列のまま渡さない
+    for (const auto& kv : QUrlQuery(url).queryItems(QUrl::FullyDecoded)) {
+        bool isInt = false, isNum = false;
+        const qint64 i = kv.second.toLongLong(&isInt);
+        const double d = isInt ? 0.0 : kv.second.toDouble(&isNum);
+        if (isInt) params->insert(kv.first, i);
+        else if (isNum) params->insert(kv.first, d);
+        else if (kv.second == QLatin1String("true") || kv.second == QLatin1String("false"))
+            params->insert(kv.first, kv.second == QLatin1String("true"));
+        else params->insert(kv.first, kv.second);
+    }
+    return true;
+}
+
+void RequestScheduler::startRpc(Job&& job, const QString& method, const QJsonObject& params) {
+    ++m_inflight;
+    m_ws->request(method, params, this, [this, job = std::move(job)](const WebSocketClient::RpcReply& rr) mutable {
+        if (rr.lost) {
+            // 送れなかった・途中で切れた → REST で出し直す（窓・クレジットは消費済み扱い）
+            m_inflight = std::max(0, m_inflight - 1);
+            job.httpOnly = true;
+            m_queues[int(job.p)].push_front(std::move(job));
+            pump();
+            return;
+        }
+        Reply r;
+        r.httpStatus = rr.ok() ? 200 : 0;
+        r.body = rr.body;
+        r.error = rr.error;
+        r.apiErrorCode = rr.errorCode;
+        r.latencyMs = rr.latencyMs;
+        finish(std::move(job), r, rr.errorCode == DERIBIT_TOO_MANY_REQUESTS, rr.timedOut);
+        }, m_cfg.timeoutMs);
+}
+
+bool RequestScheduler::isRateLimited(int httpStatus, const QByteArray& body) {
+    if (httpStatus == 429) return true;
+    if (httpStatus == 200 || body.isEmpty()) return false;   // 成功本文（約定配列など）は解かない
+    const QJsonDocument doc = QJsonDocument::fromJson(body);
+    return doc.isObject()
+        && doc.object().value("error").toObject().value("code").toInt() == DERIBIT_TOO_MANY_REQUESTS;
+}
+
+void RequestScheduler::onFinished(QNetworkReply* rep, Job job, qint64 startedMs) {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    const QNetworkReply::NetworkError netErr = rep->error();
+    Reply r;
+    r.httpStatus = rep->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    r.body = rep->readAll();
+    r.latencyMs = now - startedMs;
+    if (netErr != QNetworkReply::NoError) r.error = rep->errorString();
+    rep->deleteLater();
+
+    const bool congested = (netErr == QNetworkReply::OperationCanceledError || netErr == QNetworkReply::TimeoutError);
+    finish(std::move(job), r, isRateLimited(r.httpStatus, r.body), congested);
+}
+
+// HTTP / WS 共通の後始末（窓の増減・レート制限の待機・完了ハンドラ）
+void RequestScheduler::finish(Job&& job, const Reply& r, bool rateLimited, bool congested) {
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    m_inflight = std::max(0, m_inflight - 1);
+
+    if (rateLimited) {
+        // 乗法的減少＋待機。手持ちクレジットも空とみなす
+        ++m_rateLimitHits;
+        m_window = std::max(m_cfg.minWindow, m_window * 0.5);
+        m_pauseUntilMs = now + m_backoffMs;
+        m_backoffMs = std::min(m_cfg.backoffMaxMs, m_backoffMs * 2);
+        m_credits = 0.0;
+        m_queues[int(job.p)].push_front(std::move(job));
+        pump();
+        return;
+    }
+
+    if (r.ok()) {
+        m_backoffMs = m_cfg.backoffMinMs;
+        if (r.latencyMs <= m_cfg.fastLatencyMs)
+            m_window = std::min(m_cfg.maxWindow, m_window + 1.0 / m_window);   // 加法的増加（1窓で +1）
+        else if (r.latencyMs >= m_cfg.slowLatencyMs)
+            m_window = std::max(m_cfg.minWindow, m_window * 0.75);
+    }
+    else if (congested) {
+        m_window = std::max(m_cfg.minWindow, m_window * 0.5);               // タイムアウトは混雑扱い
+    }
+
+    if (job.done) job.done(r);
+    pump();
+}
@@ -0,0 +1,101 @@
+// request_scheduler.h
+#pragma once
+#include <QObject>
+#include <QTimer>
+#include <QUrl>
+#include <QByteArray>
+#include <QString>
+#include <QJsonObject>
+#include <deque>
+#include <functional>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class WebSocketClient;
+
+// REST 呼び出しの一元スケジューラ（GUI スレッド専用）。
+// - 優先度クラス：上のクラスが空の時だけ下を出す（IV/ticker が履歴取り込みに埋もれない）
+// - トークンバケット：Deribit のクレジット制（1回 500、上限 50000、毎秒 10000 回復）に合わせて送出
+// - 同時実行数は AIMD：低遅延で完了したら +1/窓、429 / 10028(too_many_requests) で半減＋待機
+// レート制限で弾かれた要求はクラス先頭に戻して自動で再送する（完了ハンドラには渡さない）。
+// WS を渡しておくと public/* は接続中の WS の JSON-RPC で出す（TLS/HTTP の往復を省く）。
+// 応答本文は REST と同じ形なので、完了ハンドラ側は経路を意識しない。WS が切れたら REST で出し直す。
+class RequestScheduler : public QObject {
+    Q_OBJECT
+public:
+    enum class Priority { LiveCritical = 0, DeltaGap = 1, DeepHistory = 2 };
+    static constexpr int PRIORITY_COUNT = 3;
+
+    struct Config {
+        double creditsPerRequest{ 500.0 };
+        double creditsMax{ 50000.0 };
+        double creditsPerSec{ 10000.0 };
+        double initialWindow{ 4.0 };
+        double minWindow{ 1.0 };
+        double maxWindow{ 16.0 };
+        qint64 fastLatencyMs{ 800 };    // これ以下で完了したら窓を広げる
+        qint64 slowLatencyMs{ 3000 };   // これ以上かかったら窓を 3/4 に
+        qint64 backoffMinMs{ 1000 };
+        qint64 backoffMaxMs{ 30000 };
+        int    timeoutMs{ 30000 };
+    };
+
+    // 完了結果（通信/HTTP エラー時は error に文言。本文はそのまま渡す）
+    struct Reply {
+        QString    error;
+        int        httpStatus{ 0 };
+        QByteArray body;
+        qint64     latencyMs{ 0 };
+        int        apiErrorCode{ 0 };   // JSON-RPC の error.code（WS 経路のみ）
+        bool ok() const { return error.isEmpty(); }
+        // 要求そのものを断られた（4xx / API エラー）。出し直しても通らない
+        bool rejected() const { return (httpStatus >= 400 && httpStatus < 500) || apiErrorCode != 0; }
+    };
+    using Handler = std::function<void(const Reply&)>;
+
+    explicit RequestScheduler(QNetworkAccessManager* net, QObject* parent = nullptr);
+    RequestScheduler(QNetworkAccessManager* net, const Config& cfg, QObject* parent = nullptr);
+
+    // front=true はクラス内の先頭へ（続きのページを同じ銘柄で進めたい時など）
+    void submit(Priority p, const QUrl& url, Handler done, bool front = false);
+
+    void setRpcTransport(WebSocketClient* ws) { m_ws = ws; }   // nullptr で REST のみ
+
+    int    queued(Priority p) const { return int(m_queues[int(p)].size()); }
+    int    inflight() const { return m_inflight; }
+    double window() const { return m_window; }
+    double credits() const { return m_credits; }
+    int    rateLimitHits() const { return m_rateLimitHits; }
+
+private:
+    struct Job {
+        Priority p;
+        QUrl     url;
+        Handler  done;
+        bool     httpOnly{ false };     // WS で送れなかった分の出し直し
+    };
+
+    void   pump();
+    void   refill(qint64 now);
+    void   armTimer(qint64 waitMs);
+    void   start(Job&& job);
+    void   startRpc(Job&& job, const QString& method, const QJsonObject& params);
+    void   onFinished(QNetworkReply* rep, Job job, qint64 startedMs);
+    void   finish(Job&& job, const Reply& r, bool rateLimited, bool congested);
+    static bool isRateLimited(int httpStatus, const QByteArray& body);
+    static bool toRpc(const QUrl& url, QString* method, QJsonObject* params);
+
+    QNetworkAccessManager* m_net;
+    WebSocketClient*       m_ws{ nullptr };
+    Config m_cfg;
+    std::deque<Job> m_queues[PRIORITY_COUNT];
+    QTimer m_timer;                 // クレジット不足・待機中の再開用（単発）
+
+    double m_credits;
+    qint64 m_lastRefillMs{ 0 };
+    double m_window;
+    int    m_inflight{ 0 };
+    qint64 m_pauseUntilMs{ 0 };
+    qint64 m_backoffMs;
+    int    m_rateLimitHits{ 0 };
+};
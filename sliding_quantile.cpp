@@ -0,0 +1,146 @@
+// sliding_quantile.cpp
+#include "sliding_quantile.h"
+#include <QJsonArray>
+#include <algorithm>
+#include <cmath>
+
+static constexpr double SQ_MIN_VALUE = 0.01;   // これ未満は先頭ビン
+static constexpr double SQ_MAX_VALUE = 1e6;    // これ以上は末尾ビン
+
+SlidingQuantile::SlidingQuantile(qint64 windowMs, qint64 bucketMs, double relErr)
+    : m_windowMs(std::max<qint64>(windowMs, 1))
+    , m_bucketMs(std::clamp<qint64>(bucketMs, 1, m_windowMs))
+    , m_relErr(relErr > 0.0 ? relErr : 0.01)
+    , m_logBase(std::log1p(m_relErr))
+{
+    m_nBins = std::min(65535, int(std::ceil(std::log(SQ_MAX_VALUE / SQ_MIN_VALUE) / m_logBase)) + 1);
+    m_ring.resize(int((m_windowMs + m_bucketMs - 1) / m_bucketMs));
+    m_agg.resize(m_nBins, 0);
+}
+
+int SlidingQuantile::binOf(double v) const {
+    if (v <= SQ_MIN_VALUE) return 0;
+    const int b = int(std::log(v / SQ_MIN_VALUE) / m_logBase);
+    return std::min(b, m_nBins - 1);
+}
+
+double SlidingQuantile::valueOf(int bin) const {
+    return SQ_MIN_VALUE * std::exp((bin + 0.5) * m_logBase);
+}
+
+void SlidingQuantile::clear() {
+    for (auto& b : m_ring) { b.idx = -1; b.bins.clear(); b.n = 0; }
+    std::fill(m_agg.begin(), m_agg.end(), 0u);
+    m_total = 0;
+    m_headIdx = -1;
+    m_dirty = true;
+}
+
+void SlidingQuantile::expire(Bucket& b) {
+    if (b.idx < 0) return;
+    for (auto it = b.bins.cbegin(); it != b.bins.cend(); ++it) m_agg[it.key()] -= it.value();
+    m_total -= b.n;
+    b.idx = -1;
+    b.bins.clear();
+    b.n = 0;
+}
+
+void SlidingQuantile::advance(qint64 now) {
+    const qint64 nowIdx = now / m_bucketMs;
+    if (m_headIdx < 0) { m_headIdx = nowIdx; return; }
+    if (nowIdx <= m_headIdx) return;
+
+    const qint64 n = m_ring.size();
+    if (nowIdx - m_headIdx >= n) {
+        for (auto& b : m_ring) expire(b);
+    }
+    else {
+        // (head, now] に対応するリング位置には、ちょうど窓から外れたバケットが居る
+        for (qint64 i = m_headIdx + 1; i <= nowIdx; ++i) {
+            Bucket& b = m_ring[int(i % n)];
+            if (b.idx >= 0 && b.idx <= nowIdx - n) expire(b);
+        }
+    }
+    m_headIdx = nowIdx;
+    m_dirty = true;   // バケットが回った
+}
+
+void SlidingQuantile::addToBin(qint64 bucketIdx, int bin, quint32 cnt) {
+    const qint64 n = m_ring.size();
+    if (m_headIdx < 0 || bucketIdx > m_headIdx) advance(bucketIdx * m_bucketMs);
+    if (bucketIdx <= m_headIdx - n) return;            // 窓より古い
+
+    Bucket& b = m_ring[int(bucketIdx % n)];
+    if (b.idx != bucketIdx) { expire(b); b.idx = bucketIdx; }
+    b.bins[quint16(bin)] += cnt;
+    b.n += cnt;
+    m_agg[bin] += cnt;
+    m_total += cnt;
+}
+
+void SlidingQuantile::add(qint64 ts, double v) {
+    if (!(v > 0.0) || ts <= 0) return;
+    addToBin(ts / m_bucketMs, binOf(v), 1);
+}
+
+double SlidingQuantile::quantile(double q) {
+    if (m_total <= 0) return 0.0;
+    q = std::clamp(q, 0.0, 1.0);
+
+    // バケットが回っていなければ、件数が2%以上動くまではキャッシュを返す
+    const qint64 drift = std::llabs(m_total - m_cacheTotal);
+    if (!m_dirty && q == m_cacheQ && drift * 50 < std::max<qint64>(m_cacheTotal, 1))
+        return m_cacheVal;
+
+    const qint64 k = qint64(std::floor(double(m_total - 1) * q));
+    qint64 cum = 0;
+    int bin = m_nBins - 1;
+    for (int i = 0; i < m_nBins; ++i) {
+        cum += m_agg[i];
+        if (cum > k) { bin = i; break; }
+    }
+    m_cacheQ = q;
+    m_cacheVal = valueOf(bin);
+    m_cacheTotal = m_total;
+    m_dirty = false;
+    return m_cacheVal;
+}
+
+QJsonObject SlidingQuantile::toJson() const {
+    QJsonArray buckets;
+    for (const auto& b : m_ring) {
+        if (b.idx < 0 || b.n <= 0) continue;
+        QJsonArray bins;
+        for (auto it = b.bins.cbegin(); it != b.bins.cend(); ++it) {
+            bins.append(int(it.key()));
+            bins.append(double(it.value()));
+        }
+        QJsonArray row; row.append(double(b.idx)); row.append(bins);
+        buckets.append(row);
+    }
+    QJsonObject o;
+    o.insert("bucketMs", double(m_bucketMs));
+    o.insert("relErr", m_relErr);
+    o.insert("buckets", buckets);
+    return o;
+}
+
+bool SlidingQuantile::fromJson(const QJsonObject& o) {
+    if (qint64(o.value("bucketMs").toDouble()) != m_bucketMs) return false;
+    if (std::abs(o.value("relErr").toDouble() - m_relErr) > 1e-12) return false;
+
+    clear();
+    const QJsonArray buckets = o.value("buckets").toArray();
+    for (const auto& v : buckets) {
+        const QJsonArray row = v.toArray();
+        if (row.size() != 2) continue;
+        const qint64 idx = qint64(row[0].toDouble());
+        const QJsonArray bins = row[1].toArray();
+        for (int i = 0; i + 1 < bins.size(); i += 2) {
+            const int bin = bins[i].toInt();
+            const quint32 cnt = quint32(bins[i + 1].toDouble());
+            if (bin >= 0 && bin < m_nBins && cnt > 0) addToBin(idx, bin, cnt);
+        }
+    }
+    return true;
+}
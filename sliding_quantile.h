@@ -0,0 +1,58 @@
+// sliding_quantile.h
+#pragma once
+#include <QtGlobal>
+#include <QHash>
+#include <QJsonObject>
+#include <QVector>
+
+// 直近 window の値分布を、時間バケット×対数ビンのヒストグラムで持つ分位点スケッチ。
+// - add は O(1)（ビン番号の計算とカウンタ加算のみ）
+// - 古いバケットは時間が進んだ時にまとめて差し引く
+// - 分位点はキャッシュし、バケットが落ちた時かサンプル数が一定以上動いた時だけ引き直す
+// 値の相対誤差はビン幅（relErr）程度
+class SlidingQuantile {
+public:
+    explicit SlidingQuantile(qint64 windowMs = 24ll * 60 * 60 * 1000,
+        qint64 bucketMs = 5ll * 60 * 1000,
+        double relErr = 0.01);
+
+    void   add(qint64 ts, double v);      // v<=0・窓より古い ts は無視
+    void   advance(qint64 now);           // 時刻だけ進めて期限切れバケットを落とす
+    double quantile(double q);            // 0..1。サンプルが無ければ 0
+    qint64 count() const { return m_total; }
+    void   clear();
+
+    // スナップショット用：{bucketMs, relErr, buckets:[[bucketIdx, [bin, cnt, ...]], ...]}
+    // パラメータが違う保存データは読まない
+    QJsonObject toJson() const;
+    bool        fromJson(const QJsonObject& o);
+
+private:
+    struct Bucket {
+        qint64 idx{ -1 };                 // ts / bucketMs（-1=空）
+        QHash<quint16, quint32> bins;     // 疎なヒストグラム
+        qint64 n{ 0 };
+    };
+
+    int    binOf(double v) const;
+    double valueOf(int bin) const;        // ビンの代表値（幾何中点）
+    void   addToBin(qint64 bucketIdx, int bin, quint32 cnt);
+    void   expire(Bucket& b);
+
+    qint64 m_windowMs;
+    qint64 m_bucketMs;
+    double m_relErr;
+    double m_logBase;                     // log(1+relErr)
+    int    m_nBins;
+
+    QVector<Bucket>  m_ring;              // bucketIdx % size
+    QVector<quint32> m_agg;               // 生存バケットの合算
+    qint64 m_total{ 0 };
+    qint64 m_headIdx{ -1 };               // 最新バケット
+
+    // キャッシュ
+    double m_cacheQ{ -1.0 };
+    double m_cacheVal{ 0.0 };
+    qint64 m_cacheTotal{ 0 };
+    bool   m_dirty{ true };
+};
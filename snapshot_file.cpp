@@ -0,0 +1,196 @@
+// snapshot_file.cpp
+#include "snapshot_file.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QHash>
+#include <cstring>
+
+namespace {
+
+enum Tag : quint32 {
+    NAME_OFS = 1, NAME_BYTES = 2,
+    C_EXP = 10, C_CALL = 11, C_STRIKE = 12, C_QTY = 13, C_SIGNED = 14, C_DVOL = 15,
+    C_LASTTS = 16, C_ANCHOR = 17, C_TRADES = 18, C_INST_OFS = 19, C_INST = 20,
+    I_IV = 30, I_DELTA = 31, I_SEQ_OFS = 32, I_SEQ = 33,
+    AMT_SKETCH = 40,
+    J_GEN = 50,
+};
+
+struct FileHeader {
+    quint32 magic;
+    quint32 version;
+    qint64  ts;
+    quint32 sections;
+    quint32 reserved;
+};
+static_assert(sizeof(FileHeader) == 24, "snapshot header layout");
+
+struct SectionHeader {
+    quint32 tag;
+    quint32 elemSize;
+    quint64 count;
+};
+static_assert(sizeof(SectionHeader) == 16, "snapshot section layout");
+
+class Writer {
+public:
+    template <typename T>
+    void put(quint32 tag, const T* p, qsizetype n) {
+        const SectionHeader h{ tag, quint32(sizeof(T)), quint64(n) };
+        m_buf.append(reinterpret_cast<const char*>(&h), sizeof(h));
+        m_buf.append(reinterpret_cast<const char*>(p), n * qsizetype(sizeof(T)));
+        while (m_buf.size() % 8) m_buf.append('\0');
+        ++m_sections;
+    }
+    template <typename T>
+    void put(quint32 tag, const QVector<T>& v) { put(tag, v.constData(), v.size()); }
+
+    QByteArray finish(qint64 ts) const {
+        const FileHeader h{ SnapshotFile::MAGIC, SnapshotFile::VERSION, ts, m_sections, 0 };
+        return QByteArray(reinterpret_cast<const char*>(&h), sizeof(h)) + m_buf;
+    }
+
+private:
+    QByteArray m_buf;
+    quint32 m_sections{ 0 };
+};
+
+struct Section {
+    quint32 elemSize{ 0 };
+    quint64 count{ 0 };
+    const uchar* data{ nullptr };
+};
+
+template <typename T>
+bool take(const QHash<quint32, Section>& secs, quint32 tag, QVector<T>& out) {
+    out.clear();
+    const auto it = secs.constFind(tag);
+    if (it == secs.cend()) return true;                  // 無い列は空（古い版で増えた列など）
+    if (it->elemSize != sizeof(T)) return false;
+    out.resize(qsizetype(it->count));
+    if (it->count) std::memcpy(out.data(), it->data, size_t(it->count) * sizeof(T));
+    return true;
+}
+
+// offs が 0 始まり・単調増加で、最後が total に一致するか
+bool validOffsets(const QVector<quint32>& offs, int expectCount, qsizetype total) {
+    if (offs.isEmpty()) return expectCount == 0 && total == 0;
+    if (offs.size() != expectCount + 1 || offs.front() != 0 || qsizetype(offs.back()) != total) return false;
+    for (int i = 1; i < offs.size(); ++i)
+        if (offs[i] < offs[i - 1]) return false;
+    return true;
+}
+
+} // namespace
+
+bool SnapshotFile::save(const QString& path, const SnapshotData& d) {
+    Writer w;
+
+    // 文字列表：UTF-8 を連結し、開始位置の列を添える
+    QVector<quint32> nameOfs;
+    QByteArray nameBytes;
+    nameOfs.reserve(d.names.size() + 1);
+    nameOfs.push_back(0);
+    for (const QString& n : d.names) {
+        nameBytes += n.toUtf8();
+        nameOfs.push_back(quint32(nameBytes.size()));
+    }
+    w.put(NAME_OFS, nameOfs);
+    w.put(NAME_BYTES, nameBytes.constData(), nameBytes.size());
+
+    w.put(C_EXP, d.expMs);
+    w.put(C_CALL, d.isCall);
+    w.put(C_STRIKE, d.strike);
+    w.put(C_QTY, d.qty);
+    w.put(C_SIGNED, d.signedQty);
+    w.put(C_DVOL, d.dVol);
+    w.put(C_LASTTS, d.lastTs);
+    w.put(C_ANCHOR, d.anchorTs);
+    w.put(C_TRADES, d.trades);
+    w.put(C_INST_OFS, d.instOfs);
+    w.put(C_INST, d.instList);
+
+    w.put(I_IV, d.lastIV);
+    w.put(I_DELTA, d.lastDelta);
+    w.put(I_SEQ_OFS, d.seqOfs);
+    w.put(I_SEQ, d.seqRanges);
+
+    w.put(AMT_SKETCH, d.amtSketch.constData(), d.amtSketch.size());
+    w.put(J_GEN, &d.journalGen, 1);
+
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) return false;
+    const QByteArray bytes = w.finish(d.ts);
+    if (f.write(bytes) != bytes.size()) { f.cancelWriting(); return false; }
+    return f.commit();
+}
+
+bool SnapshotFile::load(const QString& path, SnapshotData& d) {
+    d = SnapshotData{};
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly) || f.size() < qint64(sizeof(FileHeader))) return false;
+    const qint64 size = f.size();
+    const uchar* base = f.map(0, size);
+    if (!base) return false;
+
+    FileHeader h;
+    std::memcpy(&h, base, sizeof(h));
+    bool ok = (h.magic == MAGIC && h.version == VERSION);
+
+    // 節の位置だけ先に拾う（本体は map のまま）
+    QHash<quint32, Section> secs;
+    qint64 pos = qint64(sizeof(FileHeader));
+    for (quint32 i = 0; ok && i < h.sections; ++i) {
+        SectionHeader sh;
+        if (pos + qint64(sizeof(sh)) > size) { ok = false; break; }
+        std::memcpy(&sh, base + pos, sizeof(sh));
+        pos += qint64(sizeof(sh));
+        // 掛け算の前に件数を見る（壊れた count で桁あふれして検査をすり抜けないように）
+        if (sh.elemSize == 0 || sh.count > quint64(size - pos) / sh.elemSize) { ok = false; break; }
+        const quint64 bytes = quint64(sh.elemSize) * sh.count;
+        secs.insert(sh.tag, Section{ sh.elemSize, sh.count, base + pos });
+        pos += qint64((bytes + 7) & ~quint64(7));
+    }
+
+    QVector<quint32> nameOfs;
+    QByteArray nameBytes;
+    QVector<quint64> gen;
+    if (ok) {
+        d.ts = h.ts;
+        ok = take(secs, NAME_OFS, nameOfs)
+            && take(secs, C_EXP, d.expMs) && take(secs, C_CALL, d.isCall) && take(secs, C_STRIKE, d.strike)
+            && take(secs, C_QTY, d.qty) && take(secs, C_SIGNED, d.signedQty) && take(secs, C_DVOL, d.dVol)
+            && take(secs, C_LASTTS, d.lastTs) && take(secs, C_ANCHOR, d.anchorTs) && take(secs, C_TRADES, d.trades)
+            && take(secs, C_INST_OFS, d.instOfs) && take(secs, C_INST, d.instList)
+            && take(secs, I_IV, d.lastIV) && take(secs, I_DELTA, d.lastDelta)
+            && take(secs, I_SEQ_OFS, d.seqOfs) && take(secs, I_SEQ, d.seqRanges)
+            && take(secs, J_GEN, gen);
+        if (!gen.isEmpty()) d.journalGen = gen.front();
+        const auto nb = secs.constFind(NAME_BYTES);
+        if (nb != secs.cend()) nameBytes = QByteArray(reinterpret_cast<const char*>(nb->data), qsizetype(nb->count));
+        const auto am = secs.constFind(AMT_SKETCH);
+        if (am != secs.cend()) d.amtSketch = QByteArray(reinterpret_cast<const char*>(am->data), qsizetype(am->count));
+    }
+    f.unmap(const_cast<uchar*>(base));
+    if (!ok) { d = SnapshotData{}; return false; }
+
+    // 列の長さと添字の整合（壊れたファイルで範囲外を引かない）
+    const int nNames = nameOfs.isEmpty() ? 0 : int(nameOfs.size()) - 1;
+    const int nc = d.clusterCount();
+    ok = validOffsets(nameOfs, nNames, nameBytes.size())
+        && d.isCall.size() == nc && d.strike.size() == nc && d.qty.size() == nc
+        && d.signedQty.size() == nc && d.dVol.size() == nc && d.lastTs.size() == nc
+        && d.anchorTs.size() == nc && d.trades.size() == nc
+        && validOffsets(d.instOfs, nc, d.instList.size())
+        && (d.lastIV.isEmpty() || d.lastIV.size() == nNames)
+        && (d.lastDelta.isEmpty() || d.lastDelta.size() == nNames)
+        && validOffsets(d.seqOfs, d.seqOfs.isEmpty() ? 0 : nNames, d.seqRanges.size() / 2)
+        && d.seqRanges.size() % 2 == 0;
+    for (quint32 x : d.instList) ok = ok && int(x) < nNames;
+    if (!ok) { d = SnapshotData{}; return false; }
+
+    d.names.reserve(nNames);
+    for (int i = 0; i < nNames; ++i)
+        d.names << QString::fromUtf8(nameBytes.constData() + nameOfs[i], qsizetype(nameOfs[i + 1] - nameOfs[i]));
+    return true;
+}
@@ -0,0 +1,46 @@
+// snapshot_file.h
+#pragma once
+#include <QtGlobal>
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// 残存推定スナップショットの中身（列ごとの平らな配列。銘柄は names の添字で持つ）
+struct SnapshotData {
+    qint64 ts{ 0 };
+    QStringList names;                // 文字列表（銘柄名）
+
+    // クラスタ（同じ長さの列）
+    QVector<qint64>  expMs;
+    QVector<quint8>  isCall;
+    QVector<qint32>  strike;          // バケット丸め後の行使
+    QVector<double>  qty, signedQty, dVol;
+    QVector<qint64>  lastTs, anchorTs;
+    QVector<qint32>  trades;
+    QVector<quint32> instOfs;         // クラスタ c の銘柄は instList[instOfs[c] .. instOfs[c+1])
+    QVector<quint32> instList;        // names の添字
+
+    // 銘柄ごと（names と同じ長さ）
+    QVector<double>  lastIV, lastDelta;
+    QVector<quint32> seqOfs;          // 銘柄 i の既出 trade_seq 区間は seqRanges[2*seqOfs[i] .. 2*seqOfs[i+1])
+    QVector<qint64>  seqRanges;       // lo, hi の組
+
+    QByteArray amtSketch;             // SlidingQuantile::toJson（小さいのでそのまま）
+    quint64 journalGen{ 0 };          // この世代以降のジャーナルを上に重ねて復旧する（0=全部）
+
+    int clusterCount() const { return int(expMs.size()); }
+    int addName(const QString& n) { names << n; return int(names.size()) - 1; }
+};
+
+// バイナリ・版付きのスナップショットファイル。
+//   ヘッダ（magic "BSNP", 版, ts, 節数）＋ 節（tag, 要素サイズ, 件数, 本体を 8 バイト境界に詰める）の列
+// 書き込みは QSaveFile（一時ファイル → 置き換え）、読み込みは QFile::map。
+// 知らない tag は読み飛ばすので、列の追加は版を上げずにできる
+namespace SnapshotFile {
+    static constexpr quint32 MAGIC = 0x504E5342u;   // "BSNP"
+    static constexpr quint32 VERSION = 1;
+
+    bool save(const QString& path, const SnapshotData& d);
+    bool load(const QString& path, SnapshotData& d);   // 壊れている・版違いなら false
+}
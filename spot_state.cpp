@@ -0,0 +1,19 @@
+// spot_state.cpp
+#include "spot_state.h"
+#include <cmath>
+
+bool SpotState::update(double px, qint64 ts) {
+    if (!(px > 0.0) || !std::isfinite(px)) return false;
+    if (ts < m_liveTs) return false;               // 遅れて来た古い値
+    m_live = px;
+    m_liveTs = ts;
+
+    if (valid() && std::abs(driftBp()) < m_thrBp) return false;
+    m_px = px;
+    m_pxTs = ts;
+    return true;
+}
+
+double SpotState::driftBp() const {
+    return (m_px > 0.0 && m_live > 0.0) ? (m_live - m_px) / m_px * 10000.0 : 0.0;
+}
@@ -0,0 +1,32 @@
+// spot_state.h
+#pragma once
+#include <QtGlobal>
+
+// 原資産（deribit_price_index.btc_usd）の状態。
+// 指数は数百 ms ごとに来るが、依存する計算（カーブ・Pin 距離・Δ推定・想定元本）は
+// 確定値 px() だけを見る。確定値は最後に確定した値から閾値(bp)以上動いた時だけ進めるので、
+// 呼び出し側は update() が true の時だけ依存先を dirty にすればよい
+class SpotState {
+public:
+    static constexpr double DEFAULT_THRESHOLD_BP = 5.0;
+
+    void   setThresholdBp(double bp) { m_thrBp = bp > 0.0 ? bp : 0.0; }
+    double thresholdBp() const { return m_thrBp; }
+
+    // 新しい指数。古い時刻は捨てる。確定値が動いたら true（初回は必ず true）
+    bool   update(double px, qint64 ts);
+
+    bool   valid() const { return m_px > 0.0; }
+    double px() const { return m_px; }             // 依存計算に使う確定値
+    qint64 pxTs() const { return m_pxTs; }
+    double live() const { return m_live; }         // 最新の指数
+    qint64 liveTs() const { return m_liveTs; }
+    double driftBp() const;                        // 確定値からの今のずれ
+
+private:
+    double m_thrBp{ DEFAULT_THRESHOLD_BP };
+    double m_px{ 0.0 };
+    qint64 m_pxTs{ 0 };
+    double m_live{ 0.0 };
+    qint64 m_liveTs{ 0 };
+};
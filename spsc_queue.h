@@ -0,0 +1,48 @@
+// spsc_queue.h
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// 単一 producer / 単一 consumer のロックフリー有界リング。
+// push は producer スレッドのみ、pop は consumer スレッドのみから呼ぶこと。
+template <typename T, std::size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+public:
+    // 満杯なら false（要素は動かさない）
+    bool push(T&& v) {
+        const std::size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tailCache == Capacity) {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head - m_tailCache == Capacity) return false;
+        }
+        m_slots[head & (Capacity - 1)] = std::move(v);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 空なら false
+    bool pop(T& out) {
+        const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_headCache) {
+            m_headCache = m_head.load(std::memory_order_acquire);
+            if (tail == m_headCache) return false;
+        }
+        out = std::move(m_slots[tail & (Capacity - 1)]);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+    }
+
+private:
+    // producer/consumer の書き込み先を別キャッシュラインに分ける
+    alignas(64) std::atomic<std::size_t> m_head{ 0 };   // producer が進める
+    std::size_t m_tailCache{ 0 };                        // producer 側の tail 写し
+    alignas(64) std::atomic<std::size_t> m_tail{ 0 };   // consumer が進める
+    std::size_t m_headCache{ 0 };                        // consumer 側の head 写し
+    alignas(64) T m_slots[Capacity];
+};
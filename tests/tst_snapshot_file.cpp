@@ -0,0 +1,67 @@
+// tst_snapshot_file.cpp
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <cstring>
+#include "snapshot_file.h"
+
+class TestSnapshotFile : public QObject {
+    Q_OBJECT
+
+private:
+    static SnapshotData sample() {
+        SnapshotData d;
+        d.ts = 123456789;
+        d.addName(QStringLiteral("BTC-27JUN25-100000-C"));
+        d.expMs = { 1750996800000 };
+        d.isCall = { 1 };
+        d.strike = { 100000 };
+        d.qty = { 12.5 };
+        d.signedQty = { -3.0 };
+        d.dVol = { 4.25 };
+        d.lastTs = { 123450000 };
+        d.anchorTs = { 0 };
+        d.trades = { 7 };
+        d.instOfs = { 0, 1 };
+        d.instList = { 0 };
+        return d;
+    }
+
+private slots:
+    void roundTrip() {
+        QTemporaryDir dir;
+        const QString path = dir.filePath(QStringLiteral("state.snap"));
+        QVERIFY(SnapshotFile::save(path, sample()));
+
+        SnapshotData d;
+        QVERIFY(SnapshotFile::load(path, d));
+        QCOMPARE(d.ts, qint64(123456789));
+        QCOMPARE(d.clusterCount(), 1);
+        QCOMPARE(d.names.front(), QStringLiteral("BTC-27JUN25-100000-C"));
+        QCOMPARE(d.qty.front(), 12.5);
+    }
+
+    // 要素サイズ×件数が 64bit で桁あふれする count を書き込んだファイルは読まない
+    void forgedCountRejected() {
+        QTemporaryDir dir;
+        const QString path = dir.filePath(QStringLiteral("state.snap"));
+        QVERIFY(SnapshotFile::save(path, sample()));
+
+        QFile f(path);
+        QVERIFY(f.open(QIODevice::ReadWrite));
+        QByteArray bytes = f.readAll();
+        // 先頭の節（NAME_OFS、要素 4 バイト）の count：4 × (2^62 + 1) は 4 に戻る
+        const quint64 count = (quint64(1) << 62) + 1;
+        std::memcpy(bytes.data() + 24 + 8, &count, sizeof(count));
+        QVERIFY(f.seek(0));
+        QCOMPARE(f.write(bytes), bytes.size());
+        f.close();
+
+        SnapshotData d;
+        QVERIFY(!SnapshotFile::load(path, d));
+        QCOMPARE(d.clusterCount(), 0);
+    }
+};
+
+QTEST_APPLESS_MAIN(TestSnapshotFile)
+#include "tst_snapshot_file.moc"
@@ -0,0 +1,80 @@
+// tiered_series.cpp
+#include "tiered_series.h"
+#include <algorithm>
+
+static constexpr qint64 TS_MINUTE_MS = 60ll * 1000;
+static constexpr qint64 TS_HOUR_MS = 60ll * 60 * 1000;
+
+void TieredSeries::addToTier(QMap<qint64, double>& tier, qint64 bucketMs, qint64 ts, double v) {
+    tier[ts - ts % bucketMs] += v;
+}
+
+void TieredSeries::add(qint64 ts, double v) {
+    if (ts > m_now) advance(ts);
+    if (ts < m_now - m_policy.keepMs) return;
+
+    m_total += v;
+    if (ts >= m_now - m_policy.rawMs) {
+        m_rawSum += v;
+        // ほぼ常に末尾追加。遅れて来た分だけ位置を探す
+        if (m_raw.empty() || m_raw.back().ts <= ts) {
+            m_raw.push_back(Point{ ts, v });
+        }
+        else {
+            auto it = std::upper_bound(m_raw.begin(), m_raw.end(), ts,
+                [](qint64 t, const Point& p) { return t < p.ts; });
+            m_raw.insert(it, Point{ ts, v });
+        }
+    }
+    else if (ts >= m_now - m_policy.minuteMs) {
+        addToTier(m_minutes, TS_MINUTE_MS, ts, v);
+        m_minuteSum += v;
+    }
+    else {
+        addToTier(m_hours, TS_HOUR_MS, ts, v);
+    }
+}
+
+void TieredSeries::advance(qint64 now) {
+    if (now <= m_now) return;
+    m_now = now;
+
+    // 生データ → 分足
+    const qint64 rawCut = now - m_policy.rawMs;
+    while (!m_raw.empty() && m_raw.front().ts < rawCut) {
+        addToTier(m_minutes, TS_MINUTE_MS, m_raw.front().ts, m_raw.front().v);
+        m_rawSum -= m_raw.front().v;
+        m_minuteSum += m_raw.front().v;
+        m_raw.pop_front();
+    }
+    if (m_raw.empty()) m_rawSum = 0.0;          // 引き算の誤差を空になった所で落とす
+
+    // 分足 → 時間足（バケット全体が窓を出たものだけ）
+    const qint64 minCut = now - m_policy.minuteMs;
+    while (!m_minutes.isEmpty() && m_minutes.firstKey() + TS_MINUTE_MS <= minCut) {
+        addToTier(m_hours, TS_HOUR_MS, m_minutes.firstKey(), m_minutes.first());
+        m_minuteSum -= m_minutes.first();
+        m_minutes.erase(m_minutes.begin());
+    }
+    if (m_minutes.isEmpty()) m_minuteSum = 0.0;
+
+    // 保持期間切れ
+    const qint64 keepCut = now - m_policy.keepMs;
+    while (!m_hours.isEmpty() && m_hours.firstKey() + TS_HOUR_MS <= keepCut) {
+        m_total -= m_hours.first();
+        m_hours.erase(m_hours.begin());
+    }
+}
+
+double TieredSeries::rangeSum(qint64 fromMs, qint64 toMs) const {
+    if (toMs <= fromMs) return 0.0;
+    double s = 0.0;
+
+    for (auto it = m_hours.lowerBound(fromMs); it != m_hours.end() && it.key() < toMs; ++it) s += it.value();
+    for (auto it = m_minutes.lowerBound(fromMs); it != m_minutes.end() && it.key() < toMs; ++it) s += it.value();
+
+    auto it = std::lower_bound(m_raw.begin(), m_raw.end(), fromMs,
+        [](const Point& p, qint64 t) { return p.ts < t; });
+    for (; it != m_raw.end() && it->ts < toMs; ++it) s += it->v;
+    return s;
+}
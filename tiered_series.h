@@ -0,0 +1,46 @@
+// tiered_series.h
+#pragma once
+#include <QtGlobal>
+#include <QMap>
+#include <deque>
+
+// 保持期間を段階的に粗くする時系列（値は加算のみ）。
+//   生データ : 直近 rawMs（既定1h）
+//   分足     : 直近 minuteMs（既定24h）
+//   時間足   : 直近 keepMs（既定365日）
+// 古くなった分は前から順に1段粗い層へ畳み込むので、長時間動かしてもサイズは頭打ちになる。
+// 範囲和は各層を組み合わせて返す（粗い層のバケットは開始時刻で範囲判定）。
+// 直近 rawMs / minuteMs の和は追加と畳み込みのたびに走行和で持つので、読むのは O(1)。
+class TieredSeries {
+public:
+    struct Policy {
+        qint64 rawMs{ 60ll * 60 * 1000 };
+        qint64 minuteMs{ 24ll * 60 * 60 * 1000 };
+        qint64 keepMs{ 365ll * 24 * 60 * 60 * 1000 };
+    };
+
+    TieredSeries() : TieredSeries(Policy{}) {}
+    explicit TieredSeries(const Policy& p) : m_policy(p) {}
+
+    void   add(qint64 ts, double v);           // 保持期間より古いものは捨てる
+    void   advance(qint64 now);                // 時刻を進めて畳み込み（戻りは無視）
+    double rangeSum(qint64 fromMs, qint64 toMs) const;   // [from, to)
+    double total() const { return m_total; }   // 保持中の合計
+    double rawWindowSum() const { return m_rawSum; }                    // 直近 rawMs（生データ層）
+    double minuteWindowSum() const { return m_rawSum + m_minuteSum; }   // 直近 minuteMs（古い端は分単位）
+    bool   isEmpty() const { return m_raw.empty() && m_minutes.isEmpty() && m_hours.isEmpty(); }
+
+private:
+    struct Point { qint64 ts; double v; };
+
+    void addToTier(QMap<qint64, double>& tier, qint64 bucketMs, qint64 ts, double v);
+
+    Policy m_policy;
+    qint64 m_now{ 0 };                          // 見えている最新時刻
+    std::deque<Point>     m_raw;                // ts 昇順
+    QMap<qint64, double>  m_minutes;            // 分の開始時刻 → 合計
+    QMap<qint64, double>  m_hours;              // 時の開始時刻 → 合計
+    double m_total{ 0.0 };
+    double m_rawSum{ 0.0 };                     // m_raw の合計
+    double m_minuteSum{ 0.0 };                  // m_minutes の合計
+};
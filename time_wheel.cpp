@@ -0,0 +1,90 @@
+// time_wheel.cpp
+#include "time_wheel.h"
+#include <algorithm>
+
+TimeWheel::TimeWheel(qint64 bucketMs, int nBuckets)
+    : m_bucketMs(std::max<qint64>(bucketMs, 1))
+{
+    m_ring.resize(std::max(nBuckets, 1));
+}
+
+int TimeWheel::addWindow(qint64 windowMs) {
+    const int buckets = int(std::clamp<qint64>((windowMs + m_bucketMs - 1) / m_bucketMs, 1, m_ring.size()));
+    for (int i = 0; i < m_windows.size(); ++i)
+        if (m_windows[i].buckets == buckets) return i;
+    m_windows.push_back(Window{ buckets, 0.0 });
+    recompute();
+    return int(m_windows.size()) - 1;
+}
+
+void TimeWheel::clear() {
+    for (auto& s : m_ring) s = Slot{};
+    for (auto& w : m_windows) w.sum = 0.0;
+    m_headIdx = -1;
+    m_stepsSinceRecompute = 0;
+}
+
+void TimeWheel::advance(qint64 now) {
+    const qint64 nowIdx = now / m_bucketMs;
+    if (m_headIdx < 0) { m_headIdx = nowIdx; return; }
+    if (nowIdx <= m_headIdx) return;
+
+    const qint64 n = m_ring.size();
+    if (nowIdx - m_headIdx >= n) {
+        // 一周以上空いた：全部窓の外
+        for (auto& s : m_ring) s = Slot{};
+        for (auto& w : m_windows) w.sum = 0.0;
+        m_headIdx = nowIdx;
+        m_stepsSinceRecompute = 0;
+        return;
+    }
+
+    for (qint64 i = m_headIdx + 1; i <= nowIdx; ++i) {
+        // 各窓から、ちょうど外れるバケット（i - 窓長）を引く
+        for (auto& w : m_windows) {
+            const qint64 out = i - w.buckets;
+            if (out < 0) continue;
+            const Slot& s = m_ring[int(out % n)];
+            if (s.idx == out) w.sum -= s.v;
+        }
+        Slot& s = m_ring[int(i % n)];
+        s.idx = i;
+        s.v = 0.0;
+    }
+    m_headIdx = nowIdx;
+
+    m_stepsSinceRecompute += 1;
+    if (m_stepsSinceRecompute >= n) recompute();
+}
+
+void TimeWheel::add(qint64 ts, double v) {
+    const qint64 idx = ts / m_bucketMs;
+    if (m_headIdx < 0 || idx > m_headIdx) advance(ts);
+
+    const qint64 n = m_ring.size();
+    if (idx <= m_headIdx - n) return;   // リングより古い
+
+    Slot& s = m_ring[int(idx % n)];
+    if (s.idx != idx) { s.idx = idx; s.v = 0.0; }
+    s.v += v;
+    for (auto& w : m_windows)
+        if (idx > m_headIdx - w.buckets) w.sum += v;
+}
+
+double TimeWheel::sum(qint64 windowMs) const {
+    const int buckets = int(std::clamp<qint64>((windowMs + m_bucketMs - 1) / m_bucketMs, 1, m_ring.size()));
+    for (const auto& w : m_windows)
+        if (w.buckets == buckets) return w.sum;
+    Q_ASSERT(!"TimeWheel::sum: window not registered");
+    return 0.0;
+}
+
+void TimeWheel::recompute() {
+    m_stepsSinceRecompute = 0;
+    for (auto& w : m_windows) {
+        w.sum = 0.0;
+        if (m_headIdx < 0) continue;
+        for (const auto& s : m_ring)
+            if (s.idx >= 0 && s.idx > m_headIdx - w.buckets && s.idx <= m_headIdx) w.sum += s.v;
+    }
+}
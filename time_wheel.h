@@ -0,0 +1,38 @@
+// time_wheel.h
+#pragma once
+#include <QtGlobal>
+#include <QVector>
+
+// 固定幅バケットのリング＋複数窓の走行和。
+// - add: 該当バケットと、その時刻を含む窓の和に足すだけ（O(窓数)）
+// - advance: バケットが1つ進むごとに、各窓から外れるバケットを1つ引く（O(窓数)）
+// - sum: 走行和を返すだけ（O(1)）
+// 窓は「直近 windowMs（バケット単位に丸め）」で、最長でもリング全体まで。
+// 段は1つだけ：使っているのは dVol の 1m/5m（1秒×300）で、分・時間の窓は
+// TieredSeries の生データ層・分足層がそのまま段になっている（満期アクティビティ）
+class TimeWheel {
+public:
+    explicit TimeWheel(qint64 bucketMs = 1000, int nBuckets = 60);
+
+    int    addWindow(qint64 windowMs);          // 窓を登録（既にあればその番号）
+    void   add(qint64 ts, double v);            // リングより古い ts は捨てる
+    void   advance(qint64 now);                 // 時刻を進める（戻りは無視）
+    double sum(qint64 windowMs) const;          // 登録済みの窓の和（未登録は0）
+    double sumAt(int window) const { return m_windows[window].sum; }
+    void   clear();
+
+    qint64 bucketMs() const { return m_bucketMs; }
+    qint64 spanMs() const { return m_bucketMs * m_ring.size(); }
+
+private:
+    struct Slot { qint64 idx{ -1 }; double v{ 0.0 }; };
+    struct Window { int buckets{}; double sum{ 0.0 }; };
+
+    void recompute();                           // 浮動小数の誤差を畳むため一周ごとに取り直す
+
+    qint64 m_bucketMs;
+    QVector<Slot>   m_ring;
+    QVector<Window> m_windows;
+    qint64 m_headIdx{ -1 };
+    int    m_stepsSinceRecompute{ 0 };
+};
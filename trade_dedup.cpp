@@ -0,0 +1,103 @@
+// trade_dedup.cpp
+#include "trade_dedup.h"
+#include <QJsonArray>
+#include <algorithm>
+
+static constexpr qint64 ID_WINDOW_MS = 24ll * 60 * 60 * 1000;
+
+void TradeDedup::resize(int instCount) {
+    if (m_seq.size() < instCount) m_seq.resize(instCount);
+}
+
+void TradeDedup::clear() {
+    for (auto& v : m_seq) v.clear();
+    m_ids.clear();
+    m_idQueue.clear();
+}
+
+bool TradeDedup::seen(InstId id, qint64 seq, quint64 tradeId, qint64 ts) {
+    if (seq > 0 && id < InstId(m_seq.size())) {
+        QVector<Range>& v = m_seq[int(id)];
+        if (!insertSeq(v, seq)) return true;
+        if (v.size() > MAX_RANGES) compact(v, seq);
+        return false;
+    }
+    if (tradeId != 0) return seenId(tradeId, ts);
+    return false;                         // 判定材料なし（通す）
+}
+
+bool TradeDedup::insertSeq(QVector<Range>& v, qint64 seq) {
+    // 通常は末尾（最新）に伸びるので後ろから当たる
+    if (v.isEmpty() || seq > v.back().hi + 1) { v.push_back(Range{ seq, seq }); return true; }
+    if (seq == v.back().hi + 1) { v.back().hi = seq; return true; }
+
+    // seq 以上の hi を持つ最初の区間
+    auto it = std::lower_bound(v.begin(), v.end(), seq,
+        [](const Range& r, qint64 s) { return r.hi < s; });
+    if (it != v.end() && it->lo <= seq) return false;       // 既出
+
+    const bool joinPrev = (it != v.begin() && std::prev(it)->hi + 1 == seq);
+    const bool joinNext = (it != v.end() && it->lo - 1 == seq);
+    if (joinPrev && joinNext) {
+        std::prev(it)->hi = it->hi;
+        v.erase(it);
+    }
+    else if (joinPrev) std::prev(it)->hi = seq;
+    else if (joinNext) it->lo = seq;
+    else v.insert(it, Range{ seq, seq });
+    return true;
+}
+
+void TradeDedup::compact(QVector<Range>& v, qint64 keepSeq) {
+    // 古い区間から捨てる。いま入れた seq の区間は残す（深掘り中のページが毎回忘れられないように）
+    while (v.size() > MAX_RANGES) {
+        const int drop = (v.front().lo <= keepSeq && keepSeq <= v.front().hi) ? 1 : 0;
+        v.remove(drop);
+    }
+}
+
+bool TradeDedup::seenId(quint64 tradeId, qint64 ts) {
+    const qint64 cutoff = ts - ID_WINDOW_MS;
+    while (!m_idQueue.isEmpty() && m_idQueue.front().first < cutoff) {
+        m_ids.remove(m_idQueue.front().second);
+        m_idQueue.pop_front();
+    }
+    if (m_ids.contains(tradeId)) return true;
+    m_ids.insert(tradeId);
+    m_idQueue.push_back(qMakePair(ts, tradeId));
+    return false;
+}
+
+void TradeDedup::fromJson(const QJsonObject& o, const InstrumentRegistry& reg) {
+    resize(reg.size());
+    for (auto it = o.begin(); it != o.end(); ++it) {
+        const InstId id = reg.find(it.key());
+        if (!reg.valid(id)) continue;
+        const QJsonArray a = it.value().toArray();
+        QVector<Range>& v = m_seq[int(id)];
+        v.clear();
+        for (int k = 0; k + 1 < a.size(); k += 2) {
+            const qint64 lo = qint64(a[k].toDouble()), hi = qint64(a[k + 1].toDouble());
+            if (lo <= 0 || hi < lo || (!v.isEmpty() && lo <= v.back().hi + 1)) continue;   // 昇順・非隣接だけ受ける
+            v.push_back(Range{ lo, hi });
+        }
+        if (v.size() > MAX_RANGES) compact(v);
+    }
+}
+
+void TradeDedup::appendRanges(InstId id, QVector<qint64>& out) const {
+    if (id >= InstId(m_seq.size())) return;
+    for (const Range& r : m_seq[int(id)]) { out.push_back(r.lo); out.push_back(r.hi); }
+}
+
+void TradeDedup::setRanges(InstId id, const qint64* loHi, int pairs) {
+    if (id >= InstId(m_seq.size())) return;
+    QVector<Range>& v = m_seq[int(id)];
+    v.clear();
+    for (int k = 0; k < pairs; ++k) {
+        const qint64 lo = loHi[2 * k], hi = loHi[2 * k + 1];
+        if (lo <= 0 || hi < lo || (!v.isEmpty() && lo <= v.back().hi + 1)) continue;   // 昇順・非隣接だけ受ける
+        v.push_back(Range{ lo, hi });
+    }
+    if (v.size() > MAX_RANGES) compact(v);
+}
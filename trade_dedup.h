@@ -0,0 +1,44 @@
+// trade_dedup.h
+#pragma once
+#include <QtGlobal>
+#include <QJsonObject>
+#include <QSet>
+#include <QVector>
+#include <QPair>
+#include "instrument_registry.h"
+
+// 約定の二重取り込み防止（ライブ・差分・フル・手動バックフィル・ストア再生で共有。GUI スレッド専用）。
+// - 主キーは銘柄ごとの trade_seq。既出 seq を昇順・重なり無しの区間 [lo, hi] で持つ
+//   （順に届けば区間は伸びるだけ。フル履歴の深掘りとライブは別区間として並び、追いつけば合流する）
+// - 区間数が MAX_RANGES を超えたら一番古い（seq の小さい）区間から忘れる（銘柄あたり定数メモリ）。
+//   古い重複を通すことはあっても、穴を既出扱いにして新しい約定を落とすことはしない
+// - trade_seq が無い約定（銘柄不明・旧データ）だけ trade_id の整数集合で見る（24h で捨てる）
+class TradeDedup {
+public:
+    static constexpr int MAX_RANGES = 64;
+
+    void resize(int instCount);           // 銘柄表は追記のみなので伸ばすだけ
+    void clear();
+
+    // 未見なら記録して false、既出なら true
+    bool seen(InstId id, qint64 seq, quint64 tradeId, qint64 ts);
+
+    // 旧形式（JSON）スナップショットからの引き継ぎ：{instrument_name: [lo, hi, lo, hi, ...]}
+    void fromJson(const QJsonObject& o, const InstrumentRegistry& reg);
+
+    // バイナリスナップショット用：区間を lo, hi の順で out へ追記 / 丸ごと差し替え
+    void appendRanges(InstId id, QVector<qint64>& out) const;
+    void setRanges(InstId id, const qint64* loHi, int pairs);
+
+private:
+    struct Range { qint64 lo; qint64 hi; };    // 両端を含む
+
+    static bool insertSeq(QVector<Range>& v, qint64 seq);   // 既出なら false
+    static void compact(QVector<Range>& v, qint64 keepSeq = 0);   // keepSeq を含む区間は残す
+
+    bool seenId(quint64 tradeId, qint64 ts);
+
+    QVector<QVector<Range>> m_seq;        // InstId → 既出 seq の区間
+    QSet<quint64> m_ids;
+    QVector<QPair<qint64, quint64>> m_idQueue;   // (ts, id)
+};
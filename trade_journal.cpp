@@ -0,0 +1,151 @@
+// trade_journal.cpp
+#include "trade_journal.h"
+#include <QDir>
+#include <QMutexLocker>
+#include <algorithm>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// OS のキャッシュまで落とす（電源断でもコミット済みの分は残す）
+static void syncToDisk(QFile& f) {
+    f.flush();
+#ifdef Q_OS_WIN
+    _commit(f.handle());
+#else
+    ::fsync(f.handle());
+#endif
+}
+
+QString TradeJournal::pathOf(quint64 gen) const {
+    return m_dir + QStringLiteral("/%1.wal").arg(gen, 12, 10, QLatin1Char('0'));
+}
+
+QVector<quint64> TradeJournal::generations() const {
+    QVector<quint64> out;
+    const QStringList files = QDir(m_dir).entryList(QStringList() << QStringLiteral("*.wal"), QDir::Files);
+    for (const QString& f : files) {
+        bool ok = false;
+        const quint64 g = f.left(f.size() - 4).toULongLong(&ok);
+        if (ok) out.push_back(g);
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+bool TradeJournal::open(const QString& dir) {
+    close();
+    if (!QDir().mkpath(dir)) return false;
+    m_dir = dir;
+
+    const QVector<quint64> gens = generations();
+    m_gen = gens.isEmpty() ? 1 : gens.back() + 1;
+    m_stop = false;
+    m_chunks.push_back(Chunk{ m_gen, {} });   // 空でもファイルを作っておく
+
+    m_thread = QThread::create([this] { run(); });
+    m_thread->setObjectName(QStringLiteral("TradeJournal"));
+    m_thread->start();
+    return true;
+}
+
+void TradeJournal::close() {
+    if (!m_thread) return;
+    {
+        QMutexLocker lk(&m_mu);
+        m_stop = true;
+        m_wake.wakeAll();
+    }
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+    m_chunks.clear();
+    m_dir.clear();
+}
+
+void TradeJournal::append(const JournalRecord& r) {
+    if (!m_thread) return;
+    QMutexLocker lk(&m_mu);
+    const bool wasEmpty = m_chunks.empty();
+    if (wasEmpty || m_chunks.back().gen != m_gen) m_chunks.push_back(Chunk{ m_gen, {} });
+    m_chunks.back().recs.push_back(r);
+    if (wasEmpty) m_wake.wakeOne();
+}
+
+quint64 TradeJournal::rotate() {
+    if (!m_thread) return m_gen;
+    QMutexLocker lk(&m_mu);
+    ++m_gen;
+    m_chunks.push_back(Chunk{ m_gen, {} });     // 書き込み側に旧世代を閉じさせる
+    m_wake.wakeOne();
+    return m_gen;
+}
+
+void TradeJournal::dropBefore(quint64 gen) {
+    if (m_dir.isEmpty()) return;
+    for (quint64 g : generations())
+        if (g < gen) QFile::remove(pathOf(g));   // 消せなければ次回また試す
+}
+
+void TradeJournal::sync() {
+    if (!m_thread) return;
+    QMutexLocker lk(&m_mu);
+    while (!m_chunks.empty() || m_writing) m_idle.wait(&m_mu);
+}
+
+void TradeJournal::run() {
+    QFile file;
+    quint64 fileGen = 0;
+
+    for (;;) {
+        std::deque<Chunk> work;
+        {
+            QMutexLocker lk(&m_mu);
+            while (m_chunks.empty() && !m_stop) m_wake.wait(&m_mu);
+            if (m_chunks.empty() && m_stop) break;
+            work.swap(m_chunks);
+            m_writing = true;
+        }
+
+        for (const Chunk& c : work) {
+            if (c.gen != fileGen || !file.isOpen()) {
+                if (file.isOpen()) { syncToDisk(file); file.close(); }
+                file.setFileName(pathOf(c.gen));
+                fileGen = c.gen;
+                if (!file.open(QIODevice::ReadWrite)) continue;
+                if (file.size() < HEADER) {
+                    const quint32 hdr[4] = { MAGIC, VERSION, quint32(sizeof(JournalRecord)), 0 };
+                    file.resize(0);
+                    file.write(reinterpret_cast<const char*>(hdr), sizeof(hdr));
+                }
+                else {
+                    // 書きかけで落ちた半端な記録は切り捨ててから追記
+                    const qint64 body = file.size() - HEADER;
+                    const qint64 whole = body - body % qint64(sizeof(JournalRecord));
+                    if (whole != body) file.resize(HEADER + whole);
+                }
+                file.seek(file.size());
+            }
+            if (!c.recs.isEmpty())
+                file.write(reinterpret_cast<const char*>(c.recs.constData()),
+                    qint64(c.recs.size()) * qint64(sizeof(JournalRecord)));
+        }
+        if (file.isOpen()) syncToDisk(file);   // まとめて1回
+
+        bool stopping;
+        {
+            QMutexLocker lk(&m_mu);
+            m_writing = false;
+            stopping = m_stop;
+            if (m_chunks.empty()) m_idle.wakeAll();
+        }
+        // 続けて来る分を次のコミットにまとめる
+        if (!stopping) QThread::msleep(GROUP_MS);
+    }
+
+    if (file.isOpen()) { syncToDisk(file); file.close(); }
+    QMutexLocker lk(&m_mu);
+    m_idle.wakeAll();
+}
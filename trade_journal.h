@@ -0,0 +1,100 @@
+// trade_journal.h
+#pragma once
+#include <QtGlobal>
+#include <QString>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <QVector>
+#include <cstring>
+#include <deque>
+
+// 残存へ反映した1約定ぶんの差分（ディスク上もこの並び。56 バイト）
+struct JournalRecord {
+    qint64  ts{};
+    qint64  tradeSeq{};     // 無ければ 0（復旧時に重複判定へ戻す）
+    qint64  expMs{};
+    double  signedAmt{};
+    double  dVol{};
+    qint32  strike{};       // クラスタキーの行使（丸め後）
+    quint32 nameId{};       // TradeStore の名前表の番号（起動をまたいで不変）
+    quint8  isCall{};
+    quint8  reserved[7]{};
+};
+static_assert(sizeof(JournalRecord) == 56, "JournalRecord layout is part of the file format");
+
+// 残存の追記専用ジャーナル（先行書き込みログ）。
+//   <dir>/NNNNNNNNNNNN.wal : 世代ごとのファイル（16 バイトヘッダ＋JournalRecord の列）
+// GUI は append で積むだけ。書き込みスレッドが溜まった分を1回の write＋fsync でまとめて書く（グループコミット）。
+// チェックポイントの直前に rotate で世代を切り、保存できたら dropBefore で古い世代を消す。
+// 復旧は「チェックポイント＋その世代以降の replay」
+class TradeJournal {
+public:
+    static constexpr quint32 MAGIC = 0x4C415742u;   // "BWAL"
+    static constexpr quint32 VERSION = 1;
+    static constexpr qint64  HEADER = 16;
+    static constexpr int     GROUP_MS = 20;         // 1回のコミットにまとめる待ち時間
+
+    ~TradeJournal() { close(); }
+
+    bool open(const QString& dir);        // 既存の世代は残し、その次の世代へ書き始める
+    void close();                         // 残りを書き切ってスレッドを止める
+    bool isOpen() const { return m_thread != nullptr; }
+
+    void    append(const JournalRecord& r);
+    quint64 rotate();                     // 以降は新しい世代へ。新しい世代番号を返す
+    quint64 generation() const { return m_gen; }
+    void    dropBefore(quint64 gen);      // gen 未満の世代ファイルを消す
+    void    sync();                       // 積んだ分が書き終わるまで待つ
+
+    // fromGen 以降の記録を世代順・追記順に f(const JournalRecord&) へ。戻り値は件数
+    template <typename F>
+    qint64 replay(quint64 fromGen, F&& f);
+
+private:
+    struct Chunk {
+        quint64 gen;
+        QVector<JournalRecord> recs;
+    };
+
+    void run();                           // 書き込みスレッド
+    QString pathOf(quint64 gen) const;
+    QVector<quint64> generations() const; // 昇順
+
+    QString  m_dir;
+    quint64  m_gen{ 0 };                  // 書き込み先の世代（GUI 側の認識）
+    QThread* m_thread{ nullptr };
+
+    QMutex         m_mu;                  // 以下 m_mu で保護
+    QWaitCondition m_wake;                // 書き込みスレッドを起こす
+    QWaitCondition m_idle;                // 書き終わりを待つ側へ
+    std::deque<Chunk> m_chunks;
+    bool m_writing{ false };
+    bool m_stop{ false };
+};
+
+template <typename F>
+qint64 TradeJournal::replay(quint64 fromGen, F&& f) {
+    if (m_dir.isEmpty()) return 0;
+    sync();
+
+    qint64 n = 0;
+    for (quint64 gen : generations()) {
+        if (gen < fromGen) continue;
+        QFile file(pathOf(gen));
+        if (!file.open(QIODevice::ReadOnly)) continue;
+        const qint64 cnt = (file.size() - HEADER) / qint64(sizeof(JournalRecord));   // 書きかけの末尾は捨てる
+        if (cnt <= 0) continue;
+        const uchar* base = file.map(0, HEADER + cnt * qint64(sizeof(JournalRecord)));
+        if (!base) continue;
+        quint32 hdr[4];
+        std::memcpy(hdr, base, sizeof(hdr));
+        if (hdr[0] == MAGIC && hdr[1] == VERSION && hdr[2] == sizeof(JournalRecord)) {
+            const JournalRecord* recs = reinterpret_cast<const JournalRecord*>(base + HEADER);
+            for (qint64 i = 0; i < cnt; ++i) { f(recs[i]); ++n; }
+        }
+        file.unmap(const_cast<uchar*>(base));
+    }
+    return n;
+}
@@ -0,0 +1,222 @@
+// trade_store.cpp
+#include "trade_store.h"
+#include <QDir>
+#include <QDate>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <cstring>
+
+const QString TradeStore::ALL = QStringLiteral("*");
+
+static constexpr qint64 TS_DAY_MS = 24ll * 60 * 60 * 1000;
+
+bool TradeStore::open(const QString& dir) {
+    close();
+    if (!QDir().mkpath(dir)) return false;
+    m_dir = dir;
+    loadNames();
+    loadCoverage();
+    return true;
+}
+
+void TradeStore::close() {
+    if (!isOpen()) return;
+    flush();
+    m_seg.close();
+    m_segDay = -1;
+    m_namesFile.close();
+    m_names.clear();
+    m_nameIds.clear();
+    m_coverage.clear();
+    m_dir.clear();
+}
+
+QString TradeStore::segmentPath(qint64 day) const {
+    const QDate d = QDate(1970, 1, 1).addDays(day);
+    return m_dir + QLatin1Char('/') + d.toString(QStringLiteral("yyyyMMdd")) + QStringLiteral(".seg");
+}
+
+/* ---------- 名前表 ---------- */
+
+void TradeStore::loadNames() {
+    m_names.clear();
+    m_nameIds.clear();
+    m_namesFile.setFileName(m_dir + QStringLiteral("/names.tbl"));
+    if (m_namesFile.open(QIODevice::ReadOnly)) {
+        while (!m_namesFile.atEnd()) {
+            const QString n = QString::fromUtf8(m_namesFile.readLine()).trimmed();
+            m_nameIds.insert(n, quint32(m_names.size()));
+            m_names << n;                 // 空行も番号を詰めずに保持
+        }
+        m_namesFile.close();
+    }
+    m_namesFile.open(QIODevice::WriteOnly | QIODevice::Append);
+}
+
+quint32 TradeStore::nameId(const QString& name) {
+    auto it = m_nameIds.constFind(name);
+    if (it != m_nameIds.cend()) return it.value();
+
+    const quint32 id = quint32(m_names.size());
+    m_names << name;
+    m_nameIds.insert(name, id);
+    // レコードより先に名前が残るよう即時書き出し（新銘柄はまれ）
+    if (m_namesFile.isOpen()) {
+        m_namesFile.write(name.toUtf8() + '\n');
+        m_namesFile.flush();
+    }
+    return id;
+}
+
+/* ---------- 追記 ---------- */
+
+void TradeStore::append(const TradeRecord& r) {
+    if (!isOpen()) return;
+    m_pending.push_back(r);
+    if (m_pending.size() >= 4096) flush();
+}
+
+bool TradeStore::segmentHeaderOk(const uchar* hdr, const QString& path) {
+    quint32 h[4];
+    std::memcpy(h, hdr, sizeof(h));
+    if (h[0] == SEG_MAGIC && h[1] == SEG_VERSION && h[2] == quint32(sizeof(TradeRecord))) return true;
+    qWarning("TradeStore: skip segment %s (magic %08x, version %u, record %u bytes)",
+        qPrintable(path), h[0], h[1], h[2]);
+    return false;
+}
+
+bool TradeStore::openSegmentForAppend(qint64 day) {
+    if (m_segDay == day && m_seg.isOpen()) return true;
+    m_seg.close();
+    m_segDay = -1;
+    m_seg.setFileName(segmentPath(day));
+    if (!m_seg.open(QIODevice::ReadWrite)) return false;
+
+    if (m_seg.size() < SEG_HEADER) {
+        const quint32 hdr[4] = { SEG_MAGIC, SEG_VERSION, quint32(sizeof(TradeRecord)), 0 };
+        m_seg.resize(0);
+        m_seg.write(reinterpret_cast<const char*>(hdr), sizeof(hdr));
+    }
+    else {
+        // 合わないヘッダのファイルには足さない（脇へ退けて作り直す）
+        const QByteArray hdr = m_seg.read(SEG_HEADER);
+        if (hdr.size() != SEG_HEADER || !segmentHeaderOk(reinterpret_cast<const uchar*>(hdr.constData()), m_seg.fileName())) {
+            m_seg.close();
+            QFile::remove(m_seg.fileName() + ".bad");
+            if (!QFile::rename(m_seg.fileName(), m_seg.fileName() + ".bad")) return false;
+            return openSegmentForAppend(day);
+        }
+        // 途中で落ちた半端なレコードは切り捨ててから追記
+        const qint64 body = m_seg.size() - SEG_HEADER;
+        const qint64 whole = body - body % qint64(sizeof(TradeRecord));
+        if (whole != body) m_seg.resize(SEG_HEADER + whole);
+    }
+    m_seg.seek(m_seg.size());
+    m_segDay = day;
+    return true;
+}
+
+void TradeStore::flush() {
+    if (!isOpen()) return;
+
+    if (!m_pending.isEmpty()) {
+        // 日をまたぐ分は日ごとにまとめて書く（通常は1日分だけ）
+        int i = 0;
+        while (i < m_pending.size()) {
+            const qint64 day = m_pending[i].ts / TS_DAY_MS;
+            int j = i;
+            while (j < m_pending.size() && m_pending[j].ts / TS_DAY_MS == day) ++j;
+            if (openSegmentForAppend(day))
+                m_seg.write(reinterpret_cast<const char*>(m_pending.constData() + i),
+                    qint64(j - i) * qint64(sizeof(TradeRecord)));
+            i = j;
+        }
+        m_seg.flush();
+        m_pending.clear();
+    }
+
+    if (m_coverageDirty) saveCoverage();
+}
+
+/* ---------- カバレッジ ---------- */
+
+void TradeStore::markCovered(const QString& key, qint64 fromMs, qint64 toMs) {
+    if (toMs <= fromMs) return;
+    auto& m = m_coverage[key];
+
+    // 左隣が重なる/接するなら取り込む
+    auto it = m.lowerBound(fromMs);
+    if (it != m.begin()) {
+        auto prev = std::prev(it);
+        if (prev.value() >= fromMs) {
+            fromMs = prev.key();
+            toMs = std::max(toMs, prev.value());
+            it = m.erase(prev);
+        }
+    }
+    // 右側で重なる/接するものを吸収
+    while (it != m.end() && it.key() <= toMs) {
+        toMs = std::max(toMs, it.value());
+        it = m.erase(it);
+    }
+    m.insert(fromMs, toMs);
+    m_coverageDirty = true;
+}
+
+QVector<QPair<qint64, qint64>> TradeStore::covered(const QString& key, qint64 fromMs, qint64 toMs) const {
+    QVector<QPair<qint64, qint64>> out;
+    const auto c = m_coverage.constFind(key);
+    if (c == m_coverage.cend() || toMs <= fromMs) return out;
+    const auto& m = c.value();
+
+    auto it = m.upperBound(fromMs);
+    if (it != m.begin()) --it;
+    for (; it != m.end() && it.key() < toMs; ++it) {
+        const qint64 a = std::max(fromMs, it.key());
+        const qint64 b = std::min(toMs, it.value());
+        if (a < b) out.push_back({ a, b });
+    }
+    return out;
+}
+
+QVector<QPair<qint64, qint64>> TradeStore::gaps(const QString& key, qint64 fromMs, qint64 toMs) const {
+    QVector<QPair<qint64, qint64>> out;
+    qint64 cur = fromMs;
+    for (const auto& iv : covered(key, fromMs, toMs)) {
+        if (iv.first > cur) out.push_back({ cur, iv.first });
+        cur = std::max(cur, iv.second);
+    }
+    if (cur < toMs) out.push_back({ cur, toMs });
+    return out;
+}
+
+void TradeStore::loadCoverage() {
+    m_coverage.clear();
+    QFile f(m_dir + QStringLiteral("/coverage.json"));
+    if (!f.open(QIODevice::ReadOnly)) return;
+    const QJsonObject o = QJsonDocument::fromJson(f.readAll()).object();
+    for (auto it = o.begin(); it != o.end(); ++it) {
+        auto& m = m_coverage[it.key()];
+        for (const auto& v : it.value().toArray()) {
+            const QJsonArray a = v.toArray();
+            if (a.size() == 2) m.insert(qint64(a[0].toDouble()), qint64(a[1].toDouble()));
+        }
+    }
+    m_coverageDirty = false;
+}
+
+void TradeStore::saveCoverage() {
+    QJsonObject o;
+    for (auto it = m_coverage.cbegin(); it != m_coverage.cend(); ++it) {
+        QJsonArray arr;
+        for (auto r = it.value().cbegin(); r != it.value().cend(); ++r)
+            arr.append(QJsonArray{ double(r.key()), double(r.value()) });
+        o.insert(it.key(), arr);
+    }
+    QSaveFile f(m_dir + QStringLiteral("/coverage.json"));
+    if (!f.open(QIODevice::WriteOnly)) return;
+    f.write(QJsonDocument(o).toJson(QJsonDocument::Compact));
+    if (f.commit()) m_coverageDirty = false;
+}
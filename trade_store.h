@@ -0,0 +1,120 @@
+// trade_store.h
+#pragma once
+#include <QtGlobal>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMap>
+#include <QVector>
+#include <QPair>
+#include <QFile>
+#include <algorithm>
+
+// 約定1件の固定長レコード（ディスク上もこの並び。64 バイト）
+struct TradeRecord {
+    qint64  ts{};
+    qint64  tradeSeq{};     // 無ければ 0
+    quint64 tradeId{};      // trade_id（数値部分。再生時の重複除け）
+    double  price{};        // 原資産建てプレミアム
+    double  amount{};       // 枚数（絶対値）
+    double  iv{};           // payload の iv（%。無ければ 0）
+    double  indexPrice{};   // 無ければ 0
+    quint32 nameId{};       // 名前表の番号（起動をまたいで不変）
+    qint8   side{};         // +1=buy, -1=sell
+    quint8  reserved[3]{};
+};
+static_assert(sizeof(TradeRecord) == 64, "TradeRecord layout is part of the file format");
+
+// 追記専用のローカル約定ストア。
+//   <dir>/names.tbl        : 銘柄名（1行1件、行番号が nameId）
+//   <dir>/YYYYMMDD.seg     : UTC 日ごとのセグメント（16 バイトヘッダ＋TradeRecord の列）
+//   <dir>/coverage.json    : 取得済み区間（キー → [from, to) の列）。"*" は通貨全体
+// 読み出しは QFile::map でそのまま走査する。
+class TradeStore {
+public:
+    static constexpr quint32 SEG_MAGIC = 0x44525442u;   // "BTRD"
+    static constexpr quint32 SEG_VERSION = 1;
+    static constexpr qint64  SEG_HEADER = 16;
+    static const QString ALL;                           // 通貨全体のカバレッジキー
+
+    ~TradeStore() { close(); }
+
+    bool open(const QString& dir);        // 無ければ作る
+    void close();
+    bool isOpen() const { return !m_dir.isEmpty(); }
+
+    quint32 nameId(const QString& name);  // 未登録なら名前表へ追記
+    QString name(quint32 id) const { return id < quint32(m_names.size()) ? m_names[int(id)] : QString(); }
+    int     nameCount() const { return int(m_names.size()); }
+
+    void append(const TradeRecord& r);    // バッファへ（flush でセグメントへ書く）
+    void flush();                         // 溜まった分の書き出し＋カバレッジ保存
+
+    // 取得済み区間（[from, to)）
+    void markCovered(const QString& key, qint64 fromMs, qint64 toMs);
+    QVector<QPair<qint64, qint64>> covered(const QString& key, qint64 fromMs, qint64 toMs) const;
+    QVector<QPair<qint64, qint64>> gaps(const QString& key, qint64 fromMs, qint64 toMs) const;
+
+    // [fromMs, toMs) の記録を時刻順に f(const TradeRecord&) へ渡す。戻り値は件数
+    template <typename F>
+    qint64 replay(qint64 fromMs, qint64 toMs, F&& f);
+
+private:
+    QString segmentPath(qint64 day) const;
+    static bool segmentHeaderOk(const uchar* hdr, const QString& path);   // 違えばログを出して false
+    bool    openSegmentForAppend(qint64 day);
+    void    loadNames();
+    void    loadCoverage();
+    void    saveCoverage();
+
+    QString m_dir;
+    QStringList m_names;
+    QHash<QString, quint32> m_nameIds;
+    QFile   m_namesFile;
+
+    QFile   m_seg;                        // 追記中のセグメント
+    qint64  m_segDay{ -1 };
+    QVector<TradeRecord> m_pending;
+
+    QHash<QString, QMap<qint64, qint64>> m_coverage;   // key → (from → to)、重なり無し
+    bool    m_coverageDirty{ false };
+};
+
+template <typename F>
+qint64 TradeStore::replay(qint64 fromMs, qint64 toMs, F&& f) {
+    if (!isOpen() || toMs <= fromMs) return 0;
+    flush();
+
+    static constexpr qint64 DAY = 24ll * 60 * 60 * 1000;
+    qint64 n = 0;
+    QVector<quint32> order;
+    for (qint64 day = fromMs / DAY; day <= (toMs - 1) / DAY; ++day) {
+        QFile file(segmentPath(day));
+        if (!file.open(QIODevice::ReadOnly)) continue;
+        const qint64 cnt = (file.size() - SEG_HEADER) / qint64(sizeof(TradeRecord));
+        if (cnt <= 0) continue;
+        uchar* base = file.map(0, SEG_HEADER + cnt * qint64(sizeof(TradeRecord)));
+        if (!base) continue;
+        // 旧い並び・別物・壊れたファイルはレコードとして読まない
+        if (!segmentHeaderOk(base, file.fileName())) { file.unmap(base); continue; }
+        const TradeRecord* recs = reinterpret_cast<const TradeRecord*>(base + SEG_HEADER);
+
+        // 追記順はほぼ時刻順。崩れている日だけ索引を並べ替える
+        bool sorted = true;
+        for (qint64 i = 1; i < cnt && sorted; ++i) sorted = recs[i - 1].ts <= recs[i].ts;
+        if (sorted) {
+            for (qint64 i = 0; i < cnt; ++i)
+                if (recs[i].ts >= fromMs && recs[i].ts < toMs) { f(recs[i]); ++n; }
+        }
+        else {
+            order.resize(int(cnt));
+            for (qint64 i = 0; i < cnt; ++i) order[int(i)] = quint32(i);
+            std::stable_sort(order.begin(), order.end(),
+                [recs](quint32 a, quint32 b) { return recs[a].ts < recs[b].ts; });
+            for (quint32 i : order)
+                if (recs[i].ts >= fromMs && recs[i].ts < toMs) { f(recs[i]); ++n; }
+        }
+        file.unmap(base);
+    }
+    return n;
+}